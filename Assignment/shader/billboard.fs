@@ -1,7 +1,6 @@
 #version 330 core
 
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 BrightColor;
 
 in vec2 TexCoords;
 
@@ -15,9 +14,4 @@ void main()
 	}
 
     FragColor = Color;//Color;
-	//float brightness = dot(Color, vec3(0.2126, 0.7152, 0.0722));
-    //if(brightness >= 1.0)
-    //    BrightColor = vec4(Color, 1.0);
-    //else
-    BrightColor = vec4(0.0, 0.0, 0.0, 1.0);
 }
\ No newline at end of file
@@ -1,22 +1,53 @@
 #version 330 core
+// the layered passes pick the layer per instance, one draw covers every view
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_layer : enable
 
 layout (location = 0) in vec3 aPos;
 layout (location = 2) in vec2 aTexCoords;
+// transform of the ship the label belongs to (see instance_buffer.h)
+layout (location = 5) in mat4 aInstanceModel;
 
 out vec2 TexCoords;
 
+struct Light {
+	vec4 position; // point light position or light direction
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+};
+
+// per-frame constants, see frame_data.h
+layout (std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+	Light lights[4];
+	mat4 viewMatrices[4];
+	mat4 projections[4];
+	vec4 viewPositions[4];
+};
+
+// layered views (see frame_data.h): instance i draws view firstView + i % viewCount into layer
+// i % viewCount, the instance attributes advance every viewCount instances
+uniform int firstView;
+uniform int viewCount;
+// label placement relative to the ship position
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform vec3 CameraRight;
-uniform vec3 CameraUp;
-uniform vec3 CenterPos;
 
 void main()
 {
-	vec3 OldPosition = vec3(model * vec4(aPos, 1.0f));
+	int viewIndex = firstView + gl_InstanceID % max(viewCount, 1);
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_layer)
+	gl_Layer = gl_InstanceID % max(viewCount, 1);
+#endif
+	mat4 V = viewMatrices[viewIndex];
+	vec3 CameraRight = vec3(V[0][0], V[1][0], V[2][0]);
+	vec3 CameraUp = vec3(V[0][1], V[1][1], V[2][1]);
+	vec3 OldPosition = aInstanceModel[3].xyz + vec3(model * vec4(aPos, 1.0f));
 	vec3 NewPostion = OldPosition + CameraRight * aPos.x * 0.5 + CameraUp * aPos.y * 0.3;
 	//gl_Position = projection * view * model * vec4(aPos, 1.0);
-	gl_Position = projection * view * vec4(NewPostion, 1.0);
+	gl_Position = projections[viewIndex] * V * vec4(NewPostion, 1.0);
 	TexCoords = aTexCoords;	
 }
\ No newline at end of file
@@ -0,0 +1,22 @@
+#version 330 core
+// the layered passes pick the layer per instance, one draw covers every view
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_layer : enable
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoords;
+
+out vec2 TexCoords;
+// layered targets (one layer per view): instance i reads layer firstLayer + i and writes layer i
+flat out int Layer;
+
+uniform int firstLayer;
+
+void main()
+{
+    TexCoords = aTexCoords;
+    Layer = firstLayer + gl_InstanceID;
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_layer)
+    gl_Layer = gl_InstanceID;
+#endif
+    gl_Position = vec4(aPos, 1.0);
+}
\ No newline at end of file
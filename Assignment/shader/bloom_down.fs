@@ -0,0 +1,37 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+flat in int Layer;
+
+// one level of the bloom chain: image is the level above (twice the size), one layer per view
+uniform sampler2DArray image;
+// first level only: keep what is brighter than threshold (replaces the BrightColor output)
+uniform bool brightPass;
+uniform float threshold;
+// the part of image drawn this frame, [0, imageScale] (dynamic resolution)
+uniform vec2 imageScale;
+
+vec3 bright(vec2 uv)
+{
+    // the taps never read outside the drawn part
+    vec3 color = texture(image, vec3(min(uv, imageScale - 0.5 / textureSize(image, 0).xy), Layer)).rgb;
+    if (!brightPass)
+        return color;
+    float brightness = dot(color, vec3(0.2126, 0.7152, 0.0722));
+    return brightness > threshold ? color : vec3(0.0);
+}
+
+void main()
+{
+    // every bilinear tap averages 2x2 source texels: the centre tap covers the output texel,
+    // the four diagonal ones the ring around it (4x4 footprint, weights 1/2 and 4 x 1/8)
+    vec2 texel = 1.0 / textureSize(image, 0).xy;
+    vec2 uv = TexCoords * imageScale;
+    vec3 result = bright(uv) * 0.5;
+    result += bright(uv + vec2(-texel.x, -texel.y)) * 0.125;
+    result += bright(uv + vec2( texel.x, -texel.y)) * 0.125;
+    result += bright(uv + vec2(-texel.x,  texel.y)) * 0.125;
+    result += bright(uv + vec2( texel.x,  texel.y)) * 0.125;
+    FragColor = vec4(result, 1.0);
+}
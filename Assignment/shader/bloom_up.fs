@@ -0,0 +1,32 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+flat in int Layer;
+
+// the smaller level, blended over the level below it, one layer per view
+uniform sampler2DArray image;
+// the part of image drawn this frame, [0, imageScale] (dynamic resolution)
+uniform vec2 imageScale;
+
+vec3 tap(vec2 uv)
+{
+    return texture(image, vec3(min(uv, imageScale - 0.5 / textureSize(image, 0).xy), Layer)).rgb;
+}
+
+void main()
+{
+    // 3x3 tent (1 2 1 / 2 4 2 / 1 2 1) of bilinear taps one source texel apart
+    vec2 texel = 1.0 / textureSize(image, 0).xy;
+    vec2 uv = TexCoords * imageScale;
+    vec3 result = tap(uv) * 4.0;
+    result += tap(uv + vec2(-texel.x, 0.0)) * 2.0;
+    result += tap(uv + vec2( texel.x, 0.0)) * 2.0;
+    result += tap(uv + vec2(0.0, -texel.y)) * 2.0;
+    result += tap(uv + vec2(0.0,  texel.y)) * 2.0;
+    result += tap(uv + vec2(-texel.x, -texel.y));
+    result += tap(uv + vec2( texel.x, -texel.y));
+    result += tap(uv + vec2(-texel.x,  texel.y));
+    result += tap(uv + vec2( texel.x,  texel.y));
+    FragColor = vec4(result / 16.0, 1.0);
+}
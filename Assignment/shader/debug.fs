@@ -3,7 +3,9 @@ out vec4 FragColor;
 
 in vec2 TexCoords;
 
-uniform sampler2D depthMap;
+// layer 0 (the first view) of the scene colour array, sceneScale: the part of it drawn this frame
+uniform sampler2DArray depthMap;
+uniform vec2 sceneScale;
 uniform float near_plane;
 uniform float far_plane;
 
@@ -16,7 +18,7 @@ float LinearizeDepth(float depth)
 
 void main()
 {             
-    float depthValue = texture(depthMap, TexCoords).r;
+    float depthValue = texture(depthMap, vec3(TexCoords * sceneScale, 0.0)).r;
     FragColor = vec4(vec3(LinearizeDepth(depthValue) / far_plane), 1.0); // perspective
     //FragColor = vec4(vec3(depthValue), 1.0); // orthographic
 }
\ No newline at end of file
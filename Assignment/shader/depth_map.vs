@@ -1,10 +1,50 @@
 #version 330 core
+// the layered passes pick the layer per instance, one draw covers every view
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_layer : enable
 layout (location = 0) in vec3 aPos;
+layout (location = 5) in mat4 aInstanceModel;
 
-uniform mat4 lightSpaceMatrix;
+struct Light {
+	vec4 position; // point light position or light direction
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+};
+
+// per-frame constants, see frame_data.h
+layout (std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+	Light lights[4];
+	mat4 viewMatrices[4];
+	mat4 projections[4];
+	vec4 viewPositions[4];
+};
+
+// layered views (see frame_data.h): instance i draws view firstView + i % viewCount into layer
+// i % viewCount, the instance attributes advance every viewCount instances
+uniform int firstView;
+uniform int viewCount;
+uniform bool instanced;
 uniform mat4 model;
+// shadow map: light space; depth pre-pass of the colour pass: the camera, computed as in object.vs
+// so the colour pass finds the same depth
+uniform bool cameraDepth;
+invariant gl_Position;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * model * vec4(aPos, 1.0);
+    int viewIndex = firstView + gl_InstanceID % max(viewCount, 1);
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_layer)
+    gl_Layer = gl_InstanceID % max(viewCount, 1);
+#endif
+    mat4 M = instanced ? aInstanceModel : model;
+    vec3 worldPos = vec3(M * vec4(aPos, 1.0));
+    if (cameraDepth)
+        gl_Position = projections[viewIndex] * viewMatrices[viewIndex] * vec4(worldPos, 1.0);
+    else
+        gl_Position = lightSpaceMatrix * vec4(worldPos, 1.0);
 }
\ No newline at end of file
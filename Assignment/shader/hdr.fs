@@ -2,17 +2,28 @@
 out vec4 FragColor;
 
 in vec2 TexCoords;
+flat in int Layer;
 
-uniform sampler2D scene;
-uniform sampler2D bloomBlur;
+// one layer per view
+uniform sampler2DArray scene;
+uniform sampler2DArray bloomBlur;
 uniform bool bloom;
 uniform float exposure;
+// dynamic resolution: the frame fills [0, sceneScale] of scene and [0, bloomScale] of bloomBlur,
+// the bilinear fetch stretches it over the window
+uniform vec2 sceneScale;
+uniform vec2 bloomScale;
+
+vec3 upscale(sampler2DArray image, vec2 scale)
+{
+    return texture(image, vec3(min(TexCoords * scale, scale - 0.5 / textureSize(image, 0).xy), Layer)).rgb;
+}
 
 void main()
 {             
     const float gamma = 2.2;
-    vec3 hdrColor = texture(scene, TexCoords).rgb;      
-    vec3 bloomColor = texture(bloomBlur, TexCoords).rgb;
+    vec3 hdrColor = upscale(scene, sceneScale);
+    vec3 bloomColor = upscale(bloomBlur, bloomScale);
     if(bloom)
         hdrColor += bloomColor; // additive blending
     // tone mapping
@@ -3,9 +3,18 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 aTexCoords;
 
 out vec2 TexCoords;
+// views: instance i shows layer i in tile i of a columns x rows grid, the first row at the top
+flat out int Layer;
+
+uniform int columns;
+uniform int rows;
 
 void main()
 {
     TexCoords = aTexCoords;
-    gl_Position = vec4(aPos, 1.0);
+    Layer = gl_InstanceID;
+    vec2 grid = vec2(max(columns, 1), max(rows, 1));
+    vec2 tile = vec2(gl_InstanceID % int(grid.x), gl_InstanceID / int(grid.x));
+    vec2 corner = vec2(aPos.x + 1.0, 1.0 - aPos.y) * 0.5;
+    gl_Position = vec4(-1.0 + (tile.x + corner.x) * 2.0 / grid.x, 1.0 - (tile.y + corner.y) * 2.0 / grid.y, aPos.z, 1.0);
 }
\ No newline at end of file
@@ -1,63 +1,82 @@
 ﻿#version 330 core
 
 layout (location = 0) out vec4 FragColor;
-layout (location = 1) out vec4 BrightColor;
 
 in VS_OUT {
     vec3 FragPos;
     vec2 TexCoords;
     mat3 TBN;
 	vec4 FragPosLightSpace;
+	vec2 OceanCoords;
 } fs_in;
-
-struct PointLight{
-	vec3 position;
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+// the view the fragment was drawn for, its camera position lights it
+flat in int ViewIndex;
+
+struct Light {
+	vec4 position; // point light position or light direction
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
 };
 
-struct DirLight{
-	vec3 direction;
-
-	vec3 ambient;
-	vec3 diffuse;
-	vec3 specular;
+// per-frame constants, see frame_data.h
+layout (std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+	Light lights[4];
+	mat4 viewMatrices[4];
+	mat4 projections[4];
+	vec4 viewPositions[4];
 };
 
+// lights[]: 0 -> sun (point)  1 -> right  2 -> left  3 -> back (directional)
+const int SUN_LIGHT = 0;
+const int RIGHT_LIGHT = 1;
+const int LEFT_LIGHT = 2;
+const int BACK_LIGHT = 3;
+
 uniform int objectNum;
 // 1 -> ship  2 -> water
-uniform vec3 viewPos;
 uniform sampler2D shadowMap;
+// same depth map through a comparison sampler, and the VSM moments (see shadow_filter.h)
+uniform sampler2DShadow shadowMapCompare;
+uniform sampler2D shadowMoments;
+uniform int shadowTier;
+const int SHADOW_NONE = 0;
+const int SHADOW_PCF = 1;
+const int SHADOW_HARDWARE = 2;
+const int SHADOW_VSM = 3;
 uniform sampler2D texture_diffuse1;
 uniform sampler2D texture_normal1;
-
-uniform PointLight sunLight;
-
-uniform DirLight rightLight;
-uniform DirLight leftLight;
-uniform DirLight backLight;
+// FFT ocean: world space normals of the water
+uniform bool oceanWaves;
+uniform sampler2D oceanNormals;
 
 float ShadowCalculation(vec4 fragPosLightSpace, vec3 norm);
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir);
+vec3 CalcPointLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir);
+vec3 CalcDirLight(Light light, vec3 normal, vec3 viewDir);
 
 void main()
 {    
 
-	vec3 norm = texture(texture_normal1, fs_in.TexCoords).rgb;
-	norm = normalize(norm * 2.0 - 1.0);
+	// normal maps are baked to BC5, x and y of the unit normal
+	vec2 xy = texture(texture_normal1, fs_in.TexCoords).rg * 2.0 - 1.0;
+	vec3 norm = vec3(xy, sqrt(max(0.0, 1.0 - dot(xy, xy))));
 	norm = normalize(fs_in.TBN * norm);
+	bool ocean = oceanWaves && objectNum == 2;
+	if (ocean)
+		norm = normalize(texture(oceanNormals, fs_in.OceanCoords).xyz * 2.0 - 1.0);
 
-	vec3 viewDir = normalize(viewPos - fs_in.FragPos);
+	vec3 viewDir = normalize(viewPositions[ViewIndex].xyz - fs_in.FragPos);
 	vec3 objectColor = texture(texture_diffuse1, fs_in.TexCoords).rgb;
 
-	vec3 mainLight = CalcPointLight(sunLight, norm, fs_in.FragPos, viewDir);
+	vec3 mainLight = CalcPointLight(lights[SUN_LIGHT], norm, fs_in.FragPos, viewDir);
 
-	vec3 rightDirLighting = CalcDirLight(rightLight, norm, viewDir);
-	vec3 leftDirLighting = CalcDirLight(leftLight, norm, viewDir);
-	vec3 backDirLighting = CalcDirLight(backLight, norm, viewDir);
+	vec3 rightDirLighting = CalcDirLight(lights[RIGHT_LIGHT], norm, viewDir);
+	vec3 leftDirLighting = CalcDirLight(lights[LEFT_LIGHT], norm, viewDir);
+	vec3 backDirLighting = CalcDirLight(lights[BACK_LIGHT], norm, viewDir);
 
 	vec3 baseLight = rightDirLighting + leftDirLighting + backDirLighting;
 
@@ -66,23 +85,24 @@ void main()
 	if (objectNum == 1){
 		vec3 lighting =  objectColor * ((1 - shadow) * mainLight + baseLight);// * mainLight;// + baseLight);
 		FragColor = vec4(lighting, 1.0f);
-		float brightness = dot(lighting, vec3(0.2126, 0.7152, 0.0722));
-		if(brightness > 1.0) BrightColor = vec4(lighting, 1.0);
-		else BrightColor = vec4(0.0, 0.0, 0.0, 1.0f);
 	}
 	else if (objectNum == 2){
 		vec3 lighting = objectColor * ((1 - shadow)) + shadow * 0.2 * objectColor;// * mainLight;//((0.9 - shadow) * mainLight) * 
+		if (ocean) {
+			// the waves show through the sun's diffuse and highlight
+			vec3 sunDir = normalize(lights[SUN_LIGHT].position.xyz - fs_in.FragPos);
+			float diff = max(dot(norm, sunDir), 0.0);
+			float spec = pow(max(dot(norm, normalize(sunDir + viewDir)), 0.0), 128.0);
+			lighting = lighting * mix(0.8, 1.1, diff) + (1 - shadow) * spec * lights[SUN_LIGHT].specular.rgb;
+		}
 		FragColor = vec4(lighting, 0.5f);
-		float brightness = dot(lighting, vec3(0.2126, 0.7152, 0.0722));
-		if(brightness > 1.0) BrightColor = vec4(lighting, 1.0);
-		else BrightColor = vec4(0.0, 0.0, 0.0, 0.5f);
 	}
 	
 }
 
 
-vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir){	
-	vec3 lightDir = normalize(-light.direction);
+vec3 CalcDirLight(Light light, vec3 normal, vec3 viewDir){	
+	vec3 lightDir = normalize(-light.position.xyz);
 	// diff
 	float diff = max(dot(normal, lightDir), 0.0);
 	// specular
@@ -90,15 +110,15 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir){
 	vec3 halfwayDir = normalize(lightDir + viewDir);
 	float spec = pow(max(dot(viewDir, halfwayDir),0.0), 64.0);
 
-	vec3 ambient = light.ambient;
-	vec3 diffuse = light.diffuse * diff;
-	vec3 specular = light.specular * spec;
+	vec3 ambient = light.ambient.rgb;
+	vec3 diffuse = light.diffuse.rgb * diff;
+	vec3 specular = light.specular.rgb * spec;
 
 	return (ambient + diffuse + specular);
 }
 
-vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
-    vec3 lightDir = normalize(light.position - fragPos);
+vec3 CalcPointLight(Light light, vec3 normal, vec3 fragPos, vec3 viewDir){
+    vec3 lightDir = normalize(light.position.xyz - fragPos);
     // diffuse
     float diff = max(dot(normal, lightDir), 0.0);
     // specular
@@ -110,9 +130,9 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
 	// constant = 1.0 linear = 0.09  quadratic = 0.032
     //float attenuation = 1.5 / (1.0 + 0.09 * distance + 0.032 * (distance * distance));    
     // combine results
-    vec3 ambient = light.ambient;
-	vec3 diffuse = light.diffuse * diff;
-	vec3 specular = light.specular * spec;
+    vec3 ambient = light.ambient.rgb;
+	vec3 diffuse = light.diffuse.rgb * diff;
+	vec3 specular = light.specular.rgb * spec;
 	// * vec3(texture(texture_diffuse1, TexCoords));
 	//* vec3(texture(texture_diffuse1, TexCoords));
 	//* vec3(texture(material.specular, TexCoords));
@@ -124,19 +144,42 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir){
 
 float ShadowCalculation(vec4 fragPosLightSpace, vec3 norm){
 
+	if (shadowTier == SHADOW_NONE)
+		return 0.0;
+
     // perform perspective divide
     vec3 projCoords = fragPosLightSpace.xyz / fragPosLightSpace.w;
     // transform to [0,1] range
     projCoords = projCoords * 0.5 + 0.5;
-    // get closest depth value from light's perspective (using [0,1] range fragPosLight as coords)
-    float closestDepth = texture(shadowMap, projCoords.xy).r; 
+    if(projCoords.z > 1.0)
+        return 0.0;
     // get depth of current fragment from light's perspective
     float currentDepth = projCoords.z;
     // calculate bias (based on depth map resolution and slope)
     vec3 normal = norm;
-    vec3 lightDir = normalize(sunLight.position - fs_in.FragPos);
+    vec3 lightDir = normalize(lights[SUN_LIGHT].position.xyz - fs_in.FragPos);
     float bias = max(0.01 * (1.0 - dot(normal, lightDir)), 0.001);
 
+    if (shadowTier == SHADOW_HARDWARE)
+    {
+        // the sampler compares and filters 2x2 texels in one fetch
+        return 1.0 - texture(shadowMapCompare, vec3(projCoords.xy, currentDepth - bias));
+    }
+    if (shadowTier == SHADOW_VSM)
+    {
+        // Chebyshev upper bound on the lit fraction from the blurred moments
+        vec2 moments = texture(shadowMoments, projCoords.xy).rg;
+        float depth = currentDepth - bias;
+        if (depth <= moments.x)
+            return 0.0;
+        float variance = max(moments.y - moments.x * moments.x, 0.00002);
+        float d = depth - moments.x;
+        float lit = variance / (variance + d * d);
+        // cut off the tail to reduce light bleeding
+        lit = clamp((lit - 0.2) / 0.8, 0.0, 1.0);
+        return 1.0 - lit;
+    }
+
 	//float shadow = currentDepth - bias > closestDepth  ? 1.0 : 0.0;
     // check whether current frag pos is in shadow
 	float shadow = 0.0;
@@ -150,8 +193,6 @@ float ShadowCalculation(vec4 fragPosLightSpace, vec3 norm){
 		}    
     }
     shadow /= 9.0;
-
-    if(projCoords.z > 1.0)shadow = 0.0;
         
     return shadow;
 }
\ No newline at end of file
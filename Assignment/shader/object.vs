@@ -1,9 +1,15 @@
 #version 330 core
+// the layered passes pick the layer per instance, one draw covers every view
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_layer : enable
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 3) in vec3 aTangent;
 layout (location = 4) in vec3 aBitangent;
+// instanced draws: per-instance transform and normal matrix (see instance_buffer.h)
+layout (location = 5) in mat4 aInstanceModel;
+layout (location = 9) in mat3 aInstanceNormalMatrix;
 
 const vec3 up = vec3(0.0, 1.0, 1.0);
 
@@ -12,28 +18,69 @@ out VS_OUT {
     vec2 TexCoords;
     mat3 TBN;
 	vec4 FragPosLightSpace;
+	vec2 OceanCoords;
 } vs_out;
+flat out int ViewIndex;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
-uniform mat4 lightSpaceMatrix;
+struct Light {
+	vec4 position; // point light position or light direction
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+};
+
+// per-frame constants, see frame_data.h
+layout (std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+	Light lights[4];
+	mat4 viewMatrices[4];
+	mat4 projections[4];
+	vec4 viewPositions[4];
+};
 
+// layered views (see frame_data.h): instance i draws view firstView + i % viewCount into layer
+// i % viewCount, the instance attributes advance every viewCount instances
+uniform int firstView;
+uniform int viewCount;
+// otherwise model and normalMatrix come from uniforms, both computed on the CPU
+uniform bool instanced;
+uniform mat4 model;
+uniform mat3 normalMatrix;
 
+// FFT ocean (see ocean.h): the water is moved by the displacement map, read at the mip
+// level whose texels match the mesh spacing
+uniform int objectNum;
+uniform bool oceanWaves;
+uniform sampler2D oceanDisplacement;
+uniform float oceanPatchSize;
+uniform float oceanLod;
+// the depth pre-pass (depth_map.vs) has to produce the same depth
+invariant gl_Position;
 
 void main()
 {
-	vs_out.FragPos = vec3(model * vec4(aPos, 1.0));
+	int viewIndex = firstView + gl_InstanceID % max(viewCount, 1);
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_layer)
+	gl_Layer = gl_InstanceID % max(viewCount, 1);
+#endif
+	mat4 M = instanced ? aInstanceModel : model;
+	mat3 N3 = instanced ? aInstanceNormalMatrix : normalMatrix;
+
+	vs_out.FragPos = vec3(M * vec4(aPos, 1.0));
+	vs_out.OceanCoords = vs_out.FragPos.xz / oceanPatchSize;
+	if (oceanWaves && objectNum == 2)
+		vs_out.FragPos += textureLod(oceanDisplacement, vs_out.OceanCoords, oceanLod).xyz;
 	vs_out.TexCoords = aTexCoords;
 	vs_out.FragPosLightSpace = lightSpaceMatrix * vec4(vs_out.FragPos, 1.0);
 
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
-	
-	vec3 Normal = transpose(inverse(mat3(model))) * aNormal;
-	mat3 normalMatrix = transpose(inverse(mat3(model)));
+	gl_Position = projections[viewIndex] * viewMatrices[viewIndex] * vec4(vs_out.FragPos, 1.0);
+	ViewIndex = viewIndex;
 
-    vec3 T = normalize(normalMatrix * aTangent);
-    vec3 N = normalize(normalMatrix * Normal);
+    vec3 T = normalize(N3 * aTangent);
+    vec3 N = normalize(N3 * aNormal);
     T = normalize(T - dot(T, N) * N);
     vec3 B = cross(N, T);
     
@@ -0,0 +1,12 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// one step of the overdraw view: drawn where the stencil holds that many fragments
+uniform vec3 color;
+
+void main()
+{
+    FragColor = vec4(color, 1.0);
+}
@@ -0,0 +1,24 @@
+#version 330 core
+out vec2 Moments;
+
+in vec2 TexCoords;
+
+uniform sampler2D image;
+// (1, 0) or (0, 1)
+uniform vec2 direction;
+
+// 9-tap gaussian folded into 5 bilinear fetches
+const float offset[3] = float[] (0.0, 1.3846153846, 3.2307692308);
+const float weight[3] = float[] (0.2270270270, 0.3162162162, 0.0702702703);
+
+void main()
+{
+    vec2 step = direction / textureSize(image, 0);
+    vec2 result = texture(image, TexCoords).rg * weight[0];
+    for (int i = 1; i < 3; ++i)
+    {
+        result += texture(image, TexCoords + step * offset[i]).rg * weight[i];
+        result += texture(image, TexCoords - step * offset[i]).rg * weight[i];
+    }
+    Moments = result;
+}
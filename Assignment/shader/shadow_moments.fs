@@ -0,0 +1,21 @@
+#version 330 core
+out vec2 Moments;
+
+// shadow map, twice the size of the target
+uniform sampler2D depthMap;
+
+void main()
+{
+    // average of (z, z^2) over the 2x2 shadow map texels under this texel
+    ivec2 texel = ivec2(gl_FragCoord.xy) * 2;
+    vec2 moments = vec2(0.0);
+    for (int y = 0; y < 2; ++y)
+    {
+        for (int x = 0; x < 2; ++x)
+        {
+            float depth = texelFetch(depthMap, texel + ivec2(x, y), 0).r;
+            moments += vec2(depth, depth * depth);
+        }
+    }
+    Moments = moments * 0.25;
+}
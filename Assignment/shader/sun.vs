@@ -1,4 +1,7 @@
 #version 330 core
+// the layered passes pick the layer per instance, one draw covers every view
+#extension GL_ARB_shader_viewport_layer_array : enable
+#extension GL_AMD_vertex_shader_layer : enable
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
@@ -7,12 +10,37 @@ layout (location = 4) in vec3 aBitangent;
 
 out vec2 TexCoords;
 
+struct Light {
+	vec4 position; // point light position or light direction
+	vec4 ambient;
+	vec4 diffuse;
+	vec4 specular;
+};
+
+// per-frame constants, see frame_data.h
+layout (std140) uniform FrameData {
+	mat4 view;
+	mat4 projection;
+	mat4 lightSpaceMatrix;
+	vec4 viewPos;
+	Light lights[4];
+	mat4 viewMatrices[4];
+	mat4 projections[4];
+	vec4 viewPositions[4];
+};
+
+// layered views (see frame_data.h): instance i draws view firstView + i % viewCount into layer
+// i % viewCount, the instance attributes advance every viewCount instances
+uniform int firstView;
+uniform int viewCount;
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
 
 void main()
 {
+	int viewIndex = firstView + gl_InstanceID % max(viewCount, 1);
+#if defined(GL_ARB_shader_viewport_layer_array) || defined(GL_AMD_vertex_shader_layer)
+	gl_Layer = gl_InstanceID % max(viewCount, 1);
+#endif
 	TexCoords = aTexCoords;
-	gl_Position = projection * view * model * vec4(aPos, 1.0);
+	gl_Position = projections[viewIndex] * viewMatrices[viewIndex] * model * vec4(aPos, 1.0);
 }
\ No newline at end of file
@@ -0,0 +1,417 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "gpu_resources.h"
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Loads assets in the background so the first frame does not wait for them.
+// Textures are read from their baked files (texture_cache.h, baked first if needed) on a
+// pool of worker threads, every mip level is then streamed to the GPU on the main thread
+// through a ring in a pixel unpack buffer
+// (persistently mapped with ARB_buffer_storage, else mapped unsynchronized per copy),
+// at most budget bytes per frame. A texture exists as soon as it is requested and holds
+// a 1x1 placeholder colour until its levels arrive, so nothing waits for it.
+// Other CPU work (reading or building mesh caches) goes through run(): the work runs on a
+// worker, its follow-up on the main thread in update().
+
+// ring size, textures larger than this are uploaded straight from client memory
+const size_t ASSET_STREAM_RING_SIZE = 32 << 20;
+const size_t ASSET_STREAM_BUDGET = 16 << 20;
+
+class AssetLoader
+{
+public:
+	size_t budget; // bytes streamed per update(), one texture always goes through
+
+	AssetLoader(unsigned int threads, std::chrono::steady_clock::time_point start)
+		: budget(ASSET_STREAM_BUDGET), start(start), stopping(false), pendingJobs(0),
+		PBO(0), ring(NULL), persistent(false), head(0), s3tc(TextureCache::s3tcSupported()),
+		firstFrameMs(-1.0), fullyLoadedMs(-1.0), textureCount(0), jobCount(0), bytesStreamed(0), uncompressedBytes(0)
+	{
+		for (unsigned int i = 0; i < std::max(1u, threads); i++)
+			workers.push_back(std::thread([this]() { work(); }));
+
+		PBO = gpuResources().create(GPU_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+#ifdef GL_ARB_buffer_storage
+		if (GLAD_GL_ARB_buffer_storage)
+		{
+			GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+			glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ASSET_STREAM_RING_SIZE, NULL, flags);
+			ring = (unsigned char *)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ASSET_STREAM_RING_SIZE, flags);
+			persistent = ring != NULL;
+		}
+#endif
+		if (!persistent)
+			gpuResources().bufferData(GL_PIXEL_UNPACK_BUFFER, ASSET_STREAM_RING_SIZE, NULL, GL_STREAM_DRAW);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		gpuResources().allocated(GPU_BUFFER, PBO, MEMORY_STAGING, "texture stream ring", GL_STREAM_DRAW, ASSET_STREAM_RING_SIZE);
+	}
+
+	~AssetLoader() { stop(); }
+
+	// joins the workers, work that has not started is dropped
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+			jobs.clear();
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+		workers.clear();
+		for (size_t i = 0; i < fences.size(); i++)
+			glDeleteSync(fences[i].sync);
+		fences.clear();
+		requests.clear();
+		uploads.clear();
+	}
+
+	// 2D texture (mipmapped, repeat) from directory/file, the placeholder until it is loaded
+	unsigned int texture(const std::string &file, const std::string &directory, TextureKind kind, const glm::vec4 &placeholder)
+	{
+		std::vector<std::string> files(1, directory + "/" + file);
+		return request(GL_TEXTURE_2D, files, kind, placeholder);
+	}
+
+	// cube map from six faces in the order +X, -X, +Y, -Y, +Z, -Z
+	unsigned int cubemap(const std::vector<std::string> &faces, const glm::vec4 &placeholder)
+	{
+		return request(GL_TEXTURE_CUBE_MAP, faces, TEXTURE_COLOR, placeholder);
+	}
+
+	// work on a worker thread, then done on the main thread from update()
+	void run(std::function<void()> work, std::function<void()> done)
+	{
+		queue(Job(work, done, true));
+	}
+
+	// main thread, once per frame: follow-ups of finished work and the texture uploads;
+	// true when a run() job finished, e.g. a model that may cast shadows appeared
+	bool update()
+	{
+		std::deque<Job> completed;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			completed.swap(finished);
+		}
+		bool changed = false;
+		for (size_t i = 0; i < completed.size(); i++)
+		{
+			completed[i].done();
+			changed = changed || completed[i].external;
+			pendingJobs--;
+		}
+
+		// ranges the GPU has read, in the order they were fenced
+		while (!fences.empty())
+		{
+			GLint status = GL_UNSIGNALED;
+			glGetSynciv(fences.front().sync, GL_SYNC_STATUS, 1, NULL, &status);
+			if (status != GL_SIGNALED)
+				break;
+			glDeleteSync(fences.front().sync);
+			fences.pop_front();
+		}
+
+		size_t streamed = 0;
+		while (!uploads.empty())
+		{
+			TextureRequest &request = *uploads.front();
+			size_t bytes = request.bytes();
+			if (streamed > 0 && streamed + bytes > budget)
+				break;
+			upload(request);
+			gpuResources().memory().cpuReleased(MEMORY_CPU_IMAGES, bytes);
+			streamed += bytes;
+			for (std::list<TextureRequest>::iterator it = requests.begin(); it != requests.end(); ++it)
+			{
+				if (&*it == &request)
+				{
+					requests.erase(it);
+					break;
+				}
+			}
+			uploads.pop_front();
+		}
+
+		if (idle() && fullyLoadedMs < 0.0)
+			fullyLoadedMs = elapsedMs();
+		return changed;
+	}
+
+	bool idle() const { return pendingJobs == 0 && uploads.empty(); }
+
+	// call when the first frame is on screen
+	void firstFrame()
+	{
+		if (firstFrameMs < 0.0)
+			firstFrameMs = elapsedMs();
+	}
+
+	double firstFrameTime() const { return firstFrameMs; }
+	double fullyLoadedTime() const { return fullyLoadedMs; }
+
+	// "loading" member for the bench report
+	std::string report() const
+	{
+		std::ostringstream out;
+		out << "\"loading\": { \"threads\": " << workers.size() << ", \"first_frame_ms\": " << firstFrameMs
+			<< ", \"fully_loaded_ms\": " << fullyLoadedMs << ", \"textures\": " << textureCount
+			<< ", \"jobs\": " << jobCount << ", \"bytes_streamed\": " << bytesStreamed
+			<< ", \"block_compressed\": " << (s3tc ? "true" : "false") << ", \"uncompressed_bytes\": " << uncompressedBytes
+			<< ", \"persistent_mapping\": " << (persistent ? "true" : "false") << " }";
+		return out.str();
+	}
+
+private:
+	struct Job {
+		std::function<void()> work;
+		std::function<void()> done;
+		bool external; // from run(), not a texture read
+
+		Job(std::function<void()> work, std::function<void()> done, bool external) : work(work), done(done), external(external) {}
+	};
+
+	struct TextureRequest {
+		GLuint id;
+		GLenum target;
+		TextureKind kind;
+		std::vector<std::string> files;
+		std::vector<BakedTexture> images; // one per face
+		std::vector<unsigned char> loaded;
+		size_t remaining; // images still loading
+
+		size_t bytes() const
+		{
+			size_t total = 0;
+			for (size_t i = 0; i < images.size(); i++)
+				total += images[i].data.size();
+			return total;
+		}
+	};
+
+	// a range of the ring the GPU may still be reading
+	struct Fence {
+		GLsync sync;
+		size_t begin, end;
+	};
+
+	std::chrono::steady_clock::time_point start;
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Job> jobs;
+	std::deque<Job> finished;
+	bool stopping;
+	unsigned int pendingJobs; // main thread only, run() to done
+
+	std::list<TextureRequest> requests;
+	std::deque<TextureRequest *> uploads; // decoded, waiting for the stream budget
+
+	GLuint PBO;
+	unsigned char *ring; // persistent mapping
+	bool persistent;
+	size_t head;
+	std::deque<Fence> fences;
+	bool s3tc; // else BC1/BC3 are decoded on the workers
+
+	double firstFrameMs, fullyLoadedMs;
+	unsigned int textureCount, jobCount;
+	size_t bytesStreamed, uncompressedBytes; // and what the streamed levels are as RGBA8
+
+	double elapsedMs() const
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void work()
+	{
+		for (;;)
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+			if (stopping)
+				return;
+			Job job = jobs.front();
+			jobs.pop_front();
+			lock.unlock();
+
+			job.work();
+
+			lock.lock();
+			finished.push_back(job);
+		}
+	}
+
+	void queue(const Job &job)
+	{
+		pendingJobs++;
+		jobCount++;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			jobs.push_back(job);
+		}
+		wake.notify_one();
+	}
+
+	unsigned int request(GLenum target, const std::vector<std::string> &files, TextureKind kind, const glm::vec4 &placeholder)
+	{
+		GLuint id = gpuResources().create(GPU_TEXTURE);
+		glBindTexture(target, id);
+		for (size_t i = 0; i < files.size(); i++)
+			glTexImage2D(face(target, i), 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_FLOAT, &placeholder[0]);
+		setParameters(target);
+		glBindTexture(target, 0);
+		gpuResources().allocated(GPU_TEXTURE, id, MEMORY_TEXTURES, files[0], GL_RGBA, 4 * files.size());
+		textureCount++;
+
+		requests.push_back(TextureRequest());
+		TextureRequest *request = &requests.back();
+		request->id = id;
+		request->target = target;
+		request->kind = kind;
+		request->files = files;
+		request->images.resize(files.size());
+		request->loaded.assign(files.size(), 0);
+		request->remaining = files.size();
+		bool s3tc = this->s3tc;
+		for (size_t i = 0; i < files.size(); i++)
+		{
+			BakedTexture *image = &request->images[i];
+			unsigned char *loaded = &request->loaded[i];
+			std::string file = files[i];
+			// the loader threads are the parallelism, a bake compresses on this one alone
+			queue(Job([image, loaded, file, kind, s3tc]() {
+				*loaded = TextureCache::load(file, kind, s3tc, 1, *image);
+				gpuResources().memory().cpuAllocated(MEMORY_CPU_IMAGES, image->data.size());
+			}, [this, request]() {
+				if (--request->remaining == 0)
+					uploads.push_back(request);
+			}, false));
+		}
+		return id;
+	}
+
+	void upload(TextureRequest &request)
+	{
+		// keep the placeholder if an image is missing, a cube map needs all faces
+		for (size_t i = 0; i < request.images.size(); i++)
+			if (!request.loaded[i])
+				return;
+		glBindTexture(request.target, request.id);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		GLint maxLevel = 1000;
+		GLenum internalFormat = request.images[0].internalFormat;
+		size_t total = request.bytes();
+		for (size_t i = 0; i < request.images.size(); i++)
+		{
+			BakedTexture &image = request.images[i];
+			size_t bytes = image.data.size();
+			const unsigned char *data = &image.data[0];
+			size_t offset = 0;
+			bool streamed = bytes <= ASSET_STREAM_RING_SIZE;
+			if (streamed)
+			{
+				offset = stage(data, bytes);
+				data = (const unsigned char *)offset;
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+			}
+			TextureCache::upload(face(request.target, i), image, data);
+			if (streamed)
+			{
+				glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+				Fence fence = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), offset, offset + bytes };
+				fences.push_back(fence);
+			}
+			maxLevel = std::min(maxLevel, (GLint)image.levels.size() - 1);
+			gpuResources().uploaded(bytes, true);
+			bytesStreamed += bytes;
+			uncompressedBytes += image.uncompressedBytes;
+			image = BakedTexture();
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		glTexParameteri(request.target, GL_TEXTURE_MAX_LEVEL, maxLevel);
+		glBindTexture(request.target, 0);
+		gpuResources().allocated(GPU_TEXTURE, request.id, MEMORY_TEXTURES, request.files[0], internalFormat, total);
+	}
+
+	// copy into the ring, waiting for the GPU only if it still reads that range
+	size_t stage(const unsigned char *pixels, size_t bytes)
+	{
+		if (head + bytes > ASSET_STREAM_RING_SIZE)
+			head = 0;
+		size_t offset = head;
+		head += (bytes + 255) & ~(size_t)255;
+		for (size_t i = 0; i < fences.size(); )
+		{
+			if (fences[i].begin < offset + bytes && offset < fences[i].end)
+			{
+				glClientWaitSync(fences[i].sync, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+				glDeleteSync(fences[i].sync);
+				fences.erase(fences.begin() + i);
+			}
+			else
+				i++;
+		}
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+		if (persistent)
+			memcpy(ring + offset, pixels, bytes);
+		else
+		{
+			void *target = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+			if (target)
+				memcpy(target, pixels, bytes);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return offset;
+	}
+
+	static GLenum face(GLenum target, size_t i)
+	{
+		return target == GL_TEXTURE_CUBE_MAP ? (GLenum)(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i) : target;
+	}
+
+	// the parameters TextureFromFile and loadCubemap used, both trilinear now that every
+	// texture has its mip chain
+	static void setParameters(GLenum target)
+	{
+		if (target == GL_TEXTURE_CUBE_MAP)
+		{
+			glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+			glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		}
+		else
+		{
+			glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+			glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+			glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+			glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		}
+	}
+};
+
+#endif
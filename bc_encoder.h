@@ -0,0 +1,359 @@
+#ifndef BC_ENCODER_H
+#define BC_ENCODER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "parallel_for.h"
+
+// CPU encoders and decoders for the block compressed formats the texture cache bakes:
+//   BC1 (DXT1)  RGB, 8 bytes per 4x4 block
+//   BC3 (DXT5)  RGBA, a BC4 alpha block followed by a BC1 colour block
+//   BC5 (RGTC2) two channels, two BC4 blocks; used for normal maps
+// Blocks take 16 pixels of 4 bytes (RGBA) in row order. The colour endpoints come from the
+// principal axis of the block, refined once by least squares. The decoders are used when
+// the driver has no S3TC support and the texture has to be uploaded uncompressed.
+
+enum BlockFormat {
+	BLOCK_BC1,
+	BLOCK_BC3,
+	BLOCK_BC5
+};
+
+inline size_t blockBytes(BlockFormat format)
+{
+	return format == BLOCK_BC1 ? 8 : 16;
+}
+
+namespace bc {
+
+inline uint16_t pack565(const float c[3])
+{
+	int r = std::min(31, std::max(0, (int)(c[0] * 31.0f / 255.0f + 0.5f)));
+	int g = std::min(63, std::max(0, (int)(c[1] * 63.0f / 255.0f + 0.5f)));
+	int b = std::min(31, std::max(0, (int)(c[2] * 31.0f / 255.0f + 0.5f)));
+	return (uint16_t)(r << 11 | g << 5 | b);
+}
+
+inline void unpack565(uint16_t c, float out[3])
+{
+	int r = c >> 11 & 31, g = c >> 5 & 63, b = c & 31;
+	out[0] = (float)(r << 3 | r >> 2);
+	out[1] = (float)(g << 2 | g >> 4);
+	out[2] = (float)(b << 3 | b >> 2);
+}
+
+// four colour palette of a BC1 block in 4 colour mode
+inline void palette(uint16_t c0, uint16_t c1, float colors[4][3])
+{
+	unpack565(c0, colors[0]);
+	unpack565(c1, colors[1]);
+	for (int k = 0; k < 3; k++)
+	{
+		colors[2][k] = (2.0f * colors[0][k] + colors[1][k]) / 3.0f;
+		colors[3][k] = (colors[0][k] + 2.0f * colors[1][k]) / 3.0f;
+	}
+}
+
+// nearest palette entry per pixel, returns the squared error
+inline float fitIndices(const float pixels[16][3], const float colors[4][3], int indices[16])
+{
+	float total = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float best = 1e30f;
+		for (int p = 0; p < 4; p++)
+		{
+			float dr = pixels[i][0] - colors[p][0], dg = pixels[i][1] - colors[p][1], db = pixels[i][2] - colors[p][2];
+			float d = dr * dr + dg * dg + db * db;
+			if (d < best)
+			{
+				best = d;
+				indices[i] = p;
+			}
+		}
+		total += best;
+	}
+	return total;
+}
+
+// end points that minimise the error for fixed indices, false if the system is singular
+inline bool leastSquares(const float pixels[16][3], const int indices[16], float a[3], float b[3])
+{
+	static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+	float aa = 0.0f, bb = 0.0f, ab = 0.0f;
+	float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		float w = weights[indices[i]];
+		aa += w * w;
+		bb += (1.0f - w) * (1.0f - w);
+		ab += w * (1.0f - w);
+		for (int k = 0; k < 3; k++)
+		{
+			ax[k] += w * pixels[i][k];
+			bx[k] += (1.0f - w) * pixels[i][k];
+		}
+	}
+	float det = aa * bb - ab * ab;
+	if (std::fabs(det) < 1e-6f)
+		return false;
+	for (int k = 0; k < 3; k++)
+	{
+		a[k] = std::min(255.0f, std::max(0.0f, (ax[k] * bb - bx[k] * ab) / det));
+		b[k] = std::min(255.0f, std::max(0.0f, (bx[k] * aa - ax[k] * ab) / det));
+	}
+	return true;
+}
+
+inline void writeColorBlock(uint16_t c0, uint16_t c1, const int indices[16], unsigned char *out)
+{
+	static const int swapped[4] = { 1, 0, 3, 2 };
+	bool swap = c0 < c1;
+	if (swap)
+		std::swap(c0, c1);
+	uint32_t bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= (uint32_t)(c0 == c1 ? 0 : swap ? swapped[indices[i]] : indices[i]) << (2 * i);
+	out[0] = (unsigned char)(c0 & 0xFF);
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xFF);
+	out[3] = (unsigned char)(c1 >> 8);
+	for (int k = 0; k < 4; k++)
+		out[4 + k] = (unsigned char)(bits >> (8 * k));
+}
+
+// BC1 colour block, always 4 colour mode (c0 > c1) so it is also valid inside BC3
+inline void encodeColorBlock(const unsigned char rgba[64], unsigned char out[8])
+{
+	float pixels[16][3];
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			pixels[i][k] = rgba[i * 4 + k];
+			mean[k] += pixels[i][k] / 16.0f;
+		}
+	}
+
+	// principal axis of the colours by power iteration on the covariance
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		float r = pixels[i][0] - mean[0], g = pixels[i][1] - mean[1], b = pixels[i][2] - mean[2];
+		cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+		cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+	}
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+	for (int iteration = 0; iteration < 8; iteration++)
+	{
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float length = std::max(std::max(std::fabs(x), std::fabs(y)), std::fabs(z));
+		if (length < 1e-6f)
+			break;
+		axis[0] = x / length;
+		axis[1] = y / length;
+		axis[2] = z / length;
+	}
+
+	float lo = 1e30f, hi = -1e30f;
+	for (int i = 0; i < 16; i++)
+	{
+		float t = (pixels[i][0] - mean[0]) * axis[0] + (pixels[i][1] - mean[1]) * axis[1] + (pixels[i][2] - mean[2]) * axis[2];
+		lo = std::min(lo, t);
+		hi = std::max(hi, t);
+	}
+	float norm = axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2];
+	float a[3], b[3];
+	for (int k = 0; k < 3; k++)
+	{
+		a[k] = std::min(255.0f, std::max(0.0f, mean[k] + axis[k] * hi / std::max(norm, 1e-6f)));
+		b[k] = std::min(255.0f, std::max(0.0f, mean[k] + axis[k] * lo / std::max(norm, 1e-6f)));
+	}
+
+	uint16_t c0 = pack565(a), c1 = pack565(b);
+	float colors[4][3];
+	int indices[16];
+	palette(c0, c1, colors);
+	float error = fitIndices(pixels, colors, indices);
+
+	float refinedA[3], refinedB[3];
+	if (leastSquares(pixels, indices, refinedA, refinedB))
+	{
+		uint16_t r0 = pack565(refinedA), r1 = pack565(refinedB);
+		int refinedIndices[16];
+		palette(r0, r1, colors);
+		if (fitIndices(pixels, colors, refinedIndices) < error)
+		{
+			c0 = r0;
+			c1 = r1;
+			memcpy(indices, refinedIndices, sizeof(indices));
+		}
+	}
+	writeColorBlock(c0, c1, indices, out);
+}
+
+// BC4 block of one channel, 8 value mode between the minimum and the maximum
+inline void encodeChannelBlock(const unsigned char values[16], unsigned char out[8])
+{
+	int hi = 0, lo = 255;
+	for (int i = 0; i < 16; i++)
+	{
+		hi = std::max(hi, (int)values[i]);
+		lo = std::min(lo, (int)values[i]);
+	}
+	uint64_t bits = 0;
+	if (hi != lo)
+	{
+		float levels[8];
+		levels[0] = (float)hi;
+		levels[1] = (float)lo;
+		for (int k = 2; k < 8; k++)
+			levels[k] = ((8 - k) * hi + (k - 1) * lo) / 7.0f;
+		for (int i = 0; i < 16; i++)
+		{
+			int best = 0;
+			for (int k = 1; k < 8; k++)
+				if (std::fabs(values[i] - levels[k]) < std::fabs(values[i] - levels[best]))
+					best = k;
+			bits |= (uint64_t)best << (3 * i);
+		}
+	}
+	out[0] = (unsigned char)hi;
+	out[1] = (unsigned char)lo;
+	for (int k = 0; k < 6; k++)
+		out[2 + k] = (unsigned char)(bits >> (8 * k));
+}
+
+inline void decodeColorBlock(const unsigned char *in, unsigned char rgba[64])
+{
+	uint16_t c0 = (uint16_t)(in[0] | in[1] << 8), c1 = (uint16_t)(in[2] | in[3] << 8);
+	float colors[4][3];
+	palette(c0, c1, colors);
+	uint32_t bits = (uint32_t)in[4] | (uint32_t)in[5] << 8 | (uint32_t)in[6] << 16 | (uint32_t)in[7] << 24;
+	for (int i = 0; i < 16; i++)
+	{
+		int index = bits >> (2 * i) & 3;
+		for (int k = 0; k < 3; k++)
+			rgba[i * 4 + k] = (unsigned char)(colors[index][k] + 0.5f);
+		rgba[i * 4 + 3] = 255;
+	}
+}
+
+inline void decodeChannelBlock(const unsigned char *in, unsigned char *out, int stride)
+{
+	int hi = in[0], lo = in[1];
+	float levels[8];
+	levels[0] = (float)hi;
+	levels[1] = (float)lo;
+	for (int k = 2; k < 8; k++)
+		levels[k] = hi > lo ? ((8 - k) * hi + (k - 1) * lo) / 7.0f : k < 6 ? ((6 - k) * hi + (k - 1) * lo) / 5.0f : k == 6 ? 0.0f : 255.0f;
+	uint64_t bits = 0;
+	for (int k = 0; k < 6; k++)
+		bits |= (uint64_t)in[2 + k] << (8 * k);
+	for (int i = 0; i < 16; i++)
+		out[i * stride] = (unsigned char)(levels[bits >> (3 * i) & 7] + 0.5f);
+}
+
+} // namespace bc
+
+// one block of the format from 16 RGBA pixels
+inline void encodeBlock(BlockFormat format, const unsigned char rgba[64], unsigned char *out)
+{
+	unsigned char channel[16];
+	switch (format)
+	{
+	case BLOCK_BC1:
+		bc::encodeColorBlock(rgba, out);
+		break;
+	case BLOCK_BC3:
+		for (int i = 0; i < 16; i++)
+			channel[i] = rgba[i * 4 + 3];
+		bc::encodeChannelBlock(channel, out);
+		bc::encodeColorBlock(rgba, out + 8);
+		break;
+	case BLOCK_BC5:
+		for (int c = 0; c < 2; c++)
+		{
+			for (int i = 0; i < 16; i++)
+				channel[i] = rgba[i * 4 + c];
+			bc::encodeChannelBlock(channel, out + 8 * c);
+		}
+		break;
+	}
+}
+
+// 16 RGBA pixels of a block (BC5 decodes to red and green, blue 0, alpha 255)
+inline void decodeBlock(BlockFormat format, const unsigned char *in, unsigned char rgba[64])
+{
+	switch (format)
+	{
+	case BLOCK_BC1:
+		bc::decodeColorBlock(in, rgba);
+		break;
+	case BLOCK_BC3:
+		bc::decodeColorBlock(in + 8, rgba);
+		bc::decodeChannelBlock(in, rgba + 3, 4);
+		break;
+	case BLOCK_BC5:
+		bc::decodeChannelBlock(in, rgba, 4);
+		bc::decodeChannelBlock(in + 8, rgba + 1, 4);
+		for (int i = 0; i < 16; i++)
+		{
+			rgba[i * 4 + 2] = 0;
+			rgba[i * 4 + 3] = 255;
+		}
+		break;
+	}
+}
+
+// width x height RGBA image to blocks; partial blocks at the edges repeat the last row / column
+inline std::vector<unsigned char> compressImage(BlockFormat format, const unsigned char *rgba, int width, int height, unsigned int threads)
+{
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	size_t size = blockBytes(format);
+	std::vector<unsigned char> blocks((size_t)blocksX * blocksY * size);
+	parallelFor((size_t)blocksY, threads, [&](size_t by) {
+		unsigned char block[64];
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			for (int y = 0; y < 4; y++)
+			{
+				int sy = std::min((int)by * 4 + y, height - 1);
+				for (int x = 0; x < 4; x++)
+				{
+					int sx = std::min(bx * 4 + x, width - 1);
+					memcpy(block + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+				}
+			}
+			encodeBlock(format, block, &blocks[(by * blocksX + bx) * size]);
+		}
+	});
+	return blocks;
+}
+
+inline std::vector<unsigned char> decompressImage(BlockFormat format, const unsigned char *blocks, int width, int height)
+{
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	size_t size = blockBytes(format);
+	std::vector<unsigned char> rgba((size_t)width * height * 4);
+	unsigned char block[64];
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			decodeBlock(format, blocks + ((size_t)by * blocksX + bx) * size, block);
+			for (int y = 0; y < 4 && by * 4 + y < height; y++)
+				for (int x = 0; x < 4 && bx * 4 + x < width; x++)
+					memcpy(&rgba[((size_t)(by * 4 + y) * width + bx * 4 + x) * 4], block + (y * 4 + x) * 4, 4);
+		}
+	}
+	return rgba;
+}
+
+#endif
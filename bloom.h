@@ -0,0 +1,100 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <glad/glad.h>
+#include "gpu_resources.h"
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+struct BloomMip {
+	unsigned int FBO;		// every layer (layered) with several views
+	unsigned int texture;	// GL_TEXTURE_2D_ARRAY, one layer per view
+	int width;
+	int height;
+	std::vector<unsigned int> layerFBOs;	// one layer each, several views only
+};
+
+// Render targets of the bloom: level 0 is half the screen size, every further level half
+// the one before. The bright pass is downsampled through the levels and blended back up,
+// so level 0 ends up holding the blurred bright parts of the scene.
+// Every level has a layer per view like the scene targets, one instanced pass filters them all.
+class BloomChain
+{
+public:
+	BloomChain() : layerCount(1) {}
+
+	// levels is clamped so the smallest level is at least 2x2; internalFormat as the scene target
+	void create(int width, int height, int levels, GLenum internalFormat, int layers = 1)
+	{
+		layerCount = std::max(1, layers);
+		for (int i = 0; i < levels; i++)
+		{
+			width /= 2;
+			height /= 2;
+			if (width < 2 || height < 2)
+				break;
+
+			BloomMip mip;
+			mip.width = width;
+			mip.height = height;
+			mip.texture = gpuResources().create(GPU_TEXTURE);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, mip.texture);
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internalFormat, width, height, layerCount, 0, GL_RGB, GL_FLOAT, NULL);
+			gpuResources().allocated(GPU_TEXTURE, mip.texture, MEMORY_RENDER_TARGETS, "bloom level", internalFormat,
+				MemoryTracker::textureBytes(internalFormat, width, height, layerCount));
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // the filters sample one texel outside
+			glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+			mip.FBO = framebuffer(mip.texture, layerCount > 1 ? -1 : 0);
+			for (int layer = 0; layerCount > 1 && layer < layerCount; layer++)
+				mip.layerFBOs.push_back(framebuffer(mip.texture, layer));
+			mips.push_back(mip);
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	// before create() for a new size
+	void release()
+	{
+		for (size_t i = 0; i < mips.size(); i++)
+		{
+			gpuResources().destroy(GPU_FRAMEBUFFER, mips[i].FBO);
+			for (size_t j = 0; j < mips[i].layerFBOs.size(); j++)
+				gpuResources().destroy(GPU_FRAMEBUFFER, mips[i].layerFBOs[j]);
+			gpuResources().destroy(GPU_TEXTURE, mips[i].texture);
+		}
+		mips.clear();
+	}
+
+	int levels() const { return (int)mips.size(); }
+	int layers() const { return layerCount; }
+	const BloomMip &level(int i) const { return mips[i]; }
+	// framebuffer of one view of level i
+	unsigned int layerFBO(int i, int layer) const { return layerCount > 1 ? mips[i].layerFBOs[layer] : mips[i].FBO; }
+
+	// the finished bloom, sampled by hdr.fs
+	unsigned int texture() const { return mips.empty() ? 0 : mips[0].texture; }
+
+private:
+	std::vector<BloomMip> mips;
+	int layerCount;
+
+	// layer < 0: all layers
+	static unsigned int framebuffer(unsigned int texture, int layer)
+	{
+		unsigned int id = gpuResources().create(GPU_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, id);
+		if (layer < 0)
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0);
+		else
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, layer);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "Framebuffer not complete!" << std::endl;
+		return id;
+	}
+};
+
+#endif
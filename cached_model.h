@@ -0,0 +1,658 @@
+#ifndef CACHED_MODEL_H
+#define CACHED_MODEL_H
+
+#include <glad/glad.h>
+#include <model.h>
+#include "asset_loader.h"
+#include "cached_shader.h"
+#include "gpu_resources.h"
+#include "mapped_file.h"
+#include "mesh_format.h"
+#include "mesh_simplifier.h"
+#include "obj_importer.h"
+#include "texture_cache.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+// Model backed by a compiled binary mesh cache written next to the source file
+// (boat/boat_new.obj -> boat/boat_new.mesh), layout in mesh_format.h.
+// The cache holds the interleaved vertices in the object.vs layout, the index buffers
+// and the material textures. It is keyed by a hash of the OBJ and its MTL files, so
+// editing the source re-imports it. A valid cache is memory mapped and uploaded
+// straight into one VBO/EBO for the whole model, nothing is copied on the CPU side.
+// All meshes share one VAO and are ranges of the buffers (drawn with a base vertex);
+// meshes whose materials use the same textures are merged into one at import.
+// The import also builds simplified LODs (mesh_simplifier.h); they sit after LOD 0 of
+// their mesh in the EBO, Draw and DrawInstanced take the level to draw.
+// Given an AssetLoader, the cache is read (or built) on a loader thread and uploaded by
+// loader.update(); the model draws nothing until then and its textures stream in later.
+// Material textures come from their baked block compressed files (texture_cache.h).
+
+struct MaterialTexture {
+	unsigned int id;
+	std::string type;
+	std::string path;
+	std::string uniform; // sampler name in the shaders: texture_diffuse1, texture_normal1, ...
+};
+
+struct CachedLod {
+	GLsizei indexCount;
+	size_t indexOffset; // bytes into the model EBO
+	float error;		// object space
+};
+
+struct CachedMesh {
+	GLint baseVertex; // first vertex in the model VBO
+	std::vector<CachedLod> lods;
+	unsigned int material;
+	glm::vec3 boundsMin, boundsMax; // object space
+};
+
+class CachedModel
+{
+public:
+	unsigned int VAO, VBO, EBO;
+	std::vector<CachedMesh> meshes;
+	std::vector<std::vector<MaterialTexture> > materials;
+	std::string directory;
+	unsigned int id; // unique per model, part of the draw list material key
+	glm::vec3 boundsMin, boundsMax; // union of the mesh bounds
+	// error of every LOD level relative to the bounding radius, worst mesh of the level
+	std::vector<float> lodErrors;
+
+	CachedModel(const std::string &path) : VAO(0), VBO(0), EBO(0), id(nextId()), boundsMin(0.0f), boundsMax(0.0f), loader(NULL)
+	{
+		directory = path.substr(0, path.find_last_of('/'));
+		if (prepare(path))
+			upload();
+	}
+
+	// the model has to outlive the loader's work
+	CachedModel(const std::string &path, AssetLoader &loader) : VAO(0), VBO(0), EBO(0), id(nextId()), boundsMin(0.0f), boundsMax(0.0f), loader(&loader)
+	{
+		directory = path.substr(0, path.find_last_of('/'));
+		// Assimp creates GL objects while importing, only OBJ sources are read off the main thread
+		std::string extension = path.substr(path.find_last_of('.') + 1);
+		if (extension != "obj" && extension != "OBJ")
+		{
+			if (prepare(path))
+				upload();
+			return;
+		}
+		std::shared_ptr<bool> prepared = std::make_shared<bool>(false);
+		loader.run([this, path, prepared]() { *prepared = prepare(path); },
+			[this, prepared]() { if (*prepared) upload(); });
+	}
+
+	// offline: builds the mesh cache and bakes the material textures without a GL context;
+	// OBJ sources only, Assimp uploads while importing
+	static bool bakeTextures(const std::string &path, unsigned int threads)
+	{
+		std::string extension = path.substr(path.find_last_of('.') + 1);
+		if (extension != "obj" && extension != "OBJ")
+			return false;
+		CachedModel model;
+		model.directory = path.substr(0, path.find_last_of('/'));
+		if (!model.prepare(path))
+			return false;
+		bool baked = true;
+		std::set<std::string> done;
+		for (size_t i = 0; i < model.staged.materials.size(); i++)
+		{
+			const std::vector<MaterialTexture> &textures = model.staged.materials[i];
+			for (size_t t = 0; t < textures.size(); t++)
+				if (done.insert(textures[t].path).second)
+					baked = TextureCache::bake(model.directory + "/" + textures[t].path, textureKind(textures[t].type), threads) && baked;
+		}
+		return baked;
+	}
+
+	int lodCount() const { return (int)lodErrors.size(); }
+
+	// visible, if given, has one flag per mesh and skips the culled ones;
+	// meshes with fewer levels than lod draw their coarsest one
+	void Draw(CachedShader &shader, const std::vector<unsigned char> *visible = NULL, int lod = 0)
+	{
+		glBindVertexArray(VAO);
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			if (visible && !(*visible)[i])
+				continue;
+			const CachedLod &level = this->lod(i, lod);
+			bindMaterial(shader, meshes[i].material);
+			glDrawElementsBaseVertex(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (void*)level.indexOffset, meshes[i].baseVertex);
+		}
+		glBindVertexArray(0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	// one draw per mesh for all instances of an InstanceBuffer attached to this model
+	void DrawInstanced(CachedShader &shader, GLsizei instances, const std::vector<unsigned char> *visible = NULL, int lod = 0)
+	{
+		if (instances == 0)
+			return;
+		glBindVertexArray(VAO);
+		for (size_t i = 0; i < meshes.size(); i++)
+		{
+			if (visible && !(*visible)[i])
+				continue;
+			const CachedLod &level = this->lod(i, lod);
+			bindMaterial(shader, meshes[i].material);
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.indexCount, GL_UNSIGNED_INT, (void*)level.indexOffset, instances, meshes[i].baseVertex);
+		}
+		glBindVertexArray(0);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	// level of a mesh, meshes with fewer levels draw their coarsest one
+	const CachedLod &lod(size_t mesh, int level) const
+	{
+		const std::vector<CachedLod> &lods = meshes[mesh].lods;
+		return lods[std::min(level, (int)lods.size() - 1)];
+	}
+
+	// same sampler naming as Mesh::Draw: texture_diffuse1, texture_normal1, ...
+	void bindMaterial(CachedShader &shader, unsigned int material)
+	{
+		std::vector<MaterialTexture> &textures = materials[material];
+		for (unsigned int i = 0; i < textures.size(); i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			shader.setInt(textures[i].uniform, i);
+			glBindTexture(GL_TEXTURE_2D, textures[i].id);
+		}
+	}
+
+private:
+	// a validated cache, read on any thread and uploaded on the main thread
+	struct StagedCache {
+		std::unique_ptr<MappedFile> file;
+		const unsigned char *vertices, *indices;
+		size_t vertexBytes, indexBytes;
+		std::vector<CachedMesh> meshes;
+		std::vector<std::vector<MaterialTexture> > materials; // no texture ids yet
+		glm::vec3 boundsMin, boundsMax;
+		std::vector<float> lodErrors;
+	};
+
+	AssetLoader *loader;
+	StagedCache staged;
+	std::map<std::string, unsigned int> texturesLoaded;
+
+	// GL free, for bakeTextures()
+	CachedModel() : VAO(0), VBO(0), EBO(0), id(0), boundsMin(0.0f), boundsMax(0.0f), loader(NULL) {}
+
+	static unsigned int nextId()
+	{
+		static unsigned int next = 0;
+		return next++;
+	}
+
+	// hash of the OBJ plus every MTL it references
+	uint64_t sourceHash(const std::string &path)
+	{
+		uint64_t hash = hashBytes((const unsigned char *)&MESH_CACHE_VERSION, sizeof(MESH_CACHE_VERSION));
+		MappedFile source(path);
+		if (!source.valid())
+			return hash;
+		hash = hashBytes(source.data(), source.size(), hash);
+
+		const char *text = (const char *)source.data();
+		size_t size = source.size();
+		for (size_t line = 0; line < size; )
+		{
+			size_t end = line;
+			while (end < size && text[end] != '\n')
+				end++;
+			if (end - line > 7 && strncmp(text + line, "mtllib ", 7) == 0)
+			{
+				std::string name(text + line + 7, end - line - 7);
+				while (!name.empty() && (name.back() == '\r' || name.back() == ' '))
+					name.pop_back();
+				MappedFile mtl(directory + "/" + name);
+				if (mtl.valid())
+					hash = hashBytes(mtl.data(), mtl.size(), hash);
+			}
+			line = end + 1;
+		}
+		return hash;
+	}
+
+	// reads the cache, building it first if it is missing or stale; no GL calls
+	bool prepare(const std::string &path)
+	{
+		std::string cachePath = path.substr(0, path.find_last_of('.')) + ".mesh";
+		uint64_t hash = sourceHash(path);
+		if (read(cachePath, hash))
+			return true;
+
+		std::cout << "MESH CACHE: importing " << path << std::endl;
+		ImportedModel imported;
+		bool built = import(path, imported);
+		if (built)
+		{
+			mergeMaterials(imported);
+			MeshSimplifier::generateLods(imported);
+		}
+		if (built && write(cachePath, hash, imported) && read(cachePath, hash))
+			return true;
+		std::cout << "MESH CACHE: failed to build cache for " << path << std::endl;
+		return false;
+	}
+
+	// validates the cache and fills staged, the file stays mapped for upload()
+	bool read(const std::string &cachePath, uint64_t hash)
+	{
+		std::unique_ptr<MappedFile> file(new MappedFile(cachePath));
+		if (!file->valid() || file->size() < sizeof(MeshCacheHeader))
+			return false;
+		const unsigned char *base = file->data();
+		const MeshCacheHeader *header = (const MeshCacheHeader *)base;
+		if (header->magic != MESH_CACHE_MAGIC || header->version != MESH_CACHE_VERSION || header->sourceHash != hash)
+			return false;
+
+		size_t tableEnd = sizeof(MeshCacheHeader)
+			+ header->meshCount * sizeof(MeshCacheMesh)
+			+ header->materialCount * sizeof(MeshCacheMaterial)
+			+ header->textureCount * sizeof(MeshCacheTexture)
+			+ header->lodCount * sizeof(MeshCacheLod);
+		if (tableEnd > file->size() || header->meshCount == 0)
+			return false;
+		const MeshCacheMesh *meshRecords = (const MeshCacheMesh *)(base + sizeof(MeshCacheHeader));
+		const MeshCacheMaterial *materialRecords = (const MeshCacheMaterial *)(meshRecords + header->meshCount);
+		const MeshCacheTexture *textureRecords = (const MeshCacheTexture *)(materialRecords + header->materialCount);
+		const MeshCacheLod *lodRecords = (const MeshCacheLod *)(textureRecords + header->textureCount);
+
+		// the vertices and the indices of all meshes follow each other
+		uint64_t vertexEnd = meshRecords[0].vertexOffset;
+		uint64_t indexEnd = meshRecords[0].indexOffset;
+		for (uint32_t i = 0; i < header->meshCount; i++)
+		{
+			const MeshCacheMesh &record = meshRecords[i];
+			if (record.vertexOffset != vertexEnd || record.indexOffset != indexEnd)
+				return false;
+			vertexEnd += record.vertexCount * sizeof(MeshCacheVertex);
+			indexEnd += record.indexCount * sizeof(uint32_t);
+			if (vertexEnd > file->size() || indexEnd > file->size()
+				|| record.material >= header->materialCount
+				|| record.lodCount == 0 || record.firstLod + record.lodCount > header->lodCount)
+				return false;
+			for (uint32_t l = record.firstLod; l < record.firstLod + record.lodCount; l++)
+				if ((uint64_t)lodRecords[l].firstIndex + lodRecords[l].indexCount > record.indexCount)
+					return false;
+		}
+
+		StagedCache cache;
+		for (uint32_t i = 0; i < header->materialCount; i++)
+		{
+			std::vector<MaterialTexture> textures;
+			for (uint32_t t = 0; t < materialRecords[i].textureCount && materialRecords[i].firstTexture + t < header->textureCount; t++)
+			{
+				const MeshCacheTexture &record = textureRecords[materialRecords[i].firstTexture + t];
+				MaterialTexture texture;
+				texture.id = 0;
+				texture.type = std::string(record.type, strnlen(record.type, sizeof(record.type)));
+				texture.path = std::string(record.path, strnlen(record.path, sizeof(record.path)));
+				textures.push_back(texture);
+			}
+			std::map<std::string, int> numbers;
+			for (size_t t = 0; t < textures.size(); t++)
+			{
+				const std::string &type = textures[t].type;
+				bool numbered = type == "texture_diffuse" || type == "texture_specular" || type == "texture_normal" || type == "texture_height";
+				textures[t].uniform = numbered ? type + std::to_string(++numbers[type]) : type;
+			}
+			cache.materials.push_back(textures);
+		}
+
+		for (uint32_t i = 0; i < header->meshCount; i++)
+		{
+			const MeshCacheMesh &record = meshRecords[i];
+			CachedMesh mesh;
+			mesh.material = record.material;
+			mesh.baseVertex = (GLint)((record.vertexOffset - meshRecords[0].vertexOffset) / sizeof(MeshCacheVertex));
+			for (uint32_t l = record.firstLod; l < record.firstLod + record.lodCount; l++)
+			{
+				CachedLod lod;
+				lod.indexCount = lodRecords[l].indexCount;
+				lod.indexOffset = (size_t)(record.indexOffset - meshRecords[0].indexOffset) + lodRecords[l].firstIndex * sizeof(uint32_t);
+				lod.error = lodRecords[l].error;
+				mesh.lods.push_back(lod);
+			}
+			mesh.boundsMin = glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]);
+			mesh.boundsMax = glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]);
+			cache.boundsMin = i == 0 ? mesh.boundsMin : glm::min(cache.boundsMin, mesh.boundsMin);
+			cache.boundsMax = i == 0 ? mesh.boundsMax : glm::max(cache.boundsMax, mesh.boundsMax);
+			cache.meshes.push_back(mesh);
+		}
+
+		float radius = 0.5f * glm::length(cache.boundsMax - cache.boundsMin);
+		for (int level = 0; level < MESH_CACHE_MAX_LODS; level++)
+		{
+			bool used = false;
+			float error = 0.0f;
+			for (size_t i = 0; i < cache.meshes.size(); i++)
+			{
+				used = used || level < (int)cache.meshes[i].lods.size();
+				error = std::max(error, cache.meshes[i].lods[std::min(level, (int)cache.meshes[i].lods.size() - 1)].error);
+			}
+			if (!used)
+				break;
+			cache.lodErrors.push_back(radius > 0.0f ? error / radius : 0.0f);
+		}
+
+		cache.vertices = base + meshRecords[0].vertexOffset;
+		cache.indices = base + meshRecords[0].indexOffset;
+		cache.vertexBytes = (size_t)(vertexEnd - meshRecords[0].vertexOffset);
+		cache.indexBytes = (size_t)(indexEnd - meshRecords[0].indexOffset);
+		cache.file = std::move(file);
+		staged = std::move(cache);
+		gpuResources().memory().cpuAllocated(MEMORY_CPU_MESHES, staged.vertexBytes + staged.indexBytes);
+		return true;
+	}
+
+	// main thread: buffers and textures of the staged cache, then the model is drawable
+	void upload()
+	{
+		for (size_t i = 0; i < staged.materials.size(); i++)
+			for (size_t t = 0; t < staged.materials[i].size(); t++)
+				staged.materials[i][t].id = loadTexture(staged.materials[i][t].path, staged.materials[i][t].type);
+
+		VAO = gpuResources().create(GPU_VERTEX_ARRAY);
+		VBO = gpuResources().create(GPU_BUFFER);
+		EBO = gpuResources().create(GPU_BUFFER);
+		glBindVertexArray(VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		gpuResources().bufferData(GL_ARRAY_BUFFER, staged.vertexBytes, staged.vertices, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+		gpuResources().bufferData(GL_ELEMENT_ARRAY_BUFFER, staged.indexBytes, staged.indices, GL_STATIC_DRAW);
+		gpuResources().allocated(GPU_BUFFER, VBO, MEMORY_BUFFERS, directory + " vertices", GL_STATIC_DRAW, staged.vertexBytes);
+		gpuResources().allocated(GPU_BUFFER, EBO, MEMORY_BUFFERS, directory + " indices", GL_STATIC_DRAW, staged.indexBytes);
+		gpuResources().memory().cpuReleased(MEMORY_CPU_MESHES, staged.vertexBytes + staged.indexBytes);
+
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(MeshCacheVertex), (void*)offsetof(MeshCacheVertex, position));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(MeshCacheVertex), (void*)offsetof(MeshCacheVertex, normal));
+		glEnableVertexAttribArray(2);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(MeshCacheVertex), (void*)offsetof(MeshCacheVertex, texCoords));
+		glEnableVertexAttribArray(3);
+		glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(MeshCacheVertex), (void*)offsetof(MeshCacheVertex, tangent));
+		glEnableVertexAttribArray(4);
+		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(MeshCacheVertex), (void*)offsetof(MeshCacheVertex, bitangent));
+		glBindVertexArray(0);
+
+		meshes.swap(staged.meshes);
+		materials.swap(staged.materials);
+		boundsMin = staged.boundsMin;
+		boundsMax = staged.boundsMax;
+		lodErrors.swap(staged.lodErrors);
+		staged = StagedCache();
+	}
+
+	// OBJ files go through the parallel importer, anything else through Assimp (model.h)
+	bool import(const std::string &path, ImportedModel &result)
+	{
+		std::string extension = path.substr(path.find_last_of('.') + 1);
+		if (extension == "obj" || extension == "OBJ")
+			return ObjImporter::import(path, result);
+
+		Model source(path);
+		std::map<std::string, uint32_t> materialIndex;
+		for (size_t i = 0; i < source.meshes.size(); i++)
+		{
+			Mesh &mesh = source.meshes[i];
+			std::string key;
+			std::vector<ImportedTexture> textures;
+			for (size_t t = 0; t < mesh.textures.size(); t++)
+			{
+				ImportedTexture texture;
+				texture.type = mesh.textures[t].type;
+				texture.path = mesh.textures[t].path;
+				textures.push_back(texture);
+				key += texture.type + ":" + texture.path + ";";
+			}
+			if (materialIndex.find(key) == materialIndex.end())
+			{
+				materialIndex[key] = (uint32_t)result.materials.size();
+				result.materials.push_back(textures);
+			}
+
+			ImportedMesh imported;
+			imported.material = materialIndex[key];
+			imported.indices.assign(mesh.indices.begin(), mesh.indices.end());
+			imported.vertices.resize(mesh.vertices.size());
+			for (size_t v = 0; v < mesh.vertices.size(); v++)
+			{
+				MeshCacheVertex &vertex = imported.vertices[v];
+				memcpy(vertex.position, &mesh.vertices[v].Position.x, sizeof(vertex.position));
+				memcpy(vertex.normal, &mesh.vertices[v].Normal.x, sizeof(vertex.normal));
+				memcpy(vertex.texCoords, &mesh.vertices[v].TexCoords.x, sizeof(vertex.texCoords));
+				memcpy(vertex.tangent, &mesh.vertices[v].Tangent.x, sizeof(vertex.tangent));
+				memcpy(vertex.bitangent, &mesh.vertices[v].Bitangent.x, sizeof(vertex.bitangent));
+			}
+			result.meshes.push_back(imported);
+		}
+
+		// Model has no destructor, release what it uploaded; Mesh keeps its buffers private,
+		// the VAO still knows them
+		for (size_t i = 0; i < source.meshes.size(); i++)
+		{
+			GLint buffers[2] = { 0, 0 };
+			glBindVertexArray(source.meshes[i].VAO);
+			glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &buffers[0]);
+			glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &buffers[1]);
+			glBindVertexArray(0);
+			for (int b = 0; b < 2; b++)
+			{
+				GLuint buffer = (GLuint)buffers[b];
+				if (buffer != 0)
+					glDeleteBuffers(1, &buffer);
+			}
+			glDeleteVertexArrays(1, &source.meshes[i].VAO);
+		}
+		for (size_t i = 0; i < source.textures_loaded.size(); i++)
+			glDeleteTextures(1, &source.textures_loaded[i].id);
+		return !result.meshes.empty();
+	}
+
+	// meshes whose materials have the same textures become one mesh, drawn with one call
+	static void mergeMaterials(ImportedModel &model)
+	{
+		std::vector<std::vector<ImportedTexture> > materials;
+		std::vector<ImportedMesh> meshes;
+		std::vector<size_t> meshOfMaterial;
+		for (size_t i = 0; i < model.meshes.size(); i++)
+		{
+			const std::vector<ImportedTexture> &textures = model.materials[model.meshes[i].material];
+			size_t material = 0;
+			while (material < materials.size() && !sameTextures(materials[material], textures))
+				material++;
+			if (material == materials.size())
+			{
+				materials.push_back(textures);
+				meshOfMaterial.push_back(meshes.size());
+				meshes.push_back(ImportedMesh());
+				meshes.back().material = (uint32_t)material;
+			}
+			ImportedMesh &target = meshes[meshOfMaterial[material]];
+			uint32_t first = (uint32_t)target.vertices.size();
+			target.vertices.insert(target.vertices.end(), model.meshes[i].vertices.begin(), model.meshes[i].vertices.end());
+			for (size_t v = 0; v < model.meshes[i].indices.size(); v++)
+				target.indices.push_back(first + model.meshes[i].indices[v]);
+		}
+		model.meshes.swap(meshes);
+		model.materials.swap(materials);
+	}
+
+	static bool sameTextures(const std::vector<ImportedTexture> &a, const std::vector<ImportedTexture> &b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (size_t i = 0; i < a.size(); i++)
+			if (a[i].type != b[i].type || a[i].path != b[i].path)
+				return false;
+		return true;
+	}
+
+	bool write(const std::string &cachePath, uint64_t hash, const ImportedModel &model)
+	{
+		std::vector<MeshCacheMesh> meshRecords;
+		std::vector<MeshCacheMaterial> materialRecords;
+		std::vector<MeshCacheTexture> textureRecords;
+		std::vector<MeshCacheLod> lodRecords;
+
+		for (size_t i = 0; i < model.materials.size(); i++)
+		{
+			MeshCacheMaterial material;
+			material.firstTexture = (uint32_t)textureRecords.size();
+			material.textureCount = (uint32_t)model.materials[i].size();
+			for (size_t t = 0; t < model.materials[i].size(); t++)
+			{
+				MeshCacheTexture texture;
+				memset(&texture, 0, sizeof(texture));
+				strncpy(texture.type, model.materials[i][t].type.c_str(), sizeof(texture.type) - 1);
+				strncpy(texture.path, model.materials[i][t].path.c_str(), sizeof(texture.path) - 1);
+				textureRecords.push_back(texture);
+			}
+			materialRecords.push_back(material);
+		}
+
+		uint64_t vertexBytes = 0, indexBytes = 0;
+		for (size_t i = 0; i < model.meshes.size(); i++)
+		{
+			MeshCacheMesh record;
+			memset(&record, 0, sizeof(record));
+			record.vertexCount = (uint32_t)model.meshes[i].vertices.size();
+			record.material = model.meshes[i].material;
+			record.firstLod = (uint32_t)lodRecords.size();
+			MeshCacheLod lod;
+			memset(&lod, 0, sizeof(lod));
+			lod.indexCount = (uint32_t)model.meshes[i].indices.size();
+			lodRecords.push_back(lod);
+			for (size_t l = 0; l < model.meshes[i].lods.size(); l++)
+			{
+				lod.firstIndex += lod.indexCount;
+				lod.indexCount = (uint32_t)model.meshes[i].lods[l].indices.size();
+				lod.error = model.meshes[i].lods[l].error;
+				lodRecords.push_back(lod);
+			}
+			record.lodCount = (uint32_t)lodRecords.size() - record.firstLod;
+			record.indexCount = lod.firstIndex + lod.indexCount;
+			const std::vector<MeshCacheVertex> &vertices = model.meshes[i].vertices;
+			for (int k = 0; k < 3; k++)
+			{
+				record.boundsMin[k] = vertices.empty() ? 0.0f : vertices[0].position[k];
+				record.boundsMax[k] = record.boundsMin[k];
+			}
+			for (size_t v = 1; v < vertices.size(); v++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					record.boundsMin[k] = std::min(record.boundsMin[k], vertices[v].position[k]);
+					record.boundsMax[k] = std::max(record.boundsMax[k], vertices[v].position[k]);
+				}
+			}
+			record.vertexOffset = vertexBytes;
+			record.indexOffset = indexBytes;
+			vertexBytes += model.meshes[i].vertices.size() * sizeof(MeshCacheVertex);
+			indexBytes += record.indexCount * sizeof(uint32_t);
+			meshRecords.push_back(record);
+		}
+
+		MeshCacheHeader header;
+		memset(&header, 0, sizeof(header));
+		header.magic = MESH_CACHE_MAGIC;
+		header.version = MESH_CACHE_VERSION;
+		header.sourceHash = hash;
+		header.meshCount = (uint32_t)meshRecords.size();
+		header.materialCount = (uint32_t)materialRecords.size();
+		header.textureCount = (uint32_t)textureRecords.size();
+		header.lodCount = (uint32_t)lodRecords.size();
+
+		uint64_t dataStart = sizeof(MeshCacheHeader)
+			+ meshRecords.size() * sizeof(MeshCacheMesh)
+			+ materialRecords.size() * sizeof(MeshCacheMaterial)
+			+ textureRecords.size() * sizeof(MeshCacheTexture)
+			+ lodRecords.size() * sizeof(MeshCacheLod);
+		dataStart = (dataStart + 15) & ~(uint64_t)15;
+		for (size_t i = 0; i < meshRecords.size(); i++)
+		{
+			meshRecords[i].vertexOffset += dataStart;
+			meshRecords[i].indexOffset += dataStart + vertexBytes;
+		}
+
+		std::string tmpPath = cachePath + ".tmp";
+		std::ofstream out(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+		out.write((const char *)&header, sizeof(header));
+		if (!meshRecords.empty())
+			out.write((const char *)&meshRecords[0], meshRecords.size() * sizeof(MeshCacheMesh));
+		if (!materialRecords.empty())
+			out.write((const char *)&materialRecords[0], materialRecords.size() * sizeof(MeshCacheMaterial));
+		if (!textureRecords.empty())
+			out.write((const char *)&textureRecords[0], textureRecords.size() * sizeof(MeshCacheTexture));
+		if (!lodRecords.empty())
+			out.write((const char *)&lodRecords[0], lodRecords.size() * sizeof(MeshCacheLod));
+		const char zeros[16] = { 0 };
+		out.write(zeros, dataStart - (uint64_t)out.tellp());
+		for (size_t i = 0; i < model.meshes.size(); i++)
+			if (!model.meshes[i].vertices.empty())
+				out.write((const char *)&model.meshes[i].vertices[0], model.meshes[i].vertices.size() * sizeof(MeshCacheVertex));
+		for (size_t i = 0; i < model.meshes.size(); i++)
+		{
+			if (!model.meshes[i].indices.empty())
+				out.write((const char *)&model.meshes[i].indices[0], model.meshes[i].indices.size() * sizeof(uint32_t));
+			for (size_t l = 0; l < model.meshes[i].lods.size(); l++)
+				if (!model.meshes[i].lods[l].indices.empty())
+					out.write((const char *)&model.meshes[i].lods[l].indices[0], model.meshes[i].lods[l].indices.size() * sizeof(uint32_t));
+		}
+		out.close();
+		if (!out)
+			return false;
+
+		std::remove(cachePath.c_str());
+		return std::rename(tmpPath.c_str(), cachePath.c_str()) == 0;
+	}
+
+	unsigned int loadTexture(const std::string &file, const std::string &type)
+	{
+		std::map<std::string, unsigned int>::iterator it = texturesLoaded.find(file);
+		if (it != texturesLoaded.end())
+			return it->second;
+		unsigned int id = loader ? loader->texture(file, directory, textureKind(type), placeholder(type))
+			: TextureCache::createTexture(directory + "/" + file, textureKind(type));
+		texturesLoaded[file] = id;
+		return id;
+	}
+
+	static TextureKind textureKind(const std::string &type)
+	{
+		return type == "texture_normal" ? TEXTURE_NORMAL : TEXTURE_COLOR;
+	}
+
+	// what a texture shows until its image is streamed in: no diffuse (the billboard
+	// discards it, the lit shaders only read rgb), a flat normal
+	static glm::vec4 placeholder(const std::string &type)
+	{
+		if (type == "texture_normal")
+			return glm::vec4(0.5f, 0.5f, 0.0f, 1.0f); // x and y of a flat normal, see TextureCache
+		if (type == "texture_specular")
+			return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+		return glm::vec4(0.5f, 0.5f, 0.5f, 0.0f);
+	}
+};
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef CACHED_SHADER_H
+#define CACHED_SHADER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <shader.h>
+#include "gpu_resources.h"
+
+#include <string>
+#include <unordered_map>
+
+// Shader that resolves every active uniform location once after linking.
+// The set* functions hide the ones of Shader and look the location up in a table
+// instead of calling glGetUniformLocation each time.
+class CachedShader : public Shader
+{
+public:
+	CachedShader(const char *vertexPath, const char *fragmentPath)
+		: Shader(vertexPath, fragmentPath)
+	{
+		gpuResources().adopt(GPU_PROGRAM, ID);
+		GLint count = 0, maxLength = 0;
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+		glGetProgramiv(ID, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+		std::string name(maxLength > 0 ? maxLength : 1, '\0');
+		for (GLint i = 0; i < count; i++)
+		{
+			GLsizei length = 0;
+			GLint size = 0;
+			GLenum type = 0;
+			glGetActiveUniform(ID, (GLuint)i, maxLength, &length, &size, &type, &name[0]);
+			std::string uniform(name.c_str(), length);
+			GLint location = glGetUniformLocation(ID, uniform.c_str());
+			if (location < 0)
+				continue; // member of a uniform block
+			locations[uniform] = location;
+			// arrays are reported as "name[0]", also accept the plain name
+			size_t bracket = uniform.find("[0]");
+			if (bracket != std::string::npos && bracket + 3 == uniform.size())
+				locations[uniform.substr(0, bracket)] = location;
+		}
+	}
+
+	GLint location(const std::string &name) const
+	{
+		std::unordered_map<std::string, GLint>::const_iterator it = locations.find(name);
+		return it == locations.end() ? -1 : it->second;
+	}
+
+	// bind a uniform block of this program to a buffer binding point
+	void bindUniformBlock(const char *blockName, GLuint binding) const
+	{
+		GLuint index = glGetUniformBlockIndex(ID, blockName);
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(ID, index, binding);
+	}
+
+	void setBool(const std::string &name, bool value) const { glUniform1i(location(name), (int)value); }
+	void setInt(const std::string &name, int value) const { glUniform1i(location(name), value); }
+	void setFloat(const std::string &name, float value) const { glUniform1f(location(name), value); }
+	void setVec2(const std::string &name, const glm::vec2 &value) const { glUniform2fv(location(name), 1, &value[0]); }
+	void setVec2(const std::string &name, float x, float y) const { glUniform2f(location(name), x, y); }
+	void setVec3(const std::string &name, const glm::vec3 &value) const { glUniform3fv(location(name), 1, &value[0]); }
+	void setVec3(const std::string &name, float x, float y, float z) const { glUniform3f(location(name), x, y, z); }
+	void setVec4(const std::string &name, const glm::vec4 &value) const { glUniform4fv(location(name), 1, &value[0]); }
+	void setVec4(const std::string &name, float x, float y, float z, float w) const { glUniform4f(location(name), x, y, z, w); }
+	void setMat3(const std::string &name, const glm::mat3 &mat) const { glUniformMatrix3fv(location(name), 1, GL_FALSE, &mat[0][0]); }
+	void setMat4(const std::string &name, const glm::mat4 &mat) const { glUniformMatrix4fv(location(name), 1, GL_FALSE, &mat[0][0]); }
+
+private:
+	std::unordered_map<std::string, GLint> locations;
+};
+
+#endif
@@ -0,0 +1,262 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <glm/glm.hpp>
+#include "cached_model.h"
+#include "parallel_for.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CULLING_SSE
+#endif
+
+// Frustum culling against world space bounding boxes. The boxes are kept as separate
+// min/max arrays per axis so four of them are tested against a plane at once; large
+// lists are split into blocks that run on several threads.
+
+// the six planes of a view-projection (or light space) matrix, inside is dot(plane, (p, 1)) >= 0
+struct Frustum {
+	glm::vec4 planes[6];
+
+	Frustum() {}
+
+	explicit Frustum(const glm::mat4 &clip)
+	{
+		glm::vec4 row[4];
+		for (int i = 0; i < 4; i++)
+			row[i] = glm::vec4(clip[0][i], clip[1][i], clip[2][i], clip[3][i]);
+		planes[0] = row[3] + row[0];	// left
+		planes[1] = row[3] - row[0];	// right
+		planes[2] = row[3] + row[1];	// bottom
+		planes[3] = row[3] - row[1];	// top
+		planes[4] = row[3] + row[2];	// near
+		planes[5] = row[3] - row[2];	// far
+	}
+};
+
+// bounds of the box min/max after the transform (Arvo)
+inline void transformBounds(const glm::mat4 &m, const glm::vec3 &min, const glm::vec3 &max, glm::vec3 &outMin, glm::vec3 &outMax)
+{
+	outMin = outMax = glm::vec3(m[3]);
+	for (int column = 0; column < 3; column++)
+	{
+		glm::vec3 a = glm::vec3(m[column]) * min[column];
+		glm::vec3 b = glm::vec3(m[column]) * max[column];
+		outMin += glm::min(a, b);
+		outMax += glm::max(a, b);
+	}
+}
+
+// boxes in SoA layout, padded to a multiple of 4 with empty boxes
+class BoundsList
+{
+public:
+	BoundsList() : count(0) {}
+
+	void clear()
+	{
+		count = 0;
+		for (int i = 0; i < 6; i++)
+			axis[i].clear();
+	}
+
+	void add(const glm::vec3 &min, const glm::vec3 &max)
+	{
+		if (count % 4 == 0)
+		{
+			for (int i = 0; i < 6; i++)
+				axis[i].resize(count + 4, i < 3 ? INFINITY : -INFINITY); // min > max, outside every plane
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			axis[i][count] = min[i];
+			axis[3 + i][count] = max[i];
+		}
+		count++;
+	}
+
+	size_t size() const { return count; }
+
+	// minX, minY, minZ, maxX, maxY, maxZ
+	std::vector<float> axis[6];
+
+private:
+	size_t count;
+};
+
+// boxes per block of work, one block runs on one thread
+const size_t CULL_BLOCK_SIZE = 1024;
+
+// visible[i] = box i is not completely on the outside of one of the planes
+inline void cullBounds(const Frustum &frustum, const BoundsList &bounds, std::vector<unsigned char> &visible, unsigned int threads)
+{
+	visible.resize(bounds.size());
+	if (bounds.size() == 0)
+		return;
+	size_t blocks = (bounds.size() + CULL_BLOCK_SIZE - 1) / CULL_BLOCK_SIZE;
+	parallelFor(blocks, threads, [&](size_t block) {
+		size_t begin = block * CULL_BLOCK_SIZE;
+		size_t end = std::min(begin + CULL_BLOCK_SIZE, bounds.size());
+		// the corner furthest along the plane normal decides, picked per plane by the signs
+		const float *corner[6][3];
+		for (int p = 0; p < 6; p++)
+			for (int k = 0; k < 3; k++)
+				corner[p][k] = &bounds.axis[frustum.planes[p][k] >= 0.0f ? 3 + k : k][0];
+#ifdef CULLING_SSE
+		for (size_t i = begin; i < end; i += 4)
+		{
+			__m128 outside = _mm_setzero_ps();
+			for (int p = 0; p < 6; p++)
+			{
+				const glm::vec4 &plane = frustum.planes[p];
+				__m128 d = _mm_set1_ps(plane.w);
+				d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.x), _mm_loadu_ps(corner[p][0] + i)));
+				d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.y), _mm_loadu_ps(corner[p][1] + i)));
+				d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(plane.z), _mm_loadu_ps(corner[p][2] + i)));
+				outside = _mm_or_ps(outside, _mm_cmplt_ps(d, _mm_setzero_ps()));
+			}
+			int mask = _mm_movemask_ps(outside);
+			for (size_t k = 0; k < 4 && i + k < end; k++)
+				visible[i + k] = (mask >> k & 1) == 0;
+		}
+#else
+		for (size_t i = begin; i < end; i++)
+		{
+			bool outside = false;
+			for (int p = 0; p < 6 && !outside; p++)
+			{
+				const glm::vec4 &plane = frustum.planes[p];
+				outside = plane.x * corner[p][0][i] + plane.y * corner[p][1][i] + plane.z * corner[p][2][i] + plane.w < 0.0f;
+			}
+			visible[i] = !outside;
+		}
+#endif
+	});
+}
+
+struct CullStats {
+	unsigned int tested;
+	unsigned int visible;
+
+	CullStats() : tested(0), visible(0) {}
+};
+
+// Culls the instances of a model, then the meshes of the instances that are left.
+// visibleTransforms() goes into the InstanceBuffer, visibleMeshes() into Draw/DrawInstanced:
+// a mesh is drawn when it is inside the frustum for at least one visible instance.
+// With several frustums (views drawn in one pass) inside one of them is enough, the bounds
+// are transformed once for all of them.
+class ModelCuller
+{
+public:
+	void cull(const Frustum &frustum, const CachedModel &model, const std::vector<glm::mat4> &transforms, unsigned int threads)
+	{
+		cull(std::vector<Frustum>(1, frustum), model, transforms, threads);
+	}
+
+	void cull(const std::vector<Frustum> &frustums, const CachedModel &model, const std::vector<glm::mat4> &transforms, unsigned int threads)
+	{
+		bounds.clear();
+		for (size_t i = 0; i < transforms.size(); i++)
+		{
+			glm::vec3 min, max;
+			transformBounds(transforms[i], model.boundsMin, model.boundsMax, min, max);
+			bounds.add(min, max);
+		}
+		cullAny(frustums, threads);
+		visible.clear();
+		indices.clear();
+		for (size_t i = 0; i < transforms.size(); i++)
+		{
+			if (flags[i])
+			{
+				visible.push_back(transforms[i]);
+				indices.push_back((uint32_t)i);
+			}
+		}
+
+		size_t meshCount = model.meshes.size();
+		bounds.clear();
+		for (size_t i = 0; i < visible.size(); i++)
+		{
+			for (size_t m = 0; m < meshCount; m++)
+			{
+				glm::vec3 min, max;
+				transformBounds(visible[i], model.meshes[m].boundsMin, model.meshes[m].boundsMax, min, max);
+				bounds.add(min, max);
+			}
+		}
+		cullAny(frustums, threads);
+		meshes.assign(meshCount, 0);
+		for (size_t i = 0; i < flags.size(); i++)
+			meshes[i % meshCount] |= flags[i];
+
+		instanceStats.tested = (unsigned int)transforms.size();
+		instanceStats.visible = (unsigned int)visible.size();
+		meshStats.tested = (unsigned int)flags.size();
+		meshStats.visible = (unsigned int)std::count(flags.begin(), flags.end(), 1);
+	}
+
+	const std::vector<glm::mat4> &visibleTransforms() const { return visible; }
+	const std::vector<uint32_t> &visibleIndices() const { return indices; }
+	const std::vector<unsigned char> &visibleMeshes() const { return meshes; }
+
+	CullStats instanceStats;	// instances tested / inside
+	CullStats meshStats;		// meshes of the visible instances tested / inside
+
+private:
+	BoundsList bounds;
+	std::vector<unsigned char> flags;
+	std::vector<unsigned char> viewFlags;
+
+	// flags = inside at least one of frustums
+	void cullAny(const std::vector<Frustum> &frustums, unsigned int threads)
+	{
+		cullBounds(frustums[0], bounds, flags, threads);
+		for (size_t f = 1; f < frustums.size(); f++)
+		{
+			cullBounds(frustums[f], bounds, viewFlags, threads);
+			for (size_t i = 0; i < flags.size(); i++)
+				flags[i] |= viewFlags[i];
+		}
+	}
+	std::vector<glm::mat4> visible;
+	std::vector<uint32_t> indices;
+	std::vector<unsigned char> meshes;
+};
+
+// culling results of one pass, summed over the models it draws
+struct PassCullStats {
+	CullStats instances;
+	CullStats meshes;
+
+	void reset() { *this = PassCullStats(); }
+
+	void add(const ModelCuller &culler)
+	{
+		instances.tested += culler.instanceStats.tested;
+		instances.visible += culler.instanceStats.visible;
+		meshes.tested += culler.meshStats.tested;
+		meshes.visible += culler.meshStats.visible;
+	}
+
+	// "name": { ... } member of the "culling" report
+	std::string report(const std::string &name) const
+	{
+		std::ostringstream out;
+		out << "\"" << name << "\": { \"instances_tested\": " << instances.tested << ", \"instances_visible\": " << instances.visible
+			<< ", \"instances_culled\": " << instances.tested - instances.visible
+			<< ", \"meshes_tested\": " << meshes.tested << ", \"meshes_visible\": " << meshes.visible
+			<< ", \"meshes_culled\": " << meshes.tested - meshes.visible << " }";
+		return out.str();
+	}
+};
+
+#endif
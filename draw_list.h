@@ -0,0 +1,333 @@
+#ifndef DRAW_LIST_H
+#define DRAW_LIST_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "cached_model.h"
+#include "cached_shader.h"
+#include "instance_buffer.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <map>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// GL calls of one frame issued through the StateTracker, and the ones it dropped
+// because they would have set what was already set
+struct DrawStats {
+	unsigned int draws;
+	unsigned int programs, vertexArrays, textures, uniforms, instanceRanges;
+	unsigned int skippedPrograms, skippedVertexArrays, skippedTextures, skippedUniforms, skippedInstanceRanges;
+
+	DrawStats() : draws(0), programs(0), vertexArrays(0), textures(0), uniforms(0), instanceRanges(0),
+		skippedPrograms(0), skippedVertexArrays(0), skippedTextures(0), skippedUniforms(0), skippedInstanceRanges(0) {}
+};
+
+// Remembers the program, VAO, texture bindings and per-draw uniforms set through it and
+// skips calls that would not change anything. Bindings are forgotten by invalidate() when
+// other code may have changed them; uniform values stay valid as long as the per-draw
+// uniforms (model, normalMatrix, instanced, objectNum, firstView, viewCount, material samplers)
+// are only set here.
+class StateTracker
+{
+public:
+	StateTracker() { invalidate(); }
+
+	void beginFrame() { frame = DrawStats(); }
+
+	void invalidate()
+	{
+		program = 0;
+		vertexArray = 0;
+		vertexArrayKnown = false;
+		activeUnit = -1;
+		boundTextures.clear();
+	}
+
+	void useProgram(CachedShader &shader)
+	{
+		if (program == shader.ID)
+		{
+			frame.skippedPrograms++;
+			return;
+		}
+		glUseProgram(shader.ID);
+		program = shader.ID;
+		frame.programs++;
+	}
+
+	void bindVertexArray(GLuint id)
+	{
+		if (vertexArrayKnown && vertexArray == id)
+		{
+			frame.skippedVertexArrays++;
+			return;
+		}
+		glBindVertexArray(id);
+		vertexArray = id;
+		vertexArrayKnown = true;
+		frame.vertexArrays++;
+	}
+
+	void bindTexture(GLuint unit, GLenum target, GLuint texture)
+	{
+		std::map<GLuint, GLuint>::iterator it = boundTextures.find(unit);
+		if (it != boundTextures.end() && it->second == texture)
+		{
+			frame.skippedTextures++;
+			return;
+		}
+		if (activeUnit != (int)unit)
+		{
+			glActiveTexture(GL_TEXTURE0 + unit);
+			activeUnit = (int)unit;
+		}
+		glBindTexture(target, texture);
+		boundTextures[unit] = texture;
+		frame.textures++;
+	}
+
+	// the shader has to be the current program; locations < 0 are ignored
+	void setInt(CachedShader &shader, GLint location, int value)
+	{
+		if (location < 0)
+			return;
+		std::unordered_map<GLint, int> &values = uniforms[shader.ID].ints;
+		std::unordered_map<GLint, int>::iterator it = values.find(location);
+		if (it != values.end() && it->second == value)
+		{
+			frame.skippedUniforms++;
+			return;
+		}
+		glUniform1i(location, value);
+		values[location] = value;
+		frame.uniforms++;
+	}
+
+	// "model" and, if the shader has it, "normalMatrix"
+	void setTransform(CachedShader &shader, const glm::mat4 &model)
+	{
+		ProgramUniforms &values = uniforms[shader.ID];
+		if (values.hasModel && values.model == model)
+		{
+			frame.skippedUniforms++;
+			return;
+		}
+		glUniformMatrix4fv(shader.location("model"), 1, GL_FALSE, &model[0][0]);
+		GLint normalMatrix = shader.location("normalMatrix");
+		if (normalMatrix >= 0)
+		{
+			glm::mat3 normal = glm::transpose(glm::inverse(glm::mat3(model)));
+			glUniformMatrix3fv(normalMatrix, 1, GL_FALSE, &normal[0][0]);
+		}
+		values.model = model;
+		values.hasModel = true;
+		frame.uniforms++;
+	}
+
+	// point the instance attributes of the model VAO at instances [first, ...), each one
+	// repeated for divisor instances (views)
+	void bindInstances(CachedModel &model, InstanceBuffer &instances, GLsizei first, GLuint divisor = 1)
+	{
+		std::map<GLuint, InstanceRange>::iterator it = instanceRanges.find(model.VAO);
+		if (it != instanceRanges.end() && it->second.instances == &instances && it->second.first == first && it->second.divisor == divisor)
+		{
+			frame.skippedInstanceRanges++;
+			return;
+		}
+		instances.attach(model, first, divisor); // leaves VAO 0 bound
+		InstanceRange range = { &instances, first, divisor };
+		instanceRanges[model.VAO] = range;
+		vertexArray = 0;
+		vertexArrayKnown = true;
+		frame.instanceRanges++;
+	}
+
+	void drawn() { frame.draws++; }
+
+	const DrawStats &stats() const { return frame; }
+
+	// "draws" member for the bench report, counts since beginFrame()
+	std::string report() const
+	{
+		std::ostringstream out;
+		out << "\"draws\": { \"draw_calls\": " << frame.draws
+			<< ", \"issued\": { \"programs\": " << frame.programs << ", \"vertex_arrays\": " << frame.vertexArrays
+			<< ", \"textures\": " << frame.textures << ", \"uniforms\": " << frame.uniforms << ", \"instance_ranges\": " << frame.instanceRanges << " }"
+			<< ", \"skipped\": { \"programs\": " << frame.skippedPrograms << ", \"vertex_arrays\": " << frame.skippedVertexArrays
+			<< ", \"textures\": " << frame.skippedTextures << ", \"uniforms\": " << frame.skippedUniforms << ", \"instance_ranges\": " << frame.skippedInstanceRanges << " } }";
+		return out.str();
+	}
+
+private:
+	struct ProgramUniforms {
+		std::unordered_map<GLint, int> ints;
+		glm::mat4 model;
+		bool hasModel;
+
+		ProgramUniforms() : hasModel(false) {}
+	};
+
+	struct InstanceRange {
+		InstanceBuffer *instances;
+		GLsizei first;
+		GLuint divisor;
+	};
+
+	GLuint program;
+	GLuint vertexArray;
+	bool vertexArrayKnown;
+	int activeUnit;
+	std::map<GLuint, GLuint> boundTextures;	// unit -> texture
+	std::map<GLuint, ProgramUniforms> uniforms;	// per program
+	std::map<GLuint, InstanceRange> instanceRanges; // per VAO, VAO state outlives invalidate()
+	DrawStats frame;
+};
+
+// One mesh draw: what to bind and what to set, plus the key it is sorted by.
+struct DrawPacket {
+	uint64_t key;
+	CachedShader *shader;
+	CachedModel *model;
+	unsigned int mesh;
+	int lod;
+	InstanceBuffer *instances;	// instanceCount instances from firstInstance, NULL for a single draw
+	GLsizei firstInstance;
+	GLsizei instanceCount;
+	int objectNum;				// objectNum uniform of object.fs, -1 to leave it
+	bool hasTransform;			// set transform as the model uniform
+	glm::mat4 transform;
+
+	DrawPacket() : key(0), shader(NULL), model(NULL), mesh(0), lod(0), instances(NULL), firstInstance(0), instanceCount(0),
+		objectNum(-1), hasTransform(false), transform(1.0f) {}
+};
+
+// parts of a pass submit() draws
+enum DrawParts {
+	DRAW_OPAQUE = 1,
+	DRAW_TRANSLUCENT = 2,
+	DRAW_ALL = DRAW_OPAQUE | DRAW_TRANSLUCENT
+};
+
+// view distance that maps to the largest depth in the sort key
+const float DRAW_DEPTH_RANGE = 100.0f;
+
+// The render* functions add packets for the whole frame, the list is sorted once and
+// every pass submits its part through a StateTracker. The sort key is, from the top bit:
+//   opaque:      pass (4) | 0 | program (8) | model (8) | material (8) | depth (24)
+//   translucent: pass (4) | 1 | inverted depth (24) | program (8) | model (8) | material (8)
+// so each pass draws its opaque packets grouped by program and material, front to back
+// inside a material, and its translucent packets last, back to front across the whole pass.
+// Programs and models get small ids per list in the order they first come (kept across
+// frames), at most 256 of each.
+class DrawList
+{
+public:
+	void clear() { packets.clear(); }
+
+	// one packet per visible mesh of packet.model; depth is the distance from the camera
+	void addModel(unsigned int pass, bool translucent, const DrawPacket &packet, const std::vector<unsigned char> *visible, float depth)
+	{
+		for (unsigned int i = 0; i < packet.model->meshes.size(); i++)
+		{
+			if (visible && !(*visible)[i])
+				continue;
+			DrawPacket mesh = packet;
+			mesh.mesh = i;
+			mesh.key = key(pass, translucent, denseId(programIds, packet.shader->ID), denseId(modelIds, packet.model->id),
+				packet.model->meshes[i].material, depth);
+			packets.push_back(mesh);
+		}
+	}
+
+	void sort()
+	{
+		std::stable_sort(packets.begin(), packets.end(), [](const DrawPacket &a, const DrawPacket &b) { return a.key < b.key; });
+	}
+
+	// parts: the opaque and / or translucent packets, e.g. to draw something in between;
+	// viewCount > 1 draws every packet once per view, views firstView ... into the layers 0 ...
+	// of a layered target (see frame_data.h)
+	void submit(StateTracker &state, unsigned int pass, unsigned int parts = DRAW_ALL, int firstView = 0, int viewCount = 1)
+	{
+		state.invalidate();
+		for (size_t i = 0; i < packets.size(); i++)
+		{
+			const DrawPacket &p = packets[i];
+			if (p.key >> 60 != pass)
+				continue;
+			if (!(parts & (p.key >> 59 & 1 ? DRAW_TRANSLUCENT : DRAW_OPAQUE)))
+				continue;
+			CachedShader &shader = *p.shader;
+			CachedModel &model = *p.model;
+			const CachedMesh &mesh = model.meshes[p.mesh];
+			const CachedLod &lod = model.lod(p.mesh, p.lod);
+
+			state.useProgram(shader);
+			if (p.instances)
+				state.bindInstances(model, *p.instances, p.firstInstance, (GLuint)viewCount);
+			state.bindVertexArray(model.VAO);
+			state.setInt(shader, shader.location("instanced"), p.instances != NULL);
+			state.setInt(shader, shader.location("firstView"), firstView);
+			state.setInt(shader, shader.location("viewCount"), viewCount);
+			if (p.objectNum >= 0)
+				state.setInt(shader, shader.location("objectNum"), p.objectNum);
+			if (p.hasTransform)
+				state.setTransform(shader, p.transform);
+			const std::vector<MaterialTexture> &textures = model.materials[mesh.material];
+			for (unsigned int t = 0; t < textures.size(); t++)
+			{
+				state.bindTexture(t, GL_TEXTURE_2D, textures[t].id);
+				state.setInt(shader, shader.location(textures[t].uniform), t);
+			}
+
+			if (p.instances)
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT, (void*)lod.indexOffset, p.instanceCount * viewCount, mesh.baseVertex);
+			else if (viewCount > 1)
+				glDrawElementsInstancedBaseVertex(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT, (void*)lod.indexOffset, viewCount, mesh.baseVertex);
+			else
+				glDrawElementsBaseVertex(GL_TRIANGLES, lod.indexCount, GL_UNSIGNED_INT, (void*)lod.indexOffset, mesh.baseVertex);
+			state.drawn();
+		}
+		glBindVertexArray(0);
+		glActiveTexture(GL_TEXTURE0);
+		state.invalidate();
+	}
+
+	size_t size() const { return packets.size(); }
+
+	// program and model: dense ids (denseId), each below 256 like material
+	static uint64_t key(unsigned int pass, bool translucent, unsigned int program, unsigned int model, unsigned int material, float depth)
+	{
+		assert(program < 256 && model < 256 && material < 256);
+		float d = std::min(std::max(depth / DRAW_DEPTH_RANGE, 0.0f), 1.0f);
+		uint64_t quantized = (uint64_t)(d * 0xFFFFFF);
+		uint64_t group = (uint64_t)program << 16 | (uint64_t)model << 8 | material;
+		uint64_t top = (uint64_t)(pass & 0xF) << 60 | (uint64_t)translucent << 59;
+		if (translucent)
+			return top | (0xFFFFFF - quantized) << 35 | group << 11;
+		return top | group << 35 | quantized << 11;
+	}
+
+private:
+	std::vector<DrawPacket> packets;
+	std::vector<unsigned int> programIds;	// GL program names, index = dense id
+	std::vector<unsigned int> modelIds;		// CachedModel ids
+
+	static unsigned int denseId(std::vector<unsigned int> &ids, unsigned int value)
+	{
+		for (size_t i = 0; i < ids.size(); i++)
+		{
+			if (ids[i] == value)
+				return (unsigned int)i;
+		}
+		ids.push_back(value);
+		return (unsigned int)ids.size() - 1;
+	}
+};
+
+#endif
@@ -0,0 +1,290 @@
+#ifndef DYNAMIC_RESOLUTION_H
+#define DYNAMIC_RESOLUTION_H
+
+#include <glad/glad.h>
+#include "gpu_resources.h"
+#include "hdr_format.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// The HDR colour buffer and depth / stencil of the scene (the stencil counts fragments for the
+// overdraw view). They are allocated for the largest render scale and reallocated only when the window size changes; a smaller scale draws into the
+// lower left part of them (viewport) and hdr.fs stretches that part over the window.
+// Both are array textures with one layer per view: FBO has all layers attached (layered, the
+// shaders pick the layer per instance), layerFBO(i) only layer i for the drivers that cannot.
+class SceneTargets
+{
+public:
+	unsigned int FBO;
+	unsigned int colorBuffer;
+	unsigned int depthBuffer;
+	int width;	// allocated size
+	int height;
+	int layers;
+	HdrFormat format;	// what the colour buffer ended up as
+
+	SceneTargets() : FBO(0), colorBuffer(0), depthBuffer(0), width(0), height(0), layers(0), format(HDR_RGB16F) {}
+
+	// a format the driver cannot render to is replaced by R11F_G11F_B10F
+	void create(int w, int h, HdrFormat requested, int layerCount = 1)
+	{
+		width = std::max(1, w);
+		height = std::max(1, h);
+		layers = std::max(1, layerCount);
+		format = requested;
+		// floating point color buffer, the bright parts for bloom are extracted from it later
+		colorBuffer = gpuResources().create(GPU_TEXTURE);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, colorBuffer);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, hdrInternalFormat(format), width, height, layers, 0, GL_RGB, GL_FLOAT, NULL);
+		gpuResources().allocated(GPU_TEXTURE, colorBuffer, MEMORY_RENDER_TARGETS, "scene color", hdrInternalFormat(format),
+			MemoryTracker::textureBytes(hdrInternalFormat(format), width, height, layers));
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);  // we clamp to the edge as the bloom filter would otherwise sample repeated texture values!
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		depthBuffer = gpuResources().create(GPU_TEXTURE);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, depthBuffer);
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH24_STENCIL8, width, height, layers, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+		gpuResources().allocated(GPU_TEXTURE, depthBuffer, MEMORY_RENDER_TARGETS, "scene depth", GL_DEPTH24_STENCIL8,
+			MemoryTracker::textureBytes(GL_DEPTH24_STENCIL8, width, height, layers));
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		FBO = framebuffer(layers > 1 ? -1 : 0);
+		for (int i = 0; layers > 1 && i < layers; i++)
+			layerFBOs.push_back(framebuffer(i));
+		// finally check if framebuffer is complete
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			if (format != HDR_R11G11B10F)
+			{
+				std::cout << hdrFormatNames[format] << " is not renderable, using " << hdrFormatNames[HDR_R11G11B10F] << std::endl;
+				release();
+				create(w, h, HDR_R11G11B10F, layerCount);
+				return;
+			}
+			std::cout << "Framebuffer not complete!" << std::endl;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	void release()
+	{
+		gpuResources().destroy(GPU_FRAMEBUFFER, FBO);
+		for (size_t i = 0; i < layerFBOs.size(); i++)
+			gpuResources().destroy(GPU_FRAMEBUFFER, layerFBOs[i]);
+		layerFBOs.clear();
+		gpuResources().destroy(GPU_TEXTURE, colorBuffer);
+		gpuResources().destroy(GPU_TEXTURE, depthBuffer);
+		width = height = 0;
+	}
+
+	// false when the size is already allocated
+	bool resize(int w, int h, int layerCount = 1)
+	{
+		if (std::max(1, w) == width && std::max(1, h) == height && std::max(1, layerCount) == layers)
+			return false;
+		HdrFormat keep = format;
+		release();
+		create(w, h, keep, layerCount);
+		return true;
+	}
+
+	// framebuffer of one view
+	unsigned int layerFBO(int layer) const { return layers > 1 ? layerFBOs[layer] : FBO; }
+
+private:
+	std::vector<unsigned int> layerFBOs;	// only with several layers, FBO is layer 0 otherwise
+
+	// layer < 0: all layers
+	unsigned int framebuffer(int layer)
+	{
+		unsigned int id = gpuResources().create(GPU_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, id);
+		if (layer < 0)
+		{
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorBuffer, 0);
+			glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, depthBuffer, 0);
+		}
+		else
+		{
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, colorBuffer, 0, layer);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, depthBuffer, 0, layer);
+		}
+		return id;
+	}
+};
+
+struct DynamicResolutionSettings {
+	float targetMs;	// GPU time per frame to hold, 0 keeps the scale fixed
+	float minScale;	// bounds of the render scale (per axis)
+	float maxScale;
+	float scale;	// starting (or fixed) scale
+
+	DynamicResolutionSettings() : targetMs(0.0f), minScale(0.5f), maxScale(1.0f), scale(1.0f) {}
+};
+
+// Picks the render scale from the GPU time of the frames. Two timestamps per frame go into a
+// ring of LATENCY frames (like PassTimer), so reading them back does not stall. The time is
+// smoothed; above the target the scale drops, well below it the scale rises again. The pixel
+// count goes with the square of the scale, hence the square root. After a change the controller
+// waits until frames at the new scale have been measured.
+class DynamicResolution
+{
+public:
+	static const int LATENCY = 4;
+	static const int STEPS = 32;			// scales are multiples of 1/STEPS
+	static constexpr float HEADROOM = 0.8f;	// grow only below this fraction of the target
+	static constexpr float MAX_GROWTH = 0.1f;	// largest increase per change
+
+	explicit DynamicResolution(const DynamicResolutionSettings &settings)
+		: settings(settings), current(clampScale(settings.scale)), frame(-1), settle(0), measured(0), smoothedMs(0.0f),
+		changes(0), scaleSum(0.0), scaleFrames(0), minUsed(current), maxUsed(current)
+	{
+		glGenQueries(2 * LATENCY, queries);
+		for (int i = 0; i < LATENCY; i++)
+			issued[i] = false;
+	}
+
+	~DynamicResolution() { release(); }
+
+	// deletes the queries, call while the context is still current
+	void release()
+	{
+		if (queries[0] != 0)
+			glDeleteQueries(2 * LATENCY, queries);
+		for (int i = 0; i < 2 * LATENCY; i++)
+			queries[i] = 0;
+	}
+
+	bool dynamic() const { return settings.targetMs > 0.0f; }
+	float scale() const { return current; }
+
+	// lowers (or raises) the largest scale, e.g. to fit a memory budget
+	void setMaxScale(float s)
+	{
+		settings.maxScale = s;
+		settings.minScale = std::min(settings.minScale, s);
+		current = clampScale(current);
+	}
+
+	// part of a w x h target the frame is drawn into
+	int scaled(int size) const { return std::max(1, (int)std::floor(size * current + 0.5f)); }
+
+	void beginFrame()
+	{
+		frame++;
+		int slot = frame % LATENCY;
+		collect(slot);
+		glQueryCounter(queries[2 * slot], GL_TIMESTAMP);
+	}
+
+	void endFrame()
+	{
+		int slot = frame % LATENCY;
+		glQueryCounter(queries[2 * slot + 1], GL_TIMESTAMP);
+		issued[slot] = true;
+		scaleSum += current;
+		scaleFrames++;
+		minUsed = std::min(minUsed, current);
+		maxUsed = std::max(maxUsed, current);
+	}
+
+	// the statistics of the report start over (bench warmup)
+	void resetStats()
+	{
+		changes = 0;
+		scaleSum = 0.0;
+		scaleFrames = 0;
+		minUsed = maxUsed = current;
+		gpuSamples.clear();
+	}
+
+	// "resolution" member for the bench report
+	std::string report() const
+	{
+		double mean = scaleFrames ? scaleSum / scaleFrames : current;
+		double gpuMs = 0.0;
+		for (size_t i = 0; i < gpuSamples.size(); i++)
+			gpuMs += gpuSamples[i];
+		if (!gpuSamples.empty())
+			gpuMs /= gpuSamples.size();
+		std::ostringstream out;
+		out << "\"resolution\": { \"dynamic\": " << (dynamic() ? "true" : "false")
+			<< ", \"target_ms\": " << settings.targetMs
+			<< ", \"min_scale\": " << settings.minScale << ", \"max_scale\": " << settings.maxScale
+			<< ", \"scale\": " << current << ", \"mean_scale\": " << mean
+			<< ", \"lowest_scale\": " << minUsed << ", \"highest_scale\": " << maxUsed
+			<< ", \"changes\": " << changes << ", \"gpu_frame_ms\": " << gpuMs << " }";
+		return out.str();
+	}
+
+private:
+	DynamicResolutionSettings settings;
+	float current;
+	int frame;
+	int settle;			// frames until the last change shows in the measurements
+	int measured;		// frames measured at the current scale
+	float smoothedMs;
+	GLuint queries[2 * LATENCY];
+	bool issued[LATENCY];
+	int changes;
+	double scaleSum;
+	int scaleFrames;
+	float minUsed, maxUsed;
+	std::vector<double> gpuSamples;
+
+	float clampScale(float s) const
+	{
+		s = std::floor(s * STEPS + 0.5f) / STEPS;
+		return std::min(settings.maxScale, std::max(settings.minScale, s));
+	}
+
+	void collect(int slot)
+	{
+		if (!issued[slot])
+			return;
+		issued[slot] = false;
+		GLuint64 begin = 0, end = 0;
+		glGetQueryObjectui64v(queries[2 * slot], GL_QUERY_RESULT, &begin);
+		glGetQueryObjectui64v(queries[2 * slot + 1], GL_QUERY_RESULT, &end);
+		float ms = (float)((end - begin) / 1.0e6);
+		gpuSamples.push_back(ms);
+		if (settle > 0)
+		{
+			// frames drawn before the last change
+			settle--;
+			return;
+		}
+		smoothedMs = measured > 0 ? smoothedMs * 0.8f + ms * 0.2f : ms;
+		measured++;
+		if (dynamic() && measured >= LATENCY)
+			adjust();
+	}
+
+	void adjust()
+	{
+		float target = settings.targetMs;
+		float next = current;
+		if (smoothedMs > target)
+			next = current * std::sqrt(target / smoothedMs);
+		else if (smoothedMs < target * HEADROOM)
+			next = std::min(current + MAX_GROWTH, current * std::sqrt(target * HEADROOM / smoothedMs));
+		next = clampScale(next);
+		if (next == current)
+			return;
+		current = next;
+		changes++;
+		settle = LATENCY - 1;
+		measured = 0;
+	}
+};
+
+#endif
@@ -0,0 +1,153 @@
+#ifndef FFT2D_H
+#define FFT2D_H
+
+#include "parallel_for.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define FFT_SSE
+#endif
+
+// a complex n x n grid as separate real and imaginary planes, row after row
+struct ComplexPlane {
+	float *re;
+	float *im;
+};
+
+// Inverse 2D FFT (radix 2, exponent sign +, no 1/n scaling) of n x n grids, n a power of two.
+// A 1D pass transforms whole blocks of columns at once: every butterfly combines two rows,
+// so the columns of a block are consecutive floats and four of them go through one SSE
+// operation. The rows are done by transposing and running the column pass again, so the
+// result ends up transposed: the value of row y, column x is at [x * n + y].
+class FFT2D
+{
+public:
+	static const int BLOCK = 16; // columns per job, a multiple of the SSE width
+
+	explicit FFT2D(int n) : n(n), reversed(n), twiddleRe(n), twiddleIm(n)
+	{
+		int bits = 0;
+		while ((1 << bits) < n)
+			bits++;
+		for (int i = 0; i < n; i++)
+		{
+			int r = 0;
+			for (int b = 0; b < bits; b++)
+				r |= (i >> b & 1) << (bits - 1 - b);
+			reversed[i] = r;
+		}
+		// the twiddles of the stage with half size h are at [h, 2h)
+		for (int half = 1; half < n; half *= 2)
+		{
+			for (int k = 0; k < half; k++)
+			{
+				double angle = 3.14159265358979323846 * k / half;
+				twiddleRe[half + k] = (float)std::cos(angle);
+				twiddleIm[half + k] = (float)std::sin(angle);
+			}
+		}
+	}
+
+	int size() const { return n; }
+
+	// transforms every plane; scratch has one plane of the same size per plane and
+	// receives the (transposed) results, the planes are overwritten
+	void inverse(const std::vector<ComplexPlane> &planes, const std::vector<ComplexPlane> &scratch, unsigned int threads) const
+	{
+		size_t blocks = (size_t)(n + BLOCK - 1) / BLOCK;
+		size_t jobs = planes.size() * blocks;
+		parallelFor(jobs, threads, [&](size_t job) {
+			const ComplexPlane &plane = planes[job / blocks];
+			int c0 = (int)(job % blocks) * BLOCK;
+			columns(plane.re, plane.im, c0, std::min(n, c0 + BLOCK));
+		});
+		parallelFor(jobs, threads, [&](size_t job) {
+			const ComplexPlane &from = planes[job / blocks];
+			const ComplexPlane &to = scratch[job / blocks];
+			int r0 = (int)(job % blocks) * BLOCK;
+			transpose(from.re, to.re, r0, std::min(n, r0 + BLOCK));
+			transpose(from.im, to.im, r0, std::min(n, r0 + BLOCK));
+		});
+		parallelFor(jobs, threads, [&](size_t job) {
+			const ComplexPlane &plane = scratch[job / blocks];
+			int c0 = (int)(job % blocks) * BLOCK;
+			columns(plane.re, plane.im, c0, std::min(n, c0 + BLOCK));
+		});
+	}
+
+	// 1D transform down the columns [c0, c1)
+	void columns(float *re, float *im, int c0, int c1) const
+	{
+		for (int r = 0; r < n; r++)
+		{
+			int s = reversed[r];
+			if (s <= r)
+				continue;
+			for (int c = c0; c < c1; c++)
+			{
+				std::swap(re[r * n + c], re[s * n + c]);
+				std::swap(im[r * n + c], im[s * n + c]);
+			}
+		}
+		for (int half = 1; half < n; half *= 2)
+		{
+			for (int start = 0; start < n; start += 2 * half)
+			{
+				for (int k = 0; k < half; k++)
+				{
+					size_t a = (size_t)(start + k) * n, b = a + (size_t)half * n;
+					butterfly(re + a, im + a, re + b, im + b, twiddleRe[half + k], twiddleIm[half + k], c0, c1);
+				}
+			}
+		}
+	}
+
+	// rows [r0, r1) of src into the columns of dst
+	void transpose(const float *src, float *dst, int r0, int r1) const
+	{
+		for (int c0 = 0; c0 < n; c0 += BLOCK)
+			for (int r = r0; r < r1; r++)
+				for (int c = c0; c < std::min(n, c0 + BLOCK); c++)
+					dst[(size_t)c * n + r] = src[(size_t)r * n + c];
+	}
+
+private:
+	int n;
+	std::vector<int> reversed;
+	std::vector<float> twiddleRe, twiddleIm;
+
+	// a' = a + w b, b' = a - w b for the columns [c0, c1) of two rows
+	static void butterfly(float *ar, float *ai, float *br, float *bi, float wr, float wi, int c0, int c1)
+	{
+		int c = c0;
+#ifdef FFT_SSE
+		__m128 vwr = _mm_set1_ps(wr), vwi = _mm_set1_ps(wi);
+		for (; c + 4 <= c1; c += 4)
+		{
+			__m128 xr = _mm_loadu_ps(br + c), xi = _mm_loadu_ps(bi + c);
+			__m128 tr = _mm_sub_ps(_mm_mul_ps(xr, vwr), _mm_mul_ps(xi, vwi));
+			__m128 ti = _mm_add_ps(_mm_mul_ps(xr, vwi), _mm_mul_ps(xi, vwr));
+			__m128 yr = _mm_loadu_ps(ar + c), yi = _mm_loadu_ps(ai + c);
+			_mm_storeu_ps(ar + c, _mm_add_ps(yr, tr));
+			_mm_storeu_ps(ai + c, _mm_add_ps(yi, ti));
+			_mm_storeu_ps(br + c, _mm_sub_ps(yr, tr));
+			_mm_storeu_ps(bi + c, _mm_sub_ps(yi, ti));
+		}
+#endif
+		for (; c < c1; c++)
+		{
+			float tr = br[c] * wr - bi[c] * wi;
+			float ti = br[c] * wi + bi[c] * wr;
+			br[c] = ar[c] - tr;
+			bi[c] = ai[c] - ti;
+			ar[c] += tr;
+			ai[c] += ti;
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,395 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <glad/glad.h>
+#include "gpu_resources.h"
+#include "image_writer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// What a capture reads: the final composite, the HDR scene target (before bloom and tone
+// mapping) or the shadow depth map.
+enum CaptureSource {
+	CAPTURE_SCREEN,
+	CAPTURE_SCENE,
+	CAPTURE_DEPTH,
+	CAPTURE_SOURCE_COUNT
+};
+
+static const char *captureSourceNames[CAPTURE_SOURCE_COUNT] = { "screen", "scene", "depth" };
+
+// comma separated names into a mask of (1 << source)
+inline bool parseCaptureSources(const char *list, unsigned int &sources)
+{
+	sources = 0;
+	std::stringstream in(list);
+	std::string name;
+	while (std::getline(in, name, ','))
+	{
+		int i = 0;
+		while (i < CAPTURE_SOURCE_COUNT && name != captureSourceNames[i])
+			i++;
+		if (i == CAPTURE_SOURCE_COUNT)
+			return false;
+		sources |= 1u << i;
+	}
+	return sources != 0;
+}
+
+struct CaptureSettings {
+	std::string directory;	// where the files go (must exist), empty: no capture
+	unsigned int sources;	// mask of (1 << CaptureSource)
+	int every;				// capture every n-th frame
+	unsigned int threads;	// encoders
+	int queueLimit;			// frames read back or waiting for an encoder, more are dropped
+
+	CaptureSettings() : sources(1u << CAPTURE_SCREEN), every(1), threads(2), queueLimit(8) {}
+};
+
+// Records frames without stalling the pipeline. read() starts a glReadPixels into a pixel pack
+// buffer of a ring and puts a fence behind it; LATENCY frames later beginFrame() maps the
+// buffer (the copy is long done by then), copies the pixels out and hands them to a pool of
+// encoder threads, which write screen_NNNNNN.png and scene / depth_NNNNNN.exr. A capture is
+// dropped only when queueLimit frames are already in flight.
+class FrameCapture
+{
+public:
+	static const int LATENCY = 3;
+
+	explicit FrameCapture(const CaptureSettings &settings)
+		: settings(settings), frame(-1), stopping(false), encoding(0), epoch(0),
+		captured(0), written(0), dropped(0), failed(0), stalls(0), frames(0),
+		latencySum(0.0), latencyMax(0.0), mainThreadMs(0.0), bytesRead(0)
+	{
+		this->settings.every = std::max(1, settings.every);
+		this->settings.queueLimit = std::max(1, settings.queueLimit);
+		this->settings.threads = std::max(1u, settings.threads);
+		if (!enabled())
+			return;
+		for (unsigned int i = 0; i < this->settings.threads; i++)
+			workers.push_back(std::thread([this]() { work(); }));
+		// one buffer per frame that may be in flight, sized by the first read into it
+		slots.resize(this->settings.queueLimit);
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			slots[i].PBO = gpuResources().create(GPU_BUFFER);
+			slots[i].capacity = 0;
+			slots[i].fence = 0;
+			slots[i].busy = false;
+			slots[i].source = CAPTURE_SCREEN;
+		}
+	}
+
+	~FrameCapture() { finish(); }
+
+	bool enabled() const { return !settings.directory.empty() && settings.sources != 0; }
+
+	// main thread, at the start of a frame: the readbacks LATENCY frames old go to the encoders
+	void beginFrame()
+	{
+		frame++;
+		if (!enabled())
+			return;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			if (slots[i].busy && frame - slots[i].frame >= LATENCY)
+				collect(slots[i], frame - slots[i].frame >= 2 * LATENCY);
+		}
+		mainThreadMs += elapsedMs(start);
+		frames++;
+	}
+
+	// this frame is recorded
+	bool due(CaptureSource source) const
+	{
+		return enabled() && (settings.sources & (1u << source)) && frame % settings.every == 0;
+	}
+
+	// main thread, after source was drawn: reads width x height of fbo's colour (or depth)
+	// attachment, 0 is the back buffer
+	void read(CaptureSource source, unsigned int fbo, int width, int height)
+	{
+		if (!due(source))
+			return;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		size_t bytes = (size_t)width * height * pixelSize(source);
+		Slot *slot = inFlight() < settings.queueLimit ? freeSlot(source, bytes) : NULL;
+		if (slot == NULL)
+		{
+			dropped++;
+			mainThreadMs += elapsedMs(start);
+			return;
+		}
+
+		GLint readFramebuffer = 0, packAlignment = 4;
+		glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFramebuffer);
+		glGetIntegerv(GL_PACK_ALIGNMENT, &packAlignment);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->PBO);
+		glPixelStorei(GL_PACK_ALIGNMENT, 1);
+		if (source == CAPTURE_SCREEN)
+			glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+		else if (source == CAPTURE_SCENE)
+			glReadPixels(0, 0, width, height, GL_RGB, GL_HALF_FLOAT, 0);
+		else
+			glReadPixels(0, 0, width, height, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+		glPixelStorei(GL_PACK_ALIGNMENT, packAlignment);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+
+		slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		slot->busy = true;
+		slot->source = source;
+		slot->width = width;
+		slot->height = height;
+		slot->bytes = bytes;
+		slot->frame = frame;
+		slot->epoch = epoch;
+		slot->issued = start;
+		captured++;
+		bytesRead += bytes;
+		mainThreadMs += elapsedMs(start);
+	}
+
+	// maps what is still in flight, waits for the encoders and joins them;
+	// the buffers stay until gpuResources().releaseAll()
+	void finish()
+	{
+		for (size_t i = 0; i < slots.size(); i++)
+		{
+			if (slots[i].busy)
+				collect(slots[i], true);
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+		workers.clear();
+	}
+
+	// the statistics start over (bench warmup), frames captured before are not counted
+	void resetStats()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		epoch++;
+		captured = written = dropped = failed = stalls = frames = 0;
+		latencySum = latencyMax = mainThreadMs = 0.0;
+		bytesRead = 0;
+	}
+
+	// "capture" member for the bench report, call after finish()
+	std::string report() const
+	{
+		std::ostringstream out;
+		out << "\"capture\": { \"sources\": [";
+		const char *separator = "";
+		for (int i = 0; i < CAPTURE_SOURCE_COUNT; i++)
+		{
+			if (settings.sources & (1u << i))
+			{
+				out << separator << "\"" << captureSourceNames[i] << "\"";
+				separator = ", ";
+			}
+		}
+		out << "], \"every\": " << settings.every << ", \"threads\": " << settings.threads
+			<< ", \"queue_limit\": " << settings.queueLimit << ", \"latency_frames\": " << LATENCY
+			<< ", \"captured\": " << captured << ", \"written\": " << written
+			<< ", \"dropped\": " << dropped << ", \"failed\": " << failed << ", \"stalls\": " << stalls
+			<< ", \"latency_ms\": { \"mean\": " << (written ? latencySum / written : 0.0) << ", \"max\": " << latencyMax << " }"
+			<< ", \"main_thread_ms\": " << (frames ? mainThreadMs / frames : 0.0)
+			<< ", \"bytes_read\": " << bytesRead << " }";
+		return out.str();
+	}
+
+private:
+	struct Slot {
+		unsigned int PBO;
+		size_t capacity;
+		GLsync fence;
+		bool busy;
+		CaptureSource source;
+		int width, height;
+		size_t bytes;
+		int frame;
+		int epoch;
+		std::chrono::steady_clock::time_point issued;
+	};
+
+	struct Job {
+		CaptureSource source;
+		int width, height;
+		int frame;
+		int epoch;
+		std::chrono::steady_clock::time_point issued;
+		std::vector<unsigned char> pixels;
+	};
+
+	CaptureSettings settings;
+	std::vector<Slot> slots;
+	int frame;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<Job> jobs;
+	std::vector<std::vector<unsigned char> > spare;	// pixel buffers of finished jobs
+	bool stopping;
+	int encoding;
+	int epoch;
+
+	int captured, written, dropped, failed, stalls, frames;
+	double latencySum, latencyMax, mainThreadMs;
+	size_t bytesRead;
+
+	static size_t pixelSize(CaptureSource source)
+	{
+		return source == CAPTURE_SCREEN ? 4 : source == CAPTURE_SCENE ? 3 * sizeof(GLhalf) : sizeof(float);
+	}
+
+	static double elapsedMs(std::chrono::steady_clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	}
+
+	int inFlight()
+	{
+		int busy = 0;
+		for (size_t i = 0; i < slots.size(); i++)
+			busy += slots[i].busy ? 1 : 0;
+		std::lock_guard<std::mutex> lock(mutex);
+		return busy + (int)jobs.size() + encoding;
+	}
+
+	// a free buffer of the ring, one that last held the same source first so it keeps its size
+	Slot *freeSlot(CaptureSource source, size_t bytes)
+	{
+		Slot *slot = NULL;
+		for (size_t i = 0; i < slots.size() && (slot == NULL || slot->source != source); i++)
+		{
+			if (!slots[i].busy)
+				slot = &slots[i];
+		}
+		if (slot != NULL && slot->capacity < bytes)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->PBO);
+			gpuResources().bufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+			gpuResources().allocated(GPU_BUFFER, slot->PBO, MEMORY_STAGING, "capture", GL_STREAM_READ, bytes);
+			slot->capacity = bytes;
+		}
+		return slot;
+	}
+
+	// wait: block on the fence, otherwise leave a copy that is not done for a later frame
+	void collect(Slot &slot, bool wait)
+	{
+		GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+		if (status == GL_TIMEOUT_EXPIRED)
+		{
+			if (!wait)
+				return;
+			stalls++;
+			status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, (GLuint64)1000000000);
+		}
+		glDeleteSync(slot.fence);
+		slot.fence = 0;
+		slot.busy = false;
+
+		Job job;
+		job.source = slot.source;
+		job.width = slot.width;
+		job.height = slot.height;
+		job.frame = slot.frame;
+		job.issued = slot.issued;
+		job.epoch = slot.epoch;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			if (!spare.empty())
+			{
+				job.pixels.swap(spare.back());
+				spare.pop_back();
+			}
+		}
+		job.pixels.resize(slot.bytes);
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.PBO);
+		void *mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.bytes, GL_MAP_READ_BIT);
+		bool ok = mapped != NULL && status != GL_WAIT_FAILED;
+		if (mapped)
+		{
+			memcpy(&job.pixels[0], mapped, slot.bytes);
+			glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!ok)
+		{
+			failed += job.epoch == epoch ? 1 : 0;
+			return;
+		}
+		jobs.push_back(std::move(job));
+		wake.notify_one();
+	}
+	void work()
+	{
+		for (;;)
+		{
+			Job job;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() { return stopping || !jobs.empty(); });
+				if (jobs.empty())
+					return;
+				job = std::move(jobs.front());
+				jobs.pop_front();
+				encoding++;
+			}
+
+			char name[32];
+			snprintf(name, sizeof(name), "%s_%06d.%s", captureSourceNames[job.source], job.frame, job.source == CAPTURE_SCREEN ? "png" : "exr");
+			std::string path = settings.directory + "/" + name;
+			bool ok;
+			if (job.source == CAPTURE_SCREEN)
+				ok = ImageWriter::writePng(path, &job.pixels[0], job.width, job.height, 4);
+			else if (job.source == CAPTURE_SCENE)
+				ok = ImageWriter::writeExr(path, &job.pixels[0], job.width, job.height, "RGB", ImageWriter::EXR_HALF);
+			else
+				ok = ImageWriter::writeExr(path, &job.pixels[0], job.width, job.height, "Z", ImageWriter::EXR_FLOAT);
+			double latency = elapsedMs(job.issued);
+
+			std::lock_guard<std::mutex> lock(mutex);
+			encoding--;
+			if (job.epoch == epoch)
+			{
+				if (ok)
+				{
+					written++;
+					latencySum += latency;
+					latencyMax = std::max(latencyMax, latency);
+				}
+				else
+					failed++;
+			}
+			if (!ok && failed == 1)
+				std::cout << "cannot write " << path << std::endl;
+			spare.push_back(std::move(job.pixels));
+		}
+	}
+};
+
+#endif
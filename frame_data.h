@@ -0,0 +1,73 @@
+#ifndef FRAME_DATA_H
+#define FRAME_DATA_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "gpu_resources.h"
+
+// Per-frame constants shared by every program through the FrameData uniform block.
+// The layout follows std140 and has to match the block declared in the shaders:
+//
+// struct Light { vec4 position; vec4 ambient; vec4 diffuse; vec4 specular; };
+// layout (std140) uniform FrameData {
+//     mat4 view; mat4 projection; mat4 lightSpaceMatrix; vec4 viewPos; Light lights[4];
+//     mat4 viewMatrices[4]; mat4 projections[4]; vec4 viewPositions[4];
+// };
+// view, projection and viewPos are the first view again; the layered passes pick theirs from
+// the arrays by instance (see FRAME_MAX_VIEWS).
+
+const GLuint FRAME_DATA_BINDING = 0;
+
+enum FrameLightIndex { SUN_LIGHT, RIGHT_LIGHT, LEFT_LIGHT, BACK_LIGHT, FRAME_LIGHT_COUNT };
+
+// cameras one frame can render, each into its own layer of the scene targets
+const int FRAME_MAX_VIEWS = 4;
+
+struct FrameLight {
+	glm::vec4 position; // xyz: position of the point light, direction of a directional light
+	glm::vec4 ambient;
+	glm::vec4 diffuse;
+	glm::vec4 specular;
+};
+
+struct FrameData {
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::mat4 lightSpaceMatrix;
+	glm::vec4 viewPos;
+	FrameLight lights[FRAME_LIGHT_COUNT];
+	glm::mat4 viewMatrices[FRAME_MAX_VIEWS];
+	glm::mat4 projections[FRAME_MAX_VIEWS];
+	glm::vec4 viewPositions[FRAME_MAX_VIEWS];
+};
+
+static_assert(sizeof(FrameData) == 3 * 64 + 16 + FRAME_LIGHT_COUNT * 64 + FRAME_MAX_VIEWS * (2 * 64 + 16), "FrameData must match the std140 block");
+
+// uniform buffer holding FrameData, written once per frame
+class FrameUniformBuffer
+{
+public:
+	FrameUniformBuffer() : ubo(0) {}
+
+	void create()
+	{
+		ubo = gpuResources().create(GPU_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+		gpuResources().bufferData(GL_UNIFORM_BUFFER, sizeof(FrameData), NULL, GL_DYNAMIC_DRAW);
+		gpuResources().allocated(GPU_BUFFER, ubo, MEMORY_BUFFERS, "frame data", GL_DYNAMIC_DRAW, sizeof(FrameData));
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, ubo);
+	}
+
+	void update(const FrameData &data)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, ubo);
+		gpuResources().bufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameData), &data);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	}
+
+private:
+	GLuint ubo;
+};
+
+#endif
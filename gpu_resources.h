@@ -0,0 +1,263 @@
+#ifndef GPU_RESOURCES_H
+#define GPU_RESOURCES_H
+
+#include <glad/glad.h>
+#include "memory_tracker.h"
+
+#include <cstddef>
+#include <set>
+#include <sstream>
+#include <string>
+
+enum GpuResourceType {
+	GPU_VERTEX_ARRAY,
+	GPU_BUFFER,
+	GPU_TEXTURE,
+	GPU_FRAMEBUFFER,
+	GPU_RENDERBUFFER,
+	GPU_PROGRAM,
+	GPU_SAMPLER,
+	GPU_RESOURCE_TYPE_COUNT
+};
+
+struct GpuResourceCounters {
+	unsigned int created;
+	unsigned int deleted;
+	size_t bytesUploaded;
+	size_t staticBytesUploaded; // GL_STATIC_DRAW buffers and texture images
+
+	GpuResourceCounters() : created(0), deleted(0), bytesUploaded(0), staticBytesUploaded(0) {}
+
+	// objects created or destroyed, or static data uploaded again
+	bool churn() const { return created != 0 || deleted != 0 || staticBytesUploaded != 0; }
+};
+
+// Owns the GL objects of the renderer. Everything is created and deleted through here,
+// so the counters show how many objects are alive and what each frame allocates and uploads.
+// Where storage is allocated the size is recorded too (allocated(), see memory_tracker.h).
+// The objects are released by releaseAll() while the context is still current,
+// the destructor runs after the context is gone and does not touch GL.
+class GpuResources
+{
+public:
+	GpuResources() : steadyState(false)
+	{
+		for (int i = 0; i < GPU_RESOURCE_TYPE_COUNT; i++)
+			peak[i] = 0;
+	}
+
+	GLuint create(GpuResourceType type)
+	{
+		GLuint id = 0;
+		switch (type)
+		{
+		case GPU_VERTEX_ARRAY: glGenVertexArrays(1, &id); break;
+		case GPU_BUFFER: glGenBuffers(1, &id); break;
+		case GPU_TEXTURE: glGenTextures(1, &id); break;
+		case GPU_FRAMEBUFFER: glGenFramebuffers(1, &id); break;
+		case GPU_RENDERBUFFER: glGenRenderbuffers(1, &id); break;
+		case GPU_PROGRAM: id = glCreateProgram(); break;
+		case GPU_SAMPLER: glGenSamplers(1, &id); break;
+		default: break;
+		}
+		return adopt(type, id);
+	}
+
+	// take ownership of an object created by code outside this registry (Shader, TextureFromFile)
+	GLuint adopt(GpuResourceType type, GLuint id)
+	{
+		if (id == 0 || !objects[type].insert(id).second)
+			return id;
+		if (objects[type].size() > peak[type])
+			peak[type] = objects[type].size();
+		count(&GpuResourceCounters::created);
+		return id;
+	}
+
+	void destroy(GpuResourceType type, GLuint &id)
+	{
+		if (id == 0 || objects[type].erase(id) == 0)
+			return;
+		release(type, id);
+		memoryTracker.released(type, id);
+		count(&GpuResourceCounters::deleted);
+		id = 0;
+	}
+
+	void releaseAll()
+	{
+		for (int type = 0; type < GPU_RESOURCE_TYPE_COUNT; type++)
+		{
+			for (std::set<GLuint>::iterator it = objects[type].begin(); it != objects[type].end(); ++it)
+			{
+				release((GpuResourceType)type, *it);
+				count(&GpuResourceCounters::deleted);
+			}
+			objects[type].clear();
+		}
+		memoryTracker.releasedAll();
+	}
+
+	// the storage of an object for the memory accounting, replaces what was recorded for it
+	void allocated(GpuResourceType type, GLuint id, MemoryCategory category, const std::string &owner, GLenum format, size_t bytes)
+	{
+		memoryTracker.allocated(type, id, category, owner, format, bytes);
+	}
+
+	MemoryTracker &memory() { return memoryTracker; }
+	const MemoryTracker &memory() const { return memoryTracker; }
+
+	// glBufferData on the buffer bound to target
+	void bufferData(GLenum target, GLsizeiptr size, const void *data, GLenum usage)
+	{
+		glBufferData(target, size, data, usage);
+		if (data)
+			uploaded((size_t)size, usage == GL_STATIC_DRAW);
+	}
+
+	void bufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const void *data)
+	{
+		glBufferSubData(target, offset, size, data);
+		uploaded((size_t)size, false);
+	}
+
+	// glTexImage2D on the texture bound to target, a NULL image only allocates
+	void texImage2D(GLenum target, GLint level, GLint internalFormat, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *data)
+	{
+		glTexImage2D(target, level, internalFormat, width, height, 0, format, type, data);
+		if (data)
+			uploaded((size_t)width * height * pixelSize(format, type), true);
+	}
+
+	// glTexSubImage2D, counted like bufferSubData: per-frame data, not churn
+	void texSubImage2D(GLenum target, GLint level, GLint x, GLint y, GLsizei width, GLsizei height, GLenum format, GLenum type, const void *data)
+	{
+		glTexSubImage2D(target, level, x, y, width, height, format, type, data);
+		uploaded((size_t)width * height * pixelSize(format, type), false);
+	}
+
+	void uploaded(size_t bytes, bool isStatic)
+	{
+		frame.bytesUploaded += bytes;
+		total.bytesUploaded += bytes;
+		steady.bytesUploaded += steadyState ? bytes : 0;
+		if (!isStatic)
+			return;
+		frame.staticBytesUploaded += bytes;
+		total.staticBytesUploaded += bytes;
+		steady.staticBytesUploaded += steadyState ? bytes : 0;
+	}
+
+	void beginFrame()
+	{
+		lastFrame = frame;
+		frame = GpuResourceCounters();
+	}
+
+	// from now on nothing should be created, deleted or uploaded as static data
+	void beginSteadyState()
+	{
+		steadyState = true;
+		steady = GpuResourceCounters();
+	}
+
+	size_t live(GpuResourceType type) const { return objects[type].size(); }
+
+	size_t live() const
+	{
+		size_t n = 0;
+		for (int i = 0; i < GPU_RESOURCE_TYPE_COUNT; i++)
+			n += objects[i].size();
+		return n;
+	}
+
+	const GpuResourceCounters &currentFrame() const { return frame; }
+	const GpuResourceCounters &previousFrame() const { return lastFrame; }
+	const GpuResourceCounters &totals() const { return total; }
+	const GpuResourceCounters &steadyStateCounters() const { return steady; }
+
+	// "resources" member for the bench report
+	std::string report() const
+	{
+		static const char *names[GPU_RESOURCE_TYPE_COUNT] = { "vertex_arrays", "buffers", "textures", "framebuffers", "renderbuffers", "programs", "samplers" };
+		std::ostringstream out;
+		out << "\"resources\": {\n";
+		out << "    \"live\": { ";
+		for (int i = 0; i < GPU_RESOURCE_TYPE_COUNT; i++)
+			out << "\"" << names[i] << "\": " << objects[i].size() << (i + 1 < GPU_RESOURCE_TYPE_COUNT ? ", " : " },\n");
+		out << "    \"peak\": { ";
+		for (int i = 0; i < GPU_RESOURCE_TYPE_COUNT; i++)
+			out << "\"" << names[i] << "\": " << peak[i] << (i + 1 < GPU_RESOURCE_TYPE_COUNT ? ", " : " },\n");
+		out << "    \"total\": " << counters(total) << ",\n";
+		out << "    \"last_frame\": " << counters(lastFrame) << ",\n";
+		out << "    \"steady_state\": " << counters(steady) << ",\n";
+		out << "    \"churn\": " << (steady.churn() ? "true" : "false") << "\n";
+		out << "  }";
+		return out.str();
+	}
+
+private:
+	std::set<GLuint> objects[GPU_RESOURCE_TYPE_COUNT];
+	size_t peak[GPU_RESOURCE_TYPE_COUNT];
+	GpuResourceCounters frame, lastFrame, total, steady;
+	bool steadyState;
+	MemoryTracker memoryTracker;
+
+	void count(unsigned int GpuResourceCounters::*field)
+	{
+		frame.*field += 1;
+		total.*field += 1;
+		if (steadyState)
+			steady.*field += 1;
+	}
+
+	static void release(GpuResourceType type, GLuint id)
+	{
+		switch (type)
+		{
+		case GPU_VERTEX_ARRAY: glDeleteVertexArrays(1, &id); break;
+		case GPU_BUFFER: glDeleteBuffers(1, &id); break;
+		case GPU_TEXTURE: glDeleteTextures(1, &id); break;
+		case GPU_FRAMEBUFFER: glDeleteFramebuffers(1, &id); break;
+		case GPU_RENDERBUFFER: glDeleteRenderbuffers(1, &id); break;
+		case GPU_PROGRAM: glDeleteProgram(id); break;
+		case GPU_SAMPLER: glDeleteSamplers(1, &id); break;
+		default: break;
+		}
+	}
+
+	static size_t pixelSize(GLenum format, GLenum type)
+	{
+		size_t components = 4;
+		switch (format)
+		{
+		case GL_RED: case GL_DEPTH_COMPONENT: components = 1; break;
+		case GL_RG: components = 2; break;
+		case GL_RGB: case GL_BGR: components = 3; break;
+		default: break;
+		}
+		switch (type)
+		{
+		case GL_FLOAT: case GL_UNSIGNED_INT: case GL_INT: return components * 4;
+		case GL_HALF_FLOAT: case GL_UNSIGNED_SHORT: case GL_SHORT: return components * 2;
+		default: return components;
+		}
+	}
+
+	static std::string counters(const GpuResourceCounters &c)
+	{
+		std::ostringstream out;
+		out << "{ \"created\": " << c.created << ", \"deleted\": " << c.deleted
+			<< ", \"bytes_uploaded\": " << c.bytesUploaded << ", \"static_bytes_uploaded\": " << c.staticBytesUploaded << " }";
+		return out.str();
+	}
+};
+
+// the registry used by main.cpp, CachedModel and CachedShader
+inline GpuResources &gpuResources()
+{
+	static GpuResources resources;
+	return resources;
+}
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef HDR_FORMAT_H
+#define HDR_FORMAT_H
+
+#include <glad/glad.h>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+
+// Storage of the HDR scene target and the bloom levels. The packed formats hold the same
+// positive range in 4 bytes a texel; RGB16F is padded to 8 bytes by most drivers.
+// RGB9E5 is not colour renderable in GL 3.3, asking for it falls back to R11F_G11F_B10F.
+enum HdrFormat {
+	HDR_RGB16F,
+	HDR_R11G11B10F,
+	HDR_RGB9E5,
+	HDR_FORMAT_COUNT
+};
+
+static const char *hdrFormatNames[HDR_FORMAT_COUNT] = { "rgb16f", "r11g11b10f", "rgb9e5" };
+
+inline bool parseHdrFormat(const char *name, HdrFormat &format)
+{
+	for (int i = 0; i < HDR_FORMAT_COUNT; i++)
+	{
+		if (strcmp(name, hdrFormatNames[i]) == 0)
+		{
+			format = (HdrFormat)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+inline GLenum hdrInternalFormat(HdrFormat format)
+{
+	switch (format)
+	{
+	case HDR_R11G11B10F: return GL_R11F_G11F_B10F;
+	case HDR_RGB9E5: return GL_RGB9_E5;
+	default: return GL_RGB16F;
+	}
+}
+
+inline size_t hdrBytesPerPixel(HdrFormat format)
+{
+	return format == HDR_RGB16F ? 8 : 4;
+}
+
+// Estimated colour traffic of a frame from the scene target to the window, every texel read
+// or written once (no overdraw, no cache misses; depth and the shadow map are the same for all
+// layouts and left out). The old layout is the one this renderer started with: a second RGB16F
+// attachment for the bright parts, ten full size blur passes and a composite reading both.
+struct PostBandwidth {
+	size_t written;
+	size_t read;
+
+	PostBandwidth() : written(0), read(0) {}
+
+	// scene of w x h drawn in format, bloomLevels halving levels, composite into a screen of screenPixels RGBA8
+	static PostBandwidth chain(HdrFormat format, size_t w, size_t h, int bloomLevels, size_t screenPixels)
+	{
+		size_t bpp = hdrBytesPerPixel(format);
+		PostBandwidth b;
+		b.written += w * h * bpp;
+		size_t levelW = w, levelH = h, previous = w * h, first = 0;
+		for (int i = 0; i < bloomLevels; i++)
+		{
+			levelW = levelW / 2 > 0 ? levelW / 2 : 1;
+			levelH = levelH / 2 > 0 ? levelH / 2 : 1;
+			size_t level = levelW * levelH;
+			if (i == 0)
+				first = level;
+			// downsample: read the larger level, write this one
+			b.read += previous * bpp;
+			b.written += level * bpp;
+			// upsample: read this one, blend into the larger level (read and write)
+			if (i > 0)
+			{
+				b.read += (level + previous) * bpp;
+				b.written += previous * bpp;
+			}
+			previous = level;
+		}
+		b.read += (w * h + first) * bpp;
+		b.written += screenPixels * 4;
+		return b;
+	}
+
+	static PostBandwidth oldLayout(size_t w, size_t h, size_t screenPixels)
+	{
+		const size_t bpp = 8, blurPasses = 10;
+		PostBandwidth b;
+		b.written += 2 * w * h * bpp;
+		b.read += blurPasses * w * h * bpp;
+		b.written += blurPasses * w * h * bpp;
+		b.read += 2 * w * h * bpp;
+		b.written += screenPixels * 4;
+		return b;
+	}
+
+	std::string json() const
+	{
+		std::ostringstream out;
+		out << "{ \"bytes_written\": " << written << ", \"bytes_read\": " << read << " }";
+		return out.str();
+	}
+};
+
+#endif
@@ -0,0 +1,137 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <GLFW/glfw3.h>
+#ifndef _WIN32
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+#include <iostream>
+
+// Offscreen OpenGL 3.3 core context for the --bench mode.
+// On Linux a surfaceless EGL context is tried first, so the benchmark also runs on
+// machines without a display (Mesa llvmpipe); otherwise an invisible GLFW window is used.
+// There is no default framebuffer to draw into, the caller renders into its own FBO.
+
+struct HeadlessState {
+	GLFWwindow *window;
+#ifndef _WIN32
+	EGLDisplay display;
+	EGLContext context;
+#endif
+
+	HeadlessState() : window(NULL)
+#ifndef _WIN32
+		, display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT)
+#endif
+	{}
+};
+
+// one per program, whichever file includes this
+inline HeadlessState &headlessState()
+{
+	static HeadlessState state;
+	return state;
+}
+
+#ifndef _WIN32
+inline bool createEGLContext()
+{
+	EGLDisplay &headlessDisplay = headlessState().display;
+	EGLContext &headlessContext = headlessState().context;
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		headlessDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+	if (headlessDisplay == EGL_NO_DISPLAY)
+		headlessDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if (headlessDisplay == EGL_NO_DISPLAY || !eglInitialize(headlessDisplay, NULL, NULL))
+		return false;
+
+	// no surface is ever created, so any surface type will do
+	const EGLint configAttribs[] = {
+		EGL_SURFACE_TYPE, 0,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint numConfigs = 0;
+	if (!eglChooseConfig(headlessDisplay, configAttribs, &config, 1, &numConfigs) || numConfigs == 0)
+		return false;
+	if (!eglBindAPI(EGL_OPENGL_API))
+		return false;
+
+	const EGLint contextAttribs[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 3,
+		EGL_CONTEXT_MINOR_VERSION, 3,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	headlessContext = eglCreateContext(headlessDisplay, config, EGL_NO_CONTEXT, contextAttribs);
+	if (headlessContext == EGL_NO_CONTEXT)
+		return false;
+	return eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, headlessContext) == EGL_TRUE;
+}
+#endif
+
+inline bool createHeadlessContext()
+{
+	GLFWwindow *&headlessWindow = headlessState().window;
+#ifndef _WIN32
+	EGLDisplay &headlessDisplay = headlessState().display;
+	if (createEGLContext())
+		return true;
+	std::cout << "EGL surfaceless context not available, falling back to a hidden window" << std::endl;
+	if (headlessDisplay != EGL_NO_DISPLAY)
+		eglTerminate(headlessDisplay);
+	headlessDisplay = EGL_NO_DISPLAY;
+#endif
+	if (!glfwInit())
+		return false;
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	headlessWindow = glfwCreateWindow(1, 1, "bench", NULL, NULL);
+	if (headlessWindow == NULL)
+	{
+		glfwTerminate();
+		return false;
+	}
+	glfwMakeContextCurrent(headlessWindow);
+	return true;
+}
+
+inline void *headlessGetProcAddress(const char *name)
+{
+#ifndef _WIN32
+	if (headlessState().context != EGL_NO_CONTEXT)
+		return (void *)eglGetProcAddress(name);
+#endif
+	return (void *)glfwGetProcAddress(name);
+}
+
+inline void destroyHeadlessContext()
+{
+	GLFWwindow *&headlessWindow = headlessState().window;
+#ifndef _WIN32
+	EGLDisplay &headlessDisplay = headlessState().display;
+	EGLContext &headlessContext = headlessState().context;
+	if (headlessContext != EGL_NO_CONTEXT)
+	{
+		eglMakeCurrent(headlessDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(headlessDisplay, headlessContext);
+		eglTerminate(headlessDisplay);
+		headlessContext = EGL_NO_CONTEXT;
+		return;
+	}
+#endif
+	if (headlessWindow != NULL)
+	{
+		glfwDestroyWindow(headlessWindow);
+		glfwTerminate();
+		headlessWindow = NULL;
+	}
+}
+
+#endif
@@ -0,0 +1,302 @@
+#ifndef IMAGE_WRITER_H
+#define IMAGE_WRITER_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// PNG and OpenEXR files of captured frames, written without a library.
+// PNG: 8 bit RGB, every row Sub filtered and deflated with the fixed Huffman codes and
+// matches found through a one entry hash table (fast, about half the size of stored blocks).
+// EXR: scanline, uncompressed, half or float channels.
+// Rows are passed bottom up as glReadPixels returns them and flipped on the way out.
+
+namespace ImageWriter
+{
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(std::vector<unsigned char> &out) : out(out), bits(0), count(0) {}
+
+		// value's low n bits, least significant first
+		void put(uint32_t value, int n)
+		{
+			bits |= value << count;
+			count += n;
+			while (count >= 8)
+			{
+				out.push_back((unsigned char)bits);
+				bits >>= 8;
+				count -= 8;
+			}
+		}
+
+		// Huffman codes go out most significant bit first
+		void code(uint32_t value, int n)
+		{
+			uint32_t reversed = 0;
+			for (int i = 0; i < n; i++)
+				reversed |= ((value >> i) & 1) << (n - 1 - i);
+			put(reversed, n);
+		}
+
+		void flush()
+		{
+			if (count > 0)
+				out.push_back((unsigned char)bits);
+			bits = 0;
+			count = 0;
+		}
+
+	private:
+		std::vector<unsigned char> &out;
+		uint32_t bits;
+		int count;
+	};
+
+	inline void literal(BitWriter &w, int c)
+	{
+		if (c < 144)
+			w.code(0x30 + c, 8);
+		else if (c < 256)
+			w.code(0x190 + c - 144, 9);
+		else if (c < 280)
+			w.code(c - 256, 7);
+		else
+			w.code(0xC0 + c - 280, 8);
+	}
+
+	inline void match(BitWriter &w, int length, int distance)
+	{
+		static const int lengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+			35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+		static const int lengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+			3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+		static const int distanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+			257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+		static const int distanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+			7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+		int l = 28;
+		while (lengthBase[l] > length)
+			l--;
+		literal(w, 257 + l);
+		w.put(length - lengthBase[l], lengthExtra[l]);
+		int d = 29;
+		while (distanceBase[d] > distance)
+			d--;
+		w.code(d, 5);
+		w.put(distance - distanceBase[d], distanceExtra[d]);
+	}
+
+	// zlib stream of data in one fixed Huffman block
+	inline std::vector<unsigned char> deflate(const std::vector<unsigned char> &data)
+	{
+		const int HASH_BITS = 15, WINDOW = 32768, MAX_MATCH = 258;
+		std::vector<unsigned char> out;
+		out.reserve(data.size() / 2 + 64);
+		out.push_back(0x78);
+		out.push_back(0x01);
+		BitWriter w(out);
+		w.put(1, 1);	// final block
+		w.put(1, 2);	// fixed codes
+		std::vector<int> head((size_t)1 << HASH_BITS, -1);
+		const int n = (int)data.size();
+		const unsigned char *p = data.empty() ? NULL : &data[0];
+		int i = 0;
+		while (i < n)
+		{
+			int length = 0, distance = 0;
+			if (i + 3 <= n)
+			{
+				uint32_t h = ((uint32_t)p[i] << 16 | (uint32_t)p[i + 1] << 8 | p[i + 2]) * 2654435761u >> (32 - HASH_BITS);
+				int candidate = head[h];
+				head[h] = i;
+				if (candidate >= 0 && i - candidate <= WINDOW)
+				{
+					int limit = std::min(MAX_MATCH, n - i);
+					while (length < limit && p[candidate + length] == p[i + length])
+						length++;
+					distance = i - candidate;
+				}
+			}
+			if (length >= 3)
+			{
+				match(w, length, distance);
+				i += length;
+			}
+			else
+				literal(w, p[i++]);
+		}
+		literal(w, 256);
+		w.flush();
+		uint32_t a = 1, b = 0;
+		for (int k = 0; k < n; k++)
+		{
+			a = (a + p[k]) % 65521;
+			b = (b + a) % 65521;
+		}
+		uint32_t adler = b << 16 | a;
+		for (int s = 24; s >= 0; s -= 8)
+			out.push_back((unsigned char)(adler >> s));
+		return out;
+	}
+
+	struct CrcTable {
+		uint32_t entries[256];
+
+		CrcTable()
+		{
+			for (uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t c = i;
+				for (int k = 0; k < 8; k++)
+					c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+				entries[i] = c;
+			}
+		}
+	};
+
+	inline uint32_t crc32(const unsigned char *data, size_t size, uint32_t crc = 0)
+	{
+		static const CrcTable table;	// built once, also when the encoders start together
+		crc = ~crc;
+		for (size_t i = 0; i < size; i++)
+			crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	inline void chunk(std::ofstream &out, const char *type, const std::vector<unsigned char> &data)
+	{
+		unsigned char header[8];
+		uint32_t size = (uint32_t)data.size();
+		for (int i = 0; i < 4; i++)
+			header[i] = (unsigned char)(size >> (24 - 8 * i));
+		memcpy(header + 4, type, 4);
+		uint32_t crc = crc32(header + 4, 4);
+		if (!data.empty())
+			crc = crc32(&data[0], data.size(), crc);
+		unsigned char tail[4];
+		for (int i = 0; i < 4; i++)
+			tail[i] = (unsigned char)(crc >> (24 - 8 * i));
+		out.write((const char *)header, 8);
+		if (!data.empty())
+			out.write((const char *)&data[0], data.size());
+		out.write((const char *)tail, 4);
+	}
+
+	// pixels: width x height texels of channels bytes (3 or 4, alpha is dropped), bottom row first
+	inline bool writePng(const std::string &path, const unsigned char *pixels, int width, int height, int channels)
+	{
+		std::vector<unsigned char> raw((size_t)(width * 3 + 1) * height);
+		for (int y = 0; y < height; y++)
+		{
+			const unsigned char *src = pixels + (size_t)(height - 1 - y) * width * channels;
+			unsigned char *row = &raw[(size_t)y * (width * 3 + 1)];
+			row[0] = 1;	// Sub: each byte minus the one of the pixel to the left
+			for (int x = 0; x < width; x++)
+				for (int c = 0; c < 3; c++)
+					row[1 + x * 3 + c] = (unsigned char)(src[x * channels + c] - (x > 0 ? src[(x - 1) * channels + c] : 0));
+		}
+
+		std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+		static const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+		out.write((const char *)signature, 8);
+		std::vector<unsigned char> header(13, 0);
+		for (int i = 0; i < 4; i++)
+		{
+			header[i] = (unsigned char)(width >> (24 - 8 * i));
+			header[4 + i] = (unsigned char)(height >> (24 - 8 * i));
+		}
+		header[8] = 8;	// bits per channel
+		header[9] = 2;	// RGB
+		chunk(out, "IHDR", header);
+		chunk(out, "IDAT", deflate(raw));
+		chunk(out, "IEND", std::vector<unsigned char>());
+		return (bool)out;
+	}
+
+	enum ExrPixelType { EXR_HALF = 1, EXR_FLOAT = 2 };
+
+	inline void exrAttribute(std::vector<unsigned char> &header, const char *name, const char *type, const void *value, int size)
+	{
+		header.insert(header.end(), name, name + strlen(name) + 1);
+		header.insert(header.end(), type, type + strlen(type) + 1);
+		header.insert(header.end(), (const unsigned char *)&size, (const unsigned char *)&size + 4);
+		header.insert(header.end(), (const unsigned char *)value, (const unsigned char *)value + size);
+	}
+
+	// pixels: interleaved channels (names in the order they are stored, e.g. "RGB" or "Z") of
+	// type, bottom row first; EXR stores the channels of a row one after another, sorted by name.
+	// Little endian hosts only, like the KTX files of texture_cache.h.
+	inline bool writeExr(const std::string &path, const void *pixels, int width, int height, const char *channels, ExrPixelType type)
+	{
+		int count = (int)strlen(channels);
+		int typeSize = type == EXR_HALF ? 2 : 4;
+		std::vector<int> order;
+		for (char name = 'A'; name <= 'Z'; name++)
+			for (int c = 0; c < count; c++)
+				if (channels[c] == name)
+					order.push_back(c);
+
+		std::vector<unsigned char> header;
+		const uint32_t magic = 20000630, version = 2;
+		header.insert(header.end(), (const unsigned char *)&magic, (const unsigned char *)&magic + 4);
+		header.insert(header.end(), (const unsigned char *)&version, (const unsigned char *)&version + 4);
+		std::vector<unsigned char> list;
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			int32_t fields[4] = { type, 0, 1, 1 };	// pixel type, pLinear + reserved, x / y sampling
+			list.push_back((unsigned char)channels[order[i]]);
+			list.push_back(0);
+			list.insert(list.end(), (const unsigned char *)fields, (const unsigned char *)fields + sizeof(fields));
+		}
+		list.push_back(0);
+		exrAttribute(header, "channels", "chlist", &list[0], (int)list.size());
+		unsigned char compression = 0;
+		exrAttribute(header, "compression", "compression", &compression, 1);
+		int32_t window[4] = { 0, 0, width - 1, height - 1 };
+		exrAttribute(header, "dataWindow", "box2i", window, sizeof(window));
+		exrAttribute(header, "displayWindow", "box2i", window, sizeof(window));
+		unsigned char lineOrder = 0;
+		exrAttribute(header, "lineOrder", "lineOrder", &lineOrder, 1);
+		float aspect = 1.0f, center[2] = { 0.0f, 0.0f }, windowWidth = 1.0f;
+		exrAttribute(header, "pixelAspectRatio", "float", &aspect, 4);
+		exrAttribute(header, "screenWindowCenter", "v2f", center, sizeof(center));
+		exrAttribute(header, "screenWindowWidth", "float", &windowWidth, 4);
+		header.push_back(0);
+
+		int rowBytes = width * count * typeSize;
+		uint64_t offset = header.size() + (uint64_t)height * 8;
+		for (int y = 0; y < height; y++)
+		{
+			header.insert(header.end(), (const unsigned char *)&offset, (const unsigned char *)&offset + 8);
+			offset += 8 + rowBytes;
+		}
+
+		std::ofstream out(path.c_str(), std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+		out.write((const char *)&header[0], header.size());
+		std::vector<unsigned char> line(8 + rowBytes);
+		const unsigned char *src = (const unsigned char *)pixels;
+		for (int y = 0; y < height; y++)
+		{
+			int32_t fields[2] = { y, rowBytes };
+			memcpy(&line[0], fields, 8);
+			const unsigned char *row = src + (size_t)(height - 1 - y) * rowBytes;
+			unsigned char *dst = &line[8];
+			for (size_t i = 0; i < order.size(); i++)
+				for (int x = 0; x < width; x++, dst += typeSize)
+					memcpy(dst, row + ((size_t)x * count + order[i]) * typeSize, typeSize);
+			out.write((const char *)&line[0], line.size());
+		}
+		return (bool)out;
+	}
+}
+
+#endif
@@ -0,0 +1,190 @@
+#ifndef INPUT_RECORDING_H
+#define INPUT_RECORDING_H
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// movement keys held down, a mask
+enum InputKey {
+	INPUT_FORWARD = 1,
+	INPUT_BACKWARD = 2,
+	INPUT_LEFT = 4,
+	INPUT_RIGHT = 8
+};
+
+enum InputEventType {
+	INPUT_KEYS,		// keys: the held movement keys from now on
+	INPUT_MOUSE,	// x, y: cursor offset
+	INPUT_SCROLL,	// y: wheel offset
+	INPUT_BLOOM,	// keys: bloom on (1) or off (0)
+	INPUT_EXPOSURE,	// x: the new exposure
+	INPUT_EVENT_COUNT
+};
+
+static const char *inputEventNames[INPUT_EVENT_COUNT] = { "keys", "mouse", "scroll", "bloom", "exposure" };
+
+struct InputEvent {
+	double time;	// seconds since the recording started
+	InputEventType type;
+	unsigned int keys;
+	float x, y;
+};
+
+// The camera input of a session and the bloom / exposure changes, in time order. The events of
+// a frame share its time; cursor offsets of one frame are summed, keys and settings are only
+// written when they change, so a still camera costs nothing. Replaying hands out the events up
+// to a time, the replay clock advances with a fixed step and not with the wall clock.
+//
+// File, one event per line, # starts a comment:
+//   <time> keys <mask>  |  <time> mouse <dx> <dy>  |  <time> scroll <dy>
+//   <time> bloom <0|1>  |  <time> exposure <value>  |  <time> end
+class InputRecording
+{
+public:
+	InputRecording() : duration(0.0), next(0), recordedKeys(0) {}
+
+	void keys(double time, unsigned int mask)
+	{
+		if (mask == recordedKeys)
+			return;
+		recordedKeys = mask;
+		add(time, INPUT_KEYS, mask, 0.0f, 0.0f);
+	}
+
+	void mouse(double time, float dx, float dy)
+	{
+		if (!events.empty() && events.back().type == INPUT_MOUSE && events.back().time == time)
+		{
+			events.back().x += dx;
+			events.back().y += dy;
+			return;
+		}
+		add(time, INPUT_MOUSE, 0, dx, dy);
+	}
+
+	void scroll(double time, float dy)
+	{
+		if (!events.empty() && events.back().type == INPUT_SCROLL && events.back().time == time)
+		{
+			events.back().y += dy;
+			return;
+		}
+		add(time, INPUT_SCROLL, 0, 0.0f, dy);
+	}
+
+	void bloom(double time, bool on) { add(time, INPUT_BLOOM, on ? 1 : 0, 0.0f, 0.0f); }
+	void exposure(double time, float value) { add(time, INPUT_EXPOSURE, 0, value, 0.0f); }
+
+	// the recording lasts at least until time
+	void extend(double time) { duration = std::max(duration, time); }
+
+	size_t size() const { return events.size(); }
+	double length() const { return duration; }
+
+	// fixed steps of step seconds that cover the recording
+	int frames(double step) const { return (int)(duration / step) + 1; }
+
+	bool save(const std::string &path) const
+	{
+		std::ofstream out(path.c_str());
+		if (!out)
+			return false;
+		out.precision(9);
+		out << "# input recording: <time> <event> <values>\n";
+		for (size_t i = 0; i < events.size(); i++)
+		{
+			const InputEvent &e = events[i];
+			out << e.time << " " << inputEventNames[e.type];
+			if (e.type == INPUT_KEYS || e.type == INPUT_BLOOM)
+				out << " " << e.keys;
+			else if (e.type == INPUT_MOUSE)
+				out << " " << e.x << " " << e.y;
+			else if (e.type == INPUT_SCROLL)
+				out << " " << e.y;
+			else
+				out << " " << e.x;
+			out << "\n";
+		}
+		out << duration << " end\n";
+		return (bool)out;
+	}
+
+	bool load(const std::string &path)
+	{
+		std::ifstream in(path.c_str());
+		if (!in)
+		{
+			std::cout << "REPLAY: cannot open " << path << std::endl;
+			return false;
+		}
+		events.clear();
+		duration = 0.0;
+		next = 0;
+		std::string line;
+		for (int number = 1; std::getline(in, line); number++)
+		{
+			std::istringstream fields(line.substr(0, line.find('#')));
+			InputEvent e = { 0.0, INPUT_KEYS, 0, 0.0f, 0.0f };
+			std::string kind;
+			if (!(fields >> e.time))
+				continue;
+			bool ok = (bool)(fields >> kind) && e.time >= duration;
+			if (ok && kind == "end")
+			{
+				duration = e.time;
+				continue;
+			}
+			int type = 0;
+			while (type < INPUT_EVENT_COUNT && kind != inputEventNames[type])
+				type++;
+			e.type = (InputEventType)type;
+			if (type == INPUT_KEYS || type == INPUT_BLOOM)
+				ok = ok && (bool)(fields >> e.keys);
+			else if (type == INPUT_MOUSE)
+				ok = ok && (bool)(fields >> e.x >> e.y);
+			else if (type == INPUT_SCROLL)
+				ok = ok && (bool)(fields >> e.y);
+			else if (type == INPUT_EXPOSURE)
+				ok = ok && (bool)(fields >> e.x);
+			else
+				ok = false;
+			if (!ok)
+			{
+				std::cout << "REPLAY: " << path << ":" << number << ": cannot read \"" << line << "\"" << std::endl;
+				return false;
+			}
+			events.push_back(e);
+			duration = e.time;
+		}
+		return true;
+	}
+
+	// replay: the next event at or before time, false when there is none (yet)
+	bool replay(double time, InputEvent &event)
+	{
+		if (next >= events.size() || events[next].time > time)
+			return false;
+		event = events[next++];
+		return true;
+	}
+
+private:
+	std::vector<InputEvent> events;
+	double duration;
+	size_t next;				// replay position
+	unsigned int recordedKeys;	// last keys event
+
+	void add(double time, InputEventType type, unsigned int keys, float x, float y)
+	{
+		InputEvent e = { time, type, keys, x, y };
+		events.push_back(e);
+		extend(time);
+	}
+};
+
+#endif
@@ -0,0 +1,100 @@
+#ifndef INSTANCE_BUFFER_H
+#define INSTANCE_BUFFER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "cached_model.h"
+#include "gpu_resources.h"
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+// per-instance vertex data, attribute locations 5-8 (model) and 9-11 (normal matrix)
+struct ModelInstance {
+	glm::mat4 model;
+	glm::mat3 normalMatrix; // transpose(inverse(mat3(model))), computed here instead of per vertex
+};
+
+const GLuint INSTANCE_MODEL_LOCATION = 5;
+const GLuint INSTANCE_NORMAL_LOCATION = 9;
+
+// Transforms of a set of instances (the fleet) in one vertex buffer. Attached to the
+// VAO of a CachedModel, the model is drawn for all instances with one instanced draw
+// per mesh. Several models can share the buffer (the ships and their name billboards).
+class InstanceBuffer
+{
+public:
+	InstanceBuffer() : VBO(0), capacity(0), instanceCount(0) {}
+
+	void create()
+	{
+		VBO = gpuResources().create(GPU_BUFFER);
+	}
+
+	// upload new transforms, skipped when they are the ones already in the buffer
+	void update(const std::vector<glm::mat4> &transforms)
+	{
+		bool same = transforms.size() == instances.size();
+		for (size_t i = 0; same && i < transforms.size(); i++)
+			same = memcmp(&transforms[i][0][0], &instances[i].model[0][0], sizeof(glm::mat4)) == 0;
+		if (same && VBO != 0 && capacity != 0)
+			return;
+
+		instances.resize(transforms.size());
+		for (size_t i = 0; i < transforms.size(); i++)
+		{
+			instances[i].model = transforms[i];
+			instances[i].normalMatrix = glm::transpose(glm::inverse(glm::mat3(transforms[i])));
+		}
+		instanceCount = (GLsizei)instances.size();
+
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		if (instances.size() > capacity)
+		{
+			capacity = instances.size();
+			gpuResources().bufferData(GL_ARRAY_BUFFER, capacity * sizeof(ModelInstance), instances.empty() ? NULL : &instances[0], GL_DYNAMIC_DRAW);
+			gpuResources().allocated(GPU_BUFFER, VBO, MEMORY_BUFFERS, "instances", GL_DYNAMIC_DRAW, capacity * sizeof(ModelInstance));
+		}
+		else if (!instances.empty())
+			gpuResources().bufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(ModelInstance), &instances[0]);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// add the instance attributes to the VAO of the model, starting at instance first
+	// (GL 3.3 has no base instance, the attributes are pointed at the range instead);
+	// divisor: draw instances per transform, the layered passes draw every one once per view
+	void attach(CachedModel &model, GLsizei first = 0, GLuint divisor = 1)
+	{
+		size_t base = first * sizeof(ModelInstance);
+		glBindBuffer(GL_ARRAY_BUFFER, VBO);
+		glBindVertexArray(model.VAO);
+		for (GLuint column = 0; column < 4; column++)
+		{
+			GLuint location = INSTANCE_MODEL_LOCATION + column;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(ModelInstance), (void*)(base + offsetof(ModelInstance, model) + column * sizeof(glm::vec4)));
+			glVertexAttribDivisor(location, divisor);
+		}
+		for (GLuint column = 0; column < 3; column++)
+		{
+			GLuint location = INSTANCE_NORMAL_LOCATION + column;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(ModelInstance), (void*)(base + offsetof(ModelInstance, normalMatrix) + column * sizeof(glm::vec3)));
+			glVertexAttribDivisor(location, divisor);
+		}
+		glBindVertexArray(0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	GLsizei count() const { return instanceCount; }
+	const std::vector<ModelInstance> &data() const { return instances; }
+
+private:
+	unsigned int VBO;
+	size_t capacity;
+	GLsizei instanceCount;
+	std::vector<ModelInstance> instances;
+};
+
+#endif
@@ -0,0 +1,289 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// the jobs of a group that have not finished yet
+struct JobCounter {
+	std::atomic<int> pending;
+
+	JobCounter() : pending(0) {}
+};
+
+// one job or scope for the trace, microseconds since the job system started
+struct JobTraceEvent {
+	const char *name;
+	double start, duration;
+};
+
+// Jobs on a pool of worker threads with a deque each. A worker takes the newest job of its own
+// deque (what it spawned last, its data still in the cache) and, when that is empty, steals the
+// oldest job of another worker. Threads outside the pool (the GL thread) hand their jobs to the
+// workers in turn. wait() runs queued jobs until the counter drops to zero, so a job can wait for
+// the jobs it spawned without taking a worker away. With 0 threads run() does the job at once.
+//
+// With tracing on, every job and every JobTraceScope is recorded with its thread; writeTrace()
+// stores them as a Chrome trace (chrome://tracing or ui.perfetto.dev).
+class JobSystem
+{
+public:
+	static const size_t MAX_TRACE_EVENTS = 1 << 20;	// per thread, later events are dropped
+
+	explicit JobSystem(unsigned int threads)
+		: start(std::chrono::steady_clock::now()), stopping(false), queued(0), nextWorker(0), tracing(false),
+		jobCount(0), stealCount(0)
+	{
+		for (unsigned int i = 0; i < threads; i++)
+			workers.push_back(std::unique_ptr<Worker>(new Worker()));
+		for (unsigned int i = 0; i < threads; i++)
+			workers[i]->thread = std::thread([this, i]() { work((int)i); });
+	}
+
+	~JobSystem()
+	{
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i]->thread.join();
+	}
+
+	unsigned int threads() const { return (unsigned int)workers.size(); }
+
+	// name is kept for the trace, a string literal
+	void run(const char *name, std::function<void()> work, JobCounter &counter)
+	{
+		counter.pending++;
+		Job job = { name, work, &counter };
+		if (workers.empty())
+		{
+			execute(job);
+			return;
+		}
+		int self = index();
+		Worker &worker = *workers[self >= 0 ? self : nextWorker++ % workers.size()];
+		{
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			worker.jobs.push_back(job);
+		}
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			queued++;
+		}
+		wake.notify_one();
+	}
+
+	// runs jobs (of any group) until counter has none left
+	void wait(JobCounter &counter)
+	{
+		while (counter.pending > 0)
+		{
+			Job job;
+			if (take(job))
+			{
+				execute(job);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait(lock, [this, &counter]() { return counter.pending == 0 || queued > 0; });
+		}
+	}
+
+	bool done(const JobCounter &counter) const { return counter.pending == 0; }
+
+	// call while no job runs
+	void setTracing(bool on) { tracing = on; }
+	bool isTracing() const { return tracing; }
+
+	// a scope of the calling thread for the trace, see JobTraceScope
+	void traced(const char *name, std::chrono::steady_clock::time_point begin)
+	{
+		if (!tracing)
+			return;
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		JobTraceEvent event = { name, micros(begin), std::chrono::duration<double, std::micro>(end - begin).count() };
+		int self = index();
+		if (self >= 0)
+		{
+			if (workers[self]->events.size() < MAX_TRACE_EVENTS)
+				workers[self]->events.push_back(event);
+			return;
+		}
+		std::lock_guard<std::mutex> lock(outsideMutex);
+		if (outsideEvents.size() < MAX_TRACE_EVENTS)
+			outsideEvents.push_back(event);
+	}
+
+	// call while no job runs; the outside thread is named outsideName
+	bool writeTrace(const std::string &path, const char *outsideName) const
+	{
+		std::ofstream out(path.c_str());
+		if (!out)
+			return false;
+		out << "{ \"traceEvents\": [\n";
+		out << "  " << threadName(0, outsideName);
+		for (size_t i = 0; i < workers.size(); i++)
+			out << ",\n  " << threadName((int)i + 1, ("worker " + std::to_string(i)).c_str());
+		writeEvents(out, 0, outsideEvents);
+		for (size_t i = 0; i < workers.size(); i++)
+			writeEvents(out, (int)i + 1, workers[i]->events);
+		out << "\n], \"displayTimeUnit\": \"ms\" }\n";
+		return (bool)out;
+	}
+
+	size_t jobs() const { return jobCount; }
+	size_t steals() const { return stealCount; }
+
+	void resetStats()
+	{
+		jobCount = 0;
+		stealCount = 0;
+	}
+
+private:
+	struct Job {
+		const char *name;
+		std::function<void()> work;
+		JobCounter *counter;
+	};
+
+	struct Worker {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+		std::thread thread;
+		std::vector<JobTraceEvent> events;	// written by this worker only
+	};
+
+	std::chrono::steady_clock::time_point start;
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::mutex sleepMutex;
+	std::condition_variable wake;	// new jobs, finished groups, stop
+	bool stopping;
+	int queued;		// jobs in the deques, under sleepMutex
+	std::atomic<size_t> nextWorker;
+	bool tracing;
+	std::mutex outsideMutex;
+	std::vector<JobTraceEvent> outsideEvents;
+	std::atomic<size_t> jobCount, stealCount;
+
+	// worker number of the calling thread, -1 outside the pool
+	int &index()
+	{
+		static thread_local int worker = -1;
+		return worker;
+	}
+
+	void work(int worker)
+	{
+		index() = worker;
+		for (;;)
+		{
+			Job job;
+			if (take(job))
+			{
+				execute(job);
+				continue;
+			}
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait(lock, [this]() { return stopping || queued > 0; });
+			if (stopping)
+				return;
+		}
+	}
+
+	// own deque from the back, the others from the front
+	bool take(Job &job)
+	{
+		int self = index();
+		size_t count = workers.size();
+		for (size_t i = 0; i < count; i++)
+		{
+			int victim = self >= 0 ? (int)((self + i) % count) : (int)i;
+			Worker &worker = *workers[victim];
+			std::lock_guard<std::mutex> lock(worker.mutex);
+			if (worker.jobs.empty())
+				continue;
+			if (victim == self)
+			{
+				job = worker.jobs.back();
+				worker.jobs.pop_back();
+			}
+			else
+			{
+				job = worker.jobs.front();
+				worker.jobs.pop_front();
+				if (self >= 0)
+					stealCount++;
+			}
+			std::lock_guard<std::mutex> sleepLock(sleepMutex);
+			queued--;
+			return true;
+		}
+		return false;
+	}
+
+	void execute(Job &job)
+	{
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		job.work();
+		traced(job.name, begin);
+		jobCount++;
+		if (--job.counter->pending == 0)
+		{
+			{
+				// waiters check the counter under the lock
+				std::lock_guard<std::mutex> lock(sleepMutex);
+			}
+			wake.notify_all();
+		}
+	}
+
+	double micros(std::chrono::steady_clock::time_point t) const
+	{
+		return std::chrono::duration<double, std::micro>(t - start).count();
+	}
+
+	static std::string threadName(int tid, const char *name)
+	{
+		std::ostringstream out;
+		out << "{ \"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": " << tid << ", \"args\": { \"name\": \"" << name << "\" } }";
+		return out.str();
+	}
+
+	static void writeEvents(std::ofstream &out, int tid, const std::vector<JobTraceEvent> &events)
+	{
+		for (size_t i = 0; i < events.size(); i++)
+			out << ",\n  { \"name\": \"" << events[i].name << "\", \"ph\": \"X\", \"pid\": 1, \"tid\": " << tid
+				<< ", \"ts\": " << events[i].start << ", \"dur\": " << events[i].duration << " }";
+	}
+};
+
+// records the enclosing block of the calling thread in the trace
+class JobTraceScope
+{
+public:
+	JobTraceScope(JobSystem &jobs, const char *name) : jobs(jobs), name(name), begin(std::chrono::steady_clock::now()) {}
+	~JobTraceScope() { jobs.traced(name, begin); }
+
+private:
+	JobSystem &jobs;
+	const char *name;
+	std::chrono::steady_clock::time_point begin;
+};
+
+#endif
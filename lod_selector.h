@@ -0,0 +1,128 @@
+#ifndef LOD_SELECTOR_H
+#define LOD_SELECTOR_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include "cached_model.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// instances drawn at one LOD, a range of the instance buffer
+struct LodGroup {
+	GLsizei first;
+	GLsizei count;
+};
+
+// Picks a LOD per instance of a model from the projected size of its bounding sphere:
+// the coarsest level whose error (CachedModel::lodErrors, relative to the radius) stays
+// below pixelError pixels. A level is only left once the error is hysteresis past the
+// limit, so instances near a threshold do not switch back and forth every frame.
+// The selected instances are grouped by level for one instanced draw per level.
+class LodSelector
+{
+public:
+	float pixelError;
+	float hysteresis;
+
+	LodSelector() : pixelError(1.0f), hysteresis(0.25f) {}
+
+	// clip is the view-projection of the pass (perspective or ortho), visible the indices
+	// into transforms that are drawn; the level of every instance is kept between calls
+	void select(const CachedModel &model, const glm::mat4 &clip, float viewportHeight,
+		const std::vector<glm::mat4> &transforms, const std::vector<uint32_t> &visible)
+	{
+		select(model, std::vector<glm::mat4>(1, clip), viewportHeight, transforms, visible);
+	}
+
+	// several views drawn in one pass share the level: the one the largest projection needs
+	void select(const CachedModel &model, const std::vector<glm::mat4> &clips, float viewportHeight,
+		const std::vector<glm::mat4> &transforms, const std::vector<uint32_t> &visible)
+	{
+		int levelCount = std::max(1, model.lodCount());
+		levels.resize(transforms.size(), 0);
+		std::vector<glm::vec4> rowW(clips.size());
+		std::vector<float> pixelsPerUnit(clips.size());
+		for (size_t v = 0; v < clips.size(); v++)
+		{
+			const glm::mat4 &clip = clips[v];
+			rowW[v] = glm::vec4(clip[0][3], clip[1][3], clip[2][3], clip[3][3]);
+			// pixels per world unit at w = 1, the view part of clip is a rotation
+			pixelsPerUnit[v] = glm::length(glm::vec3(clip[0][1], clip[1][1], clip[2][1])) * viewportHeight * 0.5f;
+		}
+		glm::vec3 center = 0.5f * (model.boundsMin + model.boundsMax);
+		float radius = 0.5f * glm::length(model.boundsMax - model.boundsMin);
+
+		std::vector<std::vector<uint32_t> > byLevel(levelCount);
+		for (size_t i = 0; i < visible.size(); i++)
+		{
+			const glm::mat4 &m = transforms[visible[i]];
+			float scale = std::max(glm::length(glm::vec3(m[0])), std::max(glm::length(glm::vec3(m[1])), glm::length(glm::vec3(m[2]))));
+			glm::vec4 c = m * glm::vec4(center, 1.0f);
+			float pixels = 0.0f;
+			for (size_t v = 0; v < clips.size(); v++)
+				pixels = std::max(pixels, radius * scale * pixelsPerUnit[v] / std::max(glm::dot(rowW[v], c), 1e-3f));
+
+			int level = std::min((int)levels[visible[i]], levelCount - 1);
+			while (level > 0 && model.lodErrors[level] * pixels > pixelError * (1.0f + hysteresis))
+				level--;
+			while (level + 1 < levelCount && model.lodErrors[level + 1] * pixels * (1.0f + hysteresis) <= pixelError)
+				level++;
+			levels[visible[i]] = (unsigned char)level;
+			byLevel[level].push_back(visible[i]);
+		}
+
+		ordered.clear();
+		groups.assign(levelCount, LodGroup());
+		for (int level = 0; level < levelCount; level++)
+		{
+			groups[level].first = (GLsizei)ordered.size();
+			groups[level].count = (GLsizei)byLevel[level].size();
+			for (size_t i = 0; i < byLevel[level].size(); i++)
+				ordered.push_back(transforms[byLevel[level][i]]);
+		}
+	}
+
+	// the selected instances, level 0 first
+	const std::vector<glm::mat4> &transforms() const { return ordered; }
+	int levelCount() const { return (int)groups.size(); }
+	const LodGroup &group(int level) const { return groups[level]; }
+
+	// triangles the draws of the selection submit
+	size_t triangles(const CachedModel &model, const std::vector<unsigned char> &visibleMeshes) const
+	{
+		size_t total = 0;
+		for (int level = 0; level < levelCount(); level++)
+		{
+			for (size_t i = 0; i < model.meshes.size(); i++)
+			{
+				if (!visibleMeshes[i])
+					continue;
+				const std::vector<CachedLod> &lods = model.meshes[i].lods;
+				total += (size_t)groups[level].count * lods[std::min(level, (int)lods.size() - 1)].indexCount / 3;
+			}
+		}
+		return total;
+	}
+
+	// "name": { "instances": [per level], "triangles": n } member of the "lod" report
+	std::string report(const std::string &name, const CachedModel &model, const std::vector<unsigned char> &visibleMeshes) const
+	{
+		std::ostringstream out;
+		out << "\"" << name << "\": { \"instances\": [";
+		for (int level = 0; level < levelCount(); level++)
+			out << (level ? ", " : "") << groups[level].count;
+		out << "], \"triangles\": " << triangles(model, visibleMeshes) << " }";
+		return out.str();
+	}
+
+private:
+	std::vector<unsigned char> levels;	// per instance, kept for the hysteresis
+	std::vector<glm::mat4> ordered;
+	std::vector<LodGroup> groups;
+};
+
+#endif
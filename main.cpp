@@ -9,6 +9,40 @@
 #include <camera.h>
 #include <model.h>
 #include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include "asset_loader.h"
+#include "bloom.h"
+#include "cached_model.h"
+#include "cached_shader.h"
+#include "culling.h"
+#include "frame_capture.h"
+#include "frame_data.h"
+#include "gpu_resources.h"
+#include "hdr_format.h"
+#include "headless.h"
+#include "input_recording.h"
+#include "instance_buffer.h"
+#include "job_system.h"
+#include "lod_selector.h"
+#include "overdraw.h"
+#include "draw_list.h"
+#include "dynamic_resolution.h"
+#include "ocean.h"
+#include "pass_timer.h"
+#include "prepared_frame.h"
+#include "regression_check.h"
+#include "scene_graph.h"
+#include "shadow_cache.h"
+#include "shadow_filter.h"
+// the loader threads decode at the same time, stb would keep its failure reason in a global
+#define STBI_NO_FAILURE_STRINGS
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
@@ -19,25 +53,61 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow *window);
-unsigned int loadCubemap(vector<std::string> faces);
-
-void renderSkyBox(Shader &skyBoxShader);
-void renderShip(Shader &shipShader, Model &shipModel, bool isRenderLight);
-void renderWater(Shader &waterShader, Model &waterModel, bool isRenderLight);
-void renderText(Shader &textShader, Model &textModel);
-void renderSun(Shader &sunShader, Model &sunModel);
-void renderLight(Shader &objectShader, Model &objectModel);
-void renderlightSpaceMatrix(Shader &objectShader);
-void renderScreen();
+void moveCamera(unsigned int keys, float deltaTime);
+void replayInput(double time);
+
+void renderSkyBox(CachedShader &skyBoxShader, int firstView, int views);
+void renderShip(DrawList &drawList, unsigned int pass, CachedShader &shipShader, CachedModel &shipModel, InstanceBuffer &fleetInstances, GLsizei firstInstance, const LodSelector &lods, const std::vector<unsigned char> &visibleMeshes, bool isRenderLight);
+void renderWater(DrawList &drawList, unsigned int pass, CachedShader &waterShader, CachedModel &waterModel, const std::vector<unsigned char> &visibleMeshes, bool isRenderLight, const FrameData &frame);
+void renderText(DrawList &drawList, CachedShader &textShader, CachedModel &textModel, InstanceBuffer &fleetInstances, GLsizei firstInstance, GLsizei count);
+void renderSun(DrawList &drawList, CachedShader &sunShader, CachedModel &sunModel, const FrameData &frame);
+void renderLight(FrameData &frame);
+glm::mat4 lightSpaceMatrix();
+std::vector<int> buildFleet(int count);
+glm::mat4 waterModelMatrix();
+Camera &viewCamera(int view);
+int tileWidth();
+int tileHeight();
+FrameData viewFrameData();
+void renderBloom(BloomChain &bloomChain, CachedShader &downShader, CachedShader &upShader, const SceneTargets &scene, int sceneWidth, int sceneHeight);
+int targetSize(int screenSize);
+int bloomSize(int sceneSize, int level);
+void renderShadowMoments(VarianceShadowMap &varianceShadowMap, CachedShader &momentsShader, CachedShader &blurShader, unsigned int depthMap, int shadowWidth, int shadowHeight);
+int shadowSize();
+void allocateDepthMap(unsigned int depthMap);
+bool fitMemoryBudget(unsigned int depthMap, ShadowCache &shadowCache, VarianceShadowMap &varianceShadowMap, DynamicResolution &resolution);
+void renderScreen(int instances = 1);
+void renderBloomLevel(CachedShader &shader, const BloomChain &bloomChain, int level);
+void renderOverdraw(CachedShader &overdrawShader, const SceneTargets &scene, int sceneWidth, int sceneHeight, unsigned int screenFBO);
 
 bool DebugMode = false;
+// O: shows how many fragments the colour pass drew per pixel (stencil count, blue 1 ... red 8+)
+bool overdrawView = false;
+bool overdrawKeyPressed = false;
+// --depth-prepass: the opaque ships are drawn depth only first, the colour pass then shades only what is visible
+bool depthPrepass = false;
 bool bloom = true;
 bool bloomKeyPressed = false;
 float exposure = 0.5f;
+// bloom: number of downsampled levels and the brightness the bright pass keeps
+int bloomLevels = 6;
+float bloomThreshold = 1.0f;
+// storage of the scene target and the bloom levels (--hdr-format), the packed formats halve their traffic
+HdrFormat hdrFormat = HDR_R11G11B10F;
 
 // settings
 const unsigned int SCR_WIDTH = 1500;
 const unsigned int SCR_HEIGHT = 1000;
+// window size, changed by framebuffer_size_callback; the scene targets follow it at the next frame
+int screenWidth = SCR_WIDTH;
+int screenHeight = SCR_HEIGHT;
+bool screenResized = false;
+// render resolution: the scene is drawn at a scale of the window size and upscaled by hdr.fs.
+// With a target GPU frame time (--target-ms, default 60 fps in the window, off in the bench) the
+// scale moves between --min-scale and --max-scale to hold it, --render-scale sets the start / fixed scale
+DynamicResolutionSettings resolutionSettings;
+float targetFrameMs = -1.0f;
+const float DEFAULT_TARGET_MS = 1000.0f / 60.0f;
 
 // camera
 glm::vec3 cameraOriginPlace = glm::vec3(0.0f, 0.0f, 3.0f);
@@ -48,45 +118,250 @@ bool firstMouse = true;
 
 // depthMap
 int depthResolution = 4;
+// the depth map is kept while nothing changes, moving casters refresh it every
+// shadowInterval frames or one of shadowRegions x shadowRegions tiles per frame
+ShadowUpdateMode shadowUpdateMode = SHADOW_UPDATE_ON_CHANGE;
+int shadowInterval = 4;
+int shadowRegions = 2;
+// shadow filtering in object.fs, T cycles through the tiers
+ShadowTier shadowTier = SHADOW_PCF;
+bool shadowTierKeyPressed = false;
+
+// GPU memory: above --memory-budget MB a warning, with --memory-scale the shadow map and then the
+// largest render scale step down instead until the allocations fit; --memory-dump N prints every
+// allocation each N frames, M once
+size_t memoryBudget = 0;
+bool memoryScale = false;
+bool memoryOverBudget = false; // warned already
+int memoryDumpInterval = 0;
+int memoryDumpFrame = -1; // frameCount stays while the bench waits for the loading
+bool memoryDumpRequested = false;
+bool memoryKeyPressed = false;
 
 // timing
 double deltaTime = 0.0f;
 double lastFrame = 0.0f;
 
-//point light
-glm::vec3 sunPos(0.829116, 2.7817, -4.29651);
-
-// ship pos
-glm::vec3 shipPos(0.0f, 0.0f, 0.0f);
-
-int main()
+// scene: the nodes, models, lights and the ship label come from --scene FILE; the world
+// matrices are rebuilt only for the nodes that moved
+const char *sceneFile = "scene/harbour.scene";
+SceneGraph scene;
+int sunNode = -1;
+int waterNode = -1;
+int shipNode = -1; // the scene's first ship, its label is drawn above every ship of the fleet
+// --fleet N: N ships in a grid around the ship of the scene, all drawn instanced;
+// --moving-ships N: the first N of them rock on the water
+int fleetSize = 1;
+int movingShips = 0;
+double sceneTime = 0.0;
+// --views N: the camera and the first N - 1 cameras of the scene, side by side in a grid of
+// viewColumns x viewRows tiles. Each view is a layer of the scene targets; the shadow map,
+// culling, LOD and FrameData are shared and one instanced draw covers all layers. Without
+// layer selection in the vertex shader (layeredViews) every view is drawn on its own.
+int viewCount = 1;
+int viewColumns = 1;
+int viewRows = 1;
+bool layeredViews = false;
+std::vector<Camera> sceneCameras;
+
+// culling: the fleet and the water are tested against the camera frustum (color pass) and the
+// light frustum (depth pass), lists longer than CULL_BLOCK_SIZE are split over cullThreads threads
+unsigned int cullThreads = std::max(1u, std::thread::hardware_concurrency());
+PassCullStats depthCulling, colorCulling;
+// frame preparation: the scene, culling, LOD and the draw packets of frame N + 1 are jobs on
+// jobThreads workers while the GL thread submits frame N (0: prepared on the GL thread before
+// it is submitted); --trace FILE writes the jobs and the GL thread as a Chrome trace
+unsigned int jobThreads = std::max(1u, std::thread::hardware_concurrency()) - 1;
+const char *traceOutput = NULL;
+// LOD: every ship draws the coarsest level whose error stays under lodPixelError pixels,
+// measured on screen for the color pass and in shadow map texels for the depth pass
+float lodPixelError = 1.0f;
+// loading: textures are decoded and mesh caches read on loadThreads threads, at most
+// streamBudget bytes of pixels go to the GPU per frame; the scene draws placeholders meanwhile
+unsigned int loadThreads = std::max(2u, std::thread::hardware_concurrency() / 2);
+size_t streamBudget = ASSET_STREAM_BUDGET;
+// ocean: an oceanSize x oceanSize FFT surface simulated on oceanThreads threads moves the water
+// (0 keeps the flat mesh); --bench-fft measures the FFT alone for every grid size and exits
+int oceanSize = 128;
+unsigned int oceanThreads = std::max(1u, std::thread::hardware_concurrency());
+bool benchFFT = false;
+double oceanTime = 0.0;
+const float WATER_GRID_SPACING = 1.42f; // water.obj is 50 x 50 quads over 71 units
+// capture: --capture DIR records the frames named by --capture-sources (screen, scene, depth) into DIR,
+// read back through pixel buffers and encoded on --capture-threads threads; C pauses and resumes it
+CaptureSettings captureSettings;
+bool capturing = true;
+bool captureKeyPressed = false;
+// --bake-textures: build the mesh caches and the block compressed textures, then exit; needs no GPU
+bool bakeOnly = false;
+
+// benchmark: --bench N renders N frames offscreen and writes per-pass timings as JSON
+int benchFrames = 0;
+const int BENCH_WARMUP = 5;
+const char *benchOutput = NULL;
+bool assertNoChurn = false; // --assert-no-churn: fail the bench if the steady state creates or re-uploads GL objects
+const double BENCH_STEP = 1.0 / 60.0;
+// record / replay: --record FILE writes the camera input and the bloom / exposure changes of a
+// window session, --replay FILE renders them again offscreen at BENCH_STEP from the first measured
+// frame (implies the bench, for as many frames as the recording lasts unless --bench says).
+// --golden DIR compares frames with reference images there (--golden-update writes them),
+// --timings FILE writes the time of every measured frame, --perf-baseline FILE fails the run
+// when the median frame time is more than --perf-tolerance percent above that file's
+InputRecording inputRecording;
+const char *recordFile = NULL;
+const char *replayFile = NULL;
+double recordStart = -1.0;
+double recordTime = 0.0; // seconds since the recording started, the events of a frame share it
+unsigned int replayKeys = 0; // movement keys held in the replay
+GoldenSettings goldenSettings;
+const char *timingsOutput = NULL;
+const char *perfBaseline = NULL;
+float perfTolerance = 10.0f;
+enum RenderPass { PASS_PREPARE, PASS_DEPTH, PASS_PREPASS, PASS_COLOR, PASS_BLOOM, PASS_HDR };
+
+int main(int argc, char *argv[])
 {
-
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-	GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
-	if (window == NULL)
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	for (int i = 1; i < argc; i++)
 	{
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
-		return -1;
+		if (strcmp(argv[i], "--bench") == 0 && i + 1 < argc)
+			benchFrames = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--bench-out") == 0 && i + 1 < argc)
+			benchOutput = argv[++i];
+		else if (strcmp(argv[i], "--assert-no-churn") == 0)
+			assertNoChurn = true;
+		else if (strcmp(argv[i], "--fleet") == 0 && i + 1 < argc)
+			fleetSize = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--moving-ships") == 0 && i + 1 < argc)
+			movingShips = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+			sceneFile = argv[++i];
+		else if (strcmp(argv[i], "--views") == 0 && i + 1 < argc)
+			viewCount = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--cull-threads") == 0 && i + 1 < argc)
+			cullThreads = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--job-threads") == 0 && i + 1 < argc)
+			jobThreads = (unsigned int)std::max(0, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+			traceOutput = argv[++i];
+		else if (strcmp(argv[i], "--lod-error") == 0 && i + 1 < argc)
+			lodPixelError = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--load-threads") == 0 && i + 1 < argc)
+			loadThreads = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--stream-budget") == 0 && i + 1 < argc)
+			streamBudget = (size_t)std::max(1, atoi(argv[++i])) << 20;
+		else if (strcmp(argv[i], "--bake-textures") == 0)
+			bakeOnly = true;
+		else if (strcmp(argv[i], "--ocean") == 0 && i + 1 < argc)
+			oceanSize = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--ocean-threads") == 0 && i + 1 < argc)
+			oceanThreads = std::max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--bench-fft") == 0)
+			benchFFT = true;
+		else if (strcmp(argv[i], "--render-scale") == 0 && i + 1 < argc)
+			resolutionSettings.scale = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--target-ms") == 0 && i + 1 < argc)
+			targetFrameMs = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--min-scale") == 0 && i + 1 < argc)
+			resolutionSettings.minScale = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--max-scale") == 0 && i + 1 < argc)
+			resolutionSettings.maxScale = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--hdr-format") == 0 && i + 1 < argc) {
+			if (!parseHdrFormat(argv[++i], hdrFormat))
+				std::cout << "Unknown HDR format: " << argv[i] << std::endl;
+		}
+		else if (strcmp(argv[i], "--depth-prepass") == 0)
+			depthPrepass = true;
+		else if (strcmp(argv[i], "--overdraw") == 0)
+			overdrawView = true;
+		else if (strcmp(argv[i], "--capture") == 0 && i + 1 < argc)
+			captureSettings.directory = argv[++i];
+		else if (strcmp(argv[i], "--capture-sources") == 0 && i + 1 < argc) {
+			if (!parseCaptureSources(argv[++i], captureSettings.sources))
+				std::cout << "Unknown capture sources: " << argv[i] << std::endl;
+		}
+		else if (strcmp(argv[i], "--capture-every") == 0 && i + 1 < argc)
+			captureSettings.every = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--capture-threads") == 0 && i + 1 < argc)
+			captureSettings.threads = (unsigned int)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--capture-queue") == 0 && i + 1 < argc)
+			captureSettings.queueLimit = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--bloom-levels") == 0 && i + 1 < argc)
+			bloomLevels = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--shadow-interval") == 0 && i + 1 < argc) {
+			shadowUpdateMode = SHADOW_UPDATE_INTERVAL;
+			shadowInterval = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--shadow-tier") == 0 && i + 1 < argc) {
+			if (!parseShadowTier(argv[++i], shadowTier))
+				std::cout << "Unknown shadow tier: " << argv[i] << std::endl;
+		}
+		else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc)
+			memoryBudget = (size_t)std::max(0, atoi(argv[++i])) << 20;
+		else if (strcmp(argv[i], "--memory-scale") == 0)
+			memoryScale = true;
+		else if (strcmp(argv[i], "--memory-dump") == 0 && i + 1 < argc)
+			memoryDumpInterval = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--shadow-regions") == 0 && i + 1 < argc) {
+			shadowUpdateMode = SHADOW_UPDATE_REGIONS;
+			shadowRegions = atoi(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+			recordFile = argv[++i];
+		else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+			replayFile = argv[++i];
+		else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc)
+			goldenSettings.directory = argv[++i];
+		else if (strcmp(argv[i], "--golden-update") == 0)
+			goldenSettings.update = true;
+		else if (strcmp(argv[i], "--golden-frames") == 0 && i + 1 < argc) {
+			if (!parseGoldenFrames(argv[++i], goldenSettings.frames))
+				std::cout << "Unknown golden frames: " << argv[i] << std::endl;
+		}
+		else if (strcmp(argv[i], "--golden-tolerance") == 0 && i + 1 < argc)
+			goldenSettings.tolerance = atoi(argv[++i]);
+		else if (strcmp(argv[i], "--golden-pixels") == 0 && i + 1 < argc)
+			goldenSettings.maxDifferent = (float)atof(argv[++i]) / 100.0f;
+		else if (strcmp(argv[i], "--timings") == 0 && i + 1 < argc)
+			timingsOutput = argv[++i];
+		else if (strcmp(argv[i], "--perf-baseline") == 0 && i + 1 < argc)
+			perfBaseline = argv[++i];
+		else if (strcmp(argv[i], "--perf-tolerance") == 0 && i + 1 < argc)
+			perfTolerance = (float)atof(argv[++i]);
+	}
+	if (replayFile) {
+		if (!inputRecording.load(replayFile))
+			return -1;
+		if (benchFrames == 0)
+			benchFrames = inputRecording.frames(BENCH_STEP);
+	}
+	bool benchMode = benchFrames > 0;
+	// the bench keeps the scale fixed unless asked, so its runs stay comparable
+	resolutionSettings.targetMs = targetFrameMs >= 0.0f ? targetFrameMs : (benchMode ? 0.0f : DEFAULT_TARGET_MS);
+	resolutionSettings.maxScale = std::min(2.0f, std::max(0.1f, resolutionSettings.maxScale));
+	resolutionSettings.minScale = std::min(resolutionSettings.maxScale, std::max(0.1f, resolutionSettings.minScale));
+	if (oceanSize > 0) {
+		// a power of two in [64, 512]
+		int size = 64;
+		while (size < oceanSize && size < 512)
+			size *= 2;
+		oceanSize = size;
 	}
-	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
-	glfwSetScrollCallback(window, scroll_callback);
-
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+	if (benchFFT)
 	{
-		std::cout << "Failed to initialize GLAD" << std::endl;
-		return -1;
+		bool normalsPassed = false;
+		std::string report = OceanSimulation::benchmark(oceanThreads, 50, normalsPassed);
+		if (benchOutput) {
+			std::ofstream out(benchOutput);
+			out << report;
+		}
+		else
+			std::cout << report;
+		if (!normalsPassed)
+			std::cout << "OCEAN: the normal map does not match the slopes of the height map" << std::endl;
+		return normalsPassed ? 0 : 5;
 	}
-	// -----------------------------------------------------------------------------------
 
 	vector <std::string> faces{
 		"skybox/right.jpg",
@@ -97,68 +372,108 @@ int main()
 		"skybox/back.jpg"
 	};
 
-	unsigned int cubemapTexture = loadCubemap(faces);
-	// frameBuffer for color
-	unsigned int hdrFBO;
-	glGenFramebuffers(1, &hdrFBO);
-	glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-	// create 2 floating point color buffers (1 for normal rendering, other for brightness treshold values)
-	unsigned int colorBuffers[2];
-	glGenTextures(2, colorBuffers);
-	for (unsigned int i = 0; i < 2; i++)
+	if (bakeOnly)
 	{
-		glBindTexture(GL_TEXTURE_2D, colorBuffers[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);  // we clamp to the edge as the blur filter would otherwise sample repeated texture values!
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, colorBuffers[i], 0);
-	}
-	unsigned int rboDepth;
-	glGenRenderbuffers(1, &rboDepth);
-	glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, SCR_WIDTH, SCR_HEIGHT);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
-	// tell OpenGL which color attachments we'll use (of this framebuffer) for rendering 
-	unsigned int attachments[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
-	glDrawBuffers(2, attachments);
-	// finally check if framebuffer is complete
-	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-		std::cout << "Framebuffer not complete!" << std::endl;
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+		bool baked = true;
+		for (size_t i = 0; i < faces.size(); i++)
+			baked = TextureCache::bake(faces[i], TEXTURE_COLOR, threads) && baked;
+		const char *models[] = { "sun/sun.obj", "boat/boat_new.obj", "water/water.obj", "text/text.obj" };
+		for (size_t i = 0; i < sizeof(models) / sizeof(models[0]); i++)
+			baked = CachedModel::bakeTextures(models[i], threads) && baked;
+		std::cout << (baked ? "textures baked" : "some textures failed to bake") << std::endl;
+		return baked ? 0 : 1;
+	}
 
-	// framebuffer for blurring
-	unsigned int pingpongFBO[2];
-	unsigned int pingpongColorbuffers[2];
-	glGenFramebuffers(2, pingpongFBO);
-	glGenTextures(2, pingpongColorbuffers);
-	for (unsigned int i = 0; i < 2; i++)
+	if (!scene.load(sceneFile))
+		return -1;
+	std::vector<int> sunNodes = scene.modelNodes("sun"), waterNodes = scene.modelNodes("water"), sceneShips = scene.modelNodes("ship");
+	if (sunNodes.empty() || waterNodes.empty() || sceneShips.empty()) {
+		std::cout << "SCENE: " << sceneFile << " needs a sun, a water and a ship model" << std::endl;
+		return -1;
+	}
+	sunNode = sunNodes[0];
+	waterNode = waterNodes[0];
+	shipNode = sceneShips[0];
+	std::vector<int> shipNodes = buildFleet(fleetSize);
+	scene.update();
+	for (size_t i = 0; i < scene.cameras.size(); i++) {
+		const SceneCamera &view = scene.cameras[i];
+		sceneCameras.push_back(Camera(scene.worldPosition(view.node), glm::vec3(0.0f, 1.0f, 0.0f), view.yaw, view.pitch));
+		sceneCameras.back().Zoom = view.zoom;
+	}
+	viewCount = std::max(1, std::min(std::min(viewCount, FRAME_MAX_VIEWS), 1 + (int)sceneCameras.size()));
+	viewColumns = (int)ceil(sqrt((double)viewCount));
+	viewRows = (viewCount + viewColumns - 1) / viewColumns;
+
+	GLFWwindow* window = NULL;
+	if (benchMode)
 	{
-		glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[i]);
-		glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[i]);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGB, GL_FLOAT, NULL);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // we clamp to the edge as the blur filter would otherwise sample repeated texture values!
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pingpongColorbuffers[i], 0);
-		// also check if framebuffers are complete (no need for depth buffer)
-		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
-			std::cout << "Framebuffer not complete!" << std::endl;
+		if (!createHeadlessContext())
+		{
+			std::cout << "Failed to create offscreen context" << std::endl;
+			return -1;
+		}
+		if (!gladLoadGLLoader((GLADloadproc)headlessGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return -1;
+		}
 	}
+	else
+	{
+		glfwInit();
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
-	// frameBuffer for depth
-	const unsigned int SHADOW_WIDTH = 1024 * depthResolution;
-	const unsigned int SHADOW_HEIGHT = 1024 * depthResolution;
+		window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL", NULL, NULL);
+		if (window == NULL)
+		{
+			std::cout << "Failed to create GLFW window" << std::endl;
+			glfwTerminate();
+			return -1;
+		}
+		glfwMakeContextCurrent(window);
+		glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+		glfwSetCursorPosCallback(window, mouse_callback);
+		glfwSetScrollCallback(window, scroll_callback);
 
-	unsigned int depthFBO;
-	glGenFramebuffers(1, &depthFBO);
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-	unsigned int depthMap;
-	glGenTextures(1, &depthMap);
-	glBindTexture(GL_TEXTURE_2D, depthMap);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+		{
+			std::cout << "Failed to initialize GLAD" << std::endl;
+			return -1;
+		}
+	}
+	// -----------------------------------------------------------------------------------
+#ifdef GL_ARB_shader_viewport_layer_array
+	layeredViews = viewCount > 1 && GLAD_GL_ARB_shader_viewport_layer_array;
+#endif
+#ifdef GL_AMD_vertex_shader_layer
+	layeredViews = layeredViews || (viewCount > 1 && GLAD_GL_AMD_vertex_shader_layer);
+#endif
+
+	AssetLoader assetLoader(loadThreads, startTime);
+	assetLoader.budget = streamBudget;
+
+	unsigned int cubemapTexture = assetLoader.cubemap(faces, glm::vec4(0.55f, 0.6f, 0.65f, 1.0f));
+	// frameBuffer for color, big enough for the largest render scale, a layer per view
+	SceneTargets sceneTargets;
+	sceneTargets.create(targetSize(tileWidth()), targetSize(tileHeight()), hdrFormat, viewCount);
+	DynamicResolution resolution(resolutionSettings);
+	int lastRenderWidth = sceneTargets.width, lastRenderHeight = sceneTargets.height;
+
+	// framebuffers for bloom
+	BloomChain bloomChain;
+	bloomChain.create(sceneTargets.width, sceneTargets.height, bloomLevels, hdrInternalFormat(sceneTargets.format), viewCount);
+
+	// frameBuffer for depth
+	unsigned int depthFBO = gpuResources().create(GPU_FRAMEBUFFER);
+
+	unsigned int depthMap = gpuResources().create(GPU_TEXTURE);
+	allocateDepthMap(depthMap);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
@@ -171,125 +486,608 @@ int main()
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	ShadowCache shadowCache(shadowSize(), shadowSize(), shadowUpdateMode, shadowInterval, shadowRegions);
+	// comparison sampler for the hardware tier, moments for the VSM tier (allocated when first used)
+	unsigned int shadowCompareSampler = createShadowCompareSampler();
+	VarianceShadowMap varianceShadowMap;
+
+	// frameBuffer standing in for the window when there is none (bench mode)
+	unsigned int screenFBO = 0;
+	unsigned int screenColorbuffer = 0;
+	if (benchMode)
+	{
+		screenFBO = gpuResources().create(GPU_FRAMEBUFFER);
+		glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+		screenColorbuffer = gpuResources().create(GPU_TEXTURE);
+		glBindTexture(GL_TEXTURE_2D, screenColorbuffer);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, SCR_WIDTH, SCR_HEIGHT, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		gpuResources().allocated(GPU_TEXTURE, screenColorbuffer, MEMORY_RENDER_TARGETS, "bench screen", GL_RGBA8,
+			MemoryTracker::textureBytes(GL_RGBA8, SCR_WIDTH, SCR_HEIGHT));
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, screenColorbuffer, 0);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "Framebuffer not complete!" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
 
 	// -----------------------------------------------------------------------------------
 
-	Shader skyboxShader("shader/skybox.vs", "shader/skybox.fs");
-	Shader objectShader("shader/object.vs", "shader/object.fs");
-	Shader sunShader("shader/sun.vs", "shader/sun.fs");
-	Shader depthMappingShader("shader/depth_map.vs", "shader/depth_map.fs");
-	Shader debugDepthQuad("shader/debug.vs", "shader/debug.fs");
-	Shader hdrShader("shader/hdr.vs", "shader/hdr.fs");
-	Shader blurShader("shader/blur.vs", "shader/blur.fs");
-	Shader textShader("shader/billboard.vs", "shader/billboard.fs");
-
-	Model sun("sun/sun.obj");
-	Model ourModel("boat/boat_new.obj");
-	Model water("water/water.obj");
-	Model shipName("text/text.obj");
+	CachedShader skyboxShader("shader/skybox.vs", "shader/skybox.fs");
+	CachedShader objectShader("shader/object.vs", "shader/object.fs");
+	CachedShader sunShader("shader/sun.vs", "shader/sun.fs");
+	CachedShader depthMappingShader("shader/depth_map.vs", "shader/depth_map.fs");
+	CachedShader debugDepthQuad("shader/debug.vs", "shader/debug.fs");
+	CachedShader hdrShader("shader/hdr.vs", "shader/hdr.fs");
+	CachedShader bloomDownShader("shader/bloom.vs", "shader/bloom_down.fs");
+	CachedShader bloomUpShader("shader/bloom.vs", "shader/bloom_up.fs");
+	CachedShader textShader("shader/billboard.vs", "shader/billboard.fs");
+	CachedShader shadowMomentsShader("shader/bloom.vs", "shader/shadow_moments.fs");
+	CachedShader shadowBlurShader("shader/bloom.vs", "shader/shadow_blur.fs");
+	CachedShader overdrawShader("shader/bloom.vs", "shader/overdraw.fs");
+
+	// view, projection, lightSpaceMatrix and the lights come from one uniform buffer per frame
+	FrameUniformBuffer frameUniforms;
+	frameUniforms.create();
+	skyboxShader.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+	objectShader.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+	sunShader.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+	depthMappingShader.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+	textShader.bindUniformBlock("FrameData", FRAME_DATA_BINDING);
+
+	CachedModel sun("sun/sun.obj", assetLoader);
+	CachedModel ourModel("boat/boat_new.obj", assetLoader);
+	CachedModel water("water/water.obj", assetLoader);
+	CachedModel shipName("text/text.obj", assetLoader);
+
+	// ship transforms for the instanced draws of the ships and their name billboards,
+	// the buffer holds the ships left by the depth pass culling followed by the color pass ones
+	std::vector<glm::mat4> fleet;
+	for (size_t i = 0; i < shipNodes.size(); i++)
+		fleet.push_back(scene.world(shipNodes[i]));
+	std::vector<glm::mat4> waterTransforms(1, waterModelMatrix());
+	std::vector<glm::vec3> shipRest;
+	for (size_t i = 0; i < shipNodes.size(); i++)
+		shipRest.push_back(scene.position(shipNodes[i]));
+	InstanceBuffer fleetInstances;
+	fleetInstances.create();
+	fleetInstances.update(fleet);
+	ModelCuller depthShipCuller, depthWaterCuller, colorShipCuller, colorWaterCuller;
+	LodSelector depthShipLods, colorShipLods;
+	depthShipLods.pixelError = colorShipLods.pixelError = lodPixelError;
+	// draws of both passes, sorted once per frame and submitted without redundant state changes
+	StateTracker drawState;
+	// the maps of frame N + 1 are simulated while frame N renders
+	std::unique_ptr<OceanSurface> ocean;
+	if (oceanSize > 0) {
+		OceanSettings oceanSettings;
+		oceanSettings.size = oceanSize;
+		ocean.reset(new OceanSurface(oceanSettings, oceanThreads));
+		ocean->create();
+	}
 
 	debugDepthQuad.use();
 	debugDepthQuad.setInt("depthMap", 0);
 
 	objectShader.use();
 	objectShader.setInt("shadowMap", 10);
+	objectShader.setInt("shadowMapCompare", 11);
+	objectShader.setInt("shadowMoments", 12);
+	objectShader.setInt("oceanDisplacement", 13);
+	objectShader.setInt("oceanNormals", 14);
+
+	shadowMomentsShader.use();
+	shadowMomentsShader.setInt("depthMap", 0);
+
+	shadowBlurShader.use();
+	shadowBlurShader.setInt("image", 0);
 
 	skyboxShader.use();
 	skyboxShader.setInt("skyboxTexture", 0);
 
-	blurShader.use();
-	blurShader.setInt("image", 0);
+	bloomDownShader.use();
+	bloomDownShader.setInt("image", 0);
+	bloomDownShader.setFloat("threshold", bloomThreshold);
+
+	bloomUpShader.use();
+	bloomUpShader.setInt("image", 0);
 
 	hdrShader.use();
 	hdrShader.setInt("scene", 0);
 	hdrShader.setInt("bloomBlur", 1);
 
 
-	glEnable(GL_BLEND);
+	// blending is enabled only around the translucent draws
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
 	//glEnable(GL_CULL_FACE);
 
-	while (!glfwWindowShouldClose(window))
+	std::vector<std::string> passNames{ "prepare", "depth", "prepass", "color", "bloom", "hdr" };
+	PassTimer passTimer(passNames, benchMode, BENCH_WARMUP);
+	OverdrawCounter overdrawCounter;
+	FrameCapture frameCapture(captureSettings);
+	GoldenImages goldenImages(goldenSettings);
+	FrameTimings frameTimings;
+	int frameCount = 0;
+	bool loadedShown = false;
+
+	// Frame N + 1 is prepared while frame N is submitted: the scene moves, then both passes are
+	// culled and their packets built by parallel jobs. The jobs read the models, the scene and the
+	// shadow cache, the GL thread only touches those after waiting for them; the views come in
+	// with out.data, taken on the GL thread. lodHeight: rendered height the color LOD is picked for.
+	JobSystem jobs(jobThreads);
+	jobs.setTracing(traceOutput != NULL);
+	PreparedFrame preparedFrames[2];
+	int preparedSlot = 0;
+	JobCounter preparing;
+	double prepareMs = 0.0, prepareWaitMs = 0.0;	// since the warmup
+	// the jobs are already spread over the cores, a cull inside one runs its blocks on its own thread
+	unsigned int jobCullThreads = jobs.threads() > 0 ? 1 : cullThreads;
+	// the depth pass: the casters culled against the light with LODs for the shadow map texels,
+	// then its packets, which draw the instances from base on
+	auto cullShadow = [&](PreparedFrame &out, unsigned int threads) {
+		Frustum lightFrustum(out.data.lightSpaceMatrix);
+		depthWaterCuller.cull(lightFrustum, water, waterTransforms, threads);
+		depthShipCuller.cull(lightFrustum, ourModel, fleet, threads);
+		depthCulling.reset();
+		depthCulling.add(depthWaterCuller);
+		depthCulling.add(depthShipCuller);
+		depthShipLods.select(ourModel, out.data.lightSpaceMatrix, (float)shadowSize(), fleet, depthShipCuller.visibleIndices());
+	};
+	auto buildShadow = [&](PreparedFrame &out, GLsizei base) {
+		out.depthDraws.clear();
+		if (out.shadowUpdate) {
+			// the moving water would be shadowed by its own flat depth, it only receives shadows then
+			if (!ocean)
+				renderWater(out.depthDraws, PASS_DEPTH, depthMappingShader, water, depthWaterCuller.visibleMeshes(), false, out.data);
+			renderShip(out.depthDraws, PASS_DEPTH, depthMappingShader, ourModel, fleetInstances, base, depthShipLods, depthShipCuller.visibleMeshes(), false);
+		}
+		out.depthDraws.sort();
+	};
+	auto prepareFrame = [&](PreparedFrame &out, float lodHeight) {
+		std::chrono::steady_clock::time_point prepareStart = std::chrono::steady_clock::now();
+		{
+			JobTraceScope trace(jobs, "scene");
+			// the moving ships rock, the scene rebuilds the matrices of their nodes only
+			sceneTime += deltaTime;
+			for (int i = 0; i < std::min(movingShips, (int)shipNodes.size()); i++) {
+				float phase = (float)sceneTime * 1.3f + i * 0.7f;
+				scene.setPosition(shipNodes[i], shipRest[i] + glm::vec3(0.0f, 0.02f * sin(phase), 0.0f));
+				scene.setRotation(shipNodes[i], glm::vec3(0.0f, 0.0f, 2.0f * sin(phase * 0.8f)));
+			}
+			scene.update();
+			for (size_t i = 0; i < shipNodes.size(); i++) {
+				if (scene.moved(shipNodes[i]))
+					fleet[i] = scene.world(shipNodes[i]);
+			}
+			if (scene.moved(waterNode))
+				waterTransforms[0] = waterModelMatrix();
+			out.data.lightSpaceMatrix = lightSpaceMatrix();
+			renderLight(out.data);
+			shadowCache.beginFrame(out.data.lightSpaceMatrix);
+			shadowCache.addCaster(&water, waterModelMatrix());
+			for (size_t i = 0; i < fleet.size(); i++)
+				shadowCache.addCaster(&ourModel, fleet[i]);
+			out.shadowUpdate = shadowCache.update(); // only when the light or the casters changed
+			out.shadowRegion = shadowCache.region();
+		}
+
+		JobCounter culled;
+		if (out.shadowUpdate) {
+			jobs.run("cull depth", [&]() { cullShadow(out, jobCullThreads); }, culled);
+		}
+		// the color pass draws what any of the views sees, at the LOD the closest one needs
+		jobs.run("cull color", [&]() {
+			std::vector<glm::mat4> viewClips;
+			std::vector<Frustum> viewFrustums;
+			for (int v = 0; v < viewCount; v++) {
+				viewClips.push_back(out.data.projections[v] * out.data.viewMatrices[v]);
+				viewFrustums.push_back(Frustum(viewClips.back()));
+			}
+			colorWaterCuller.cull(viewFrustums, water, waterTransforms, jobCullThreads);
+			colorShipCuller.cull(viewFrustums, ourModel, fleet, jobCullThreads);
+			colorCulling.reset();
+			colorCulling.add(colorWaterCuller);
+			colorCulling.add(colorShipCuller);
+			colorShipLods.select(ourModel, viewClips, lodHeight, fleet, colorShipCuller.visibleIndices());
+		}, culled);
+		jobs.wait(culled);
+		out.instances.clear();
+		if (out.shadowUpdate)
+			out.instances = depthShipLods.transforms();
+		GLsizei colorInstances = (GLsizei)out.instances.size();
+		out.instances.insert(out.instances.end(), colorShipLods.transforms().begin(), colorShipLods.transforms().end());
+
+		// the passes are the top bits of the sort key, each list is sorted on its own
+		JobCounter built;
+		jobs.run("depth packets", [&]() { buildShadow(out, 0); }, built);
+		jobs.run("color packets", [&]() {
+			out.draws.clear();
+			if (depthPrepass)
+				renderShip(out.draws, PASS_PREPASS, depthMappingShader, ourModel, fleetInstances, colorInstances, colorShipLods, colorShipCuller.visibleMeshes(), false);
+			renderSun(out.draws, sunShader, sun, out.data);
+			renderShip(out.draws, PASS_COLOR, objectShader, ourModel, fleetInstances, colorInstances, colorShipLods, colorShipCuller.visibleMeshes(), true);
+			renderWater(out.draws, PASS_COLOR, objectShader, water, colorWaterCuller.visibleMeshes(), true, out.data);
+			renderText(out.draws, textShader, shipName, fleetInstances, colorInstances, (GLsizei)colorShipLods.transforms().size());
+			out.draws.sort();
+		}, built);
+		jobs.wait(built);
+		prepareMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - prepareStart).count();
+	};
+	// GL thread, no preparation running: the shadow map was dropped after the frame was prepared
+	// (reallocated, new casters loaded), so its depth pass is built again for all of the map, with its instances
+	// after the ones the frame already has
+	auto refreshShadow = [&](PreparedFrame &out) {
+		if (!shadowCache.refresh())
+			return;
+		out.shadowUpdate = true;
+		out.shadowRegion = shadowCache.region();
+		cullShadow(out, cullThreads);
+		GLsizei base = (GLsizei)out.instances.size();
+		out.instances.insert(out.instances.end(), depthShipLods.transforms().begin(), depthShipLods.transforms().end());
+		buildShadow(out, base);
+	};
+	// the first frame is prepared before the loop, every iteration then prepares the next one
+	preparedFrames[0].data = viewFrameData();
+	float lodHeight = (float)std::min(sceneTargets.height, resolution.scaled(tileHeight()));
+	jobs.run("prepare", [&, lodHeight]() { prepareFrame(preparedFrames[0], lodHeight); }, preparing);
+
+	while (benchMode ? frameCount < benchFrames + BENCH_WARMUP : !glfwWindowShouldClose(window))
 	{
-		
+		passTimer.beginFrame();
+		gpuResources().beginFrame();
+		drawState.beginFrame();
+		resolution.beginFrame();
+		frameCapture.beginFrame();
+		// this frame, prepared while the last one was submitted
+		std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+		{
+			JobTraceScope trace(jobs, "wait prepare");
+			jobs.wait(preparing);
+		}
+		prepareWaitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+		PreparedFrame &prepared = preparedFrames[preparedSlot];
+		JobTraceScope submitTrace(jobs, "submit");
+		if (benchMode && frameCount == BENCH_WARMUP) {
+			gpuResources().beginSteadyState();
+			resolution.resetStats();
+			overdrawCounter.resetStats();
+			frameCapture.resetStats();
+			scene.resetStats();
+			jobs.resetStats();
+			prepareMs = prepareWaitMs = 0.0;
+			if (ocean)
+				ocean->resetStats();
+		}
+		// over the memory budget: a step down per frame until it fits, or a warning
+		if (memoryBudget > 0 && gpuResources().memory().gpuBytes() > memoryBudget) {
+			if (fitMemoryBudget(depthMap, shadowCache, varianceShadowMap, resolution)) {
+				std::cout << "MEMORY: over the budget, shadow map " << shadowSize() << ", max scale " << resolutionSettings.maxScale << std::endl;
+				screenResized = true;
+			}
+			else if (!memoryOverBudget) {
+				std::cout << "MEMORY: " << (gpuResources().memory().gpuBytes() >> 20) << " MB, over the budget of " << (memoryBudget >> 20) << " MB\n"
+					<< gpuResources().memory().dump(8);
+				memoryOverBudget = true;
+			}
+		}
+		else
+			memoryOverBudget = false;
+		if (memoryDumpRequested || (memoryDumpInterval > 0 && frameCount % memoryDumpInterval == 0 && frameCount != memoryDumpFrame)) {
+			memoryDumpRequested = false;
+			memoryDumpFrame = frameCount;
+			std::cout << gpuResources().memory().dump();
+		}
+		if (screenResized) {
+			screenResized = false;
+			if (sceneTargets.resize(targetSize(tileWidth()), targetSize(tileHeight()), viewCount)) {
+				bloomChain.release();
+				bloomChain.create(sceneTargets.width, sceneTargets.height, bloomLevels, hdrInternalFormat(sceneTargets.format), viewCount);
+			}
+		}
+		// the part of the scene targets (of every layer) this frame is drawn into
+		int renderWidth = std::min(sceneTargets.width, resolution.scaled(tileWidth()));
+		int renderHeight = std::min(sceneTargets.height, resolution.scaled(tileHeight()));
+		lastRenderWidth = renderWidth;
+		lastRenderHeight = renderHeight;
+		glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
 		glClearColor(0.05f, 0.05f, 0.05f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-
-		double currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+		glViewport(0, 0, screenWidth, screenHeight);
 
-		processInput(window);
+		if (benchMode) {
+			// fixed step so every bench run renders the same frames
+			deltaTime = BENCH_STEP;
+			if (replayFile && frameCount >= BENCH_WARMUP)
+				replayInput((frameCount - BENCH_WARMUP) * BENCH_STEP);
+		}
+		else {
+			double currentFrame = glfwGetTime();
+			deltaTime = currentFrame - lastFrame;
+			lastFrame = currentFrame;
+			if (recordStart < 0.0)
+				recordStart = currentFrame;
+			recordTime = currentFrame - recordStart;
+
+			processInput(window);
+		}
+		// models and textures that finished loading, new casters need a new shadow map
+		if (assetLoader.update())
+			shadowCache.invalidate();
+		bool loading = !assetLoader.idle();
+		// the clocks start over with the first loaded frame, so the measured frames are the same
+		// however many frames the loading took
+		if (benchMode && !loading && frameCount == 0) {
+			sceneTime = oceanTime = 0.0;
+			shadowCache.invalidate();
+		}
+		// a map dropped since the frame was prepared (loads, a new depth map from the memory
+		// budget) is drawn by this frame and not one frame late
+		refreshShadow(prepared);
+	// the uploads of the prepared frame, then the jobs start on the next one
+		passTimer.begin(PASS_PREPARE);
+		oceanTime += deltaTime;
+		if (ocean)
+			ocean->update((float)oceanTime, (float)(oceanTime + deltaTime));
+		frameUniforms.update(prepared.data);
+		fleetInstances.update(prepared.instances);
+		PreparedFrame *next = &preparedFrames[1 - preparedSlot];
+		next->data = viewFrameData();
+		float lodHeight = (float)renderHeight;
+		jobs.run("prepare", [&, next, lodHeight]() { prepareFrame(*next, lodHeight); }, preparing);
+		passTimer.end(PASS_PREPARE);
 	// first rendering --> depth
-		glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
-			glClear(GL_DEPTH_BUFFER_BIT);
-			renderWater(depthMappingShader, water, false);
-			renderShip(depthMappingShader, ourModel, false);
-			
-		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		passTimer.begin(PASS_DEPTH);
+		if (prepared.shadowUpdate) {
+			glViewport(0, 0, shadowSize(), shadowSize());
+			glBindFramebuffer(GL_FRAMEBUFFER, depthFBO);
+				ShadowCache::beginUpdate(prepared.shadowRegion);
+				glClear(GL_DEPTH_BUFFER_BIT);
+				depthMappingShader.use();
+				depthMappingShader.setBool("cameraDepth", false);
+				prepared.depthDraws.submit(drawState, PASS_DEPTH);
+				ShadowCache::endUpdate();
+			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			varianceShadowMap.invalidate();
+		}
+		if (shadowTier == SHADOW_VSM && !varianceShadowMap.isValid())
+			renderShadowMoments(varianceShadowMap, shadowMomentsShader, shadowBlurShader, depthMap, shadowSize(), shadowSize());
+		passTimer.end(PASS_DEPTH);
+	// the views: all layers in one pass, or one pass per layer without layer selection
+		int viewPasses = layeredViews ? 1 : viewCount;
+		int passViews = layeredViews ? viewCount : 1;
+	// depth pre-pass: the camera depth of the opaque ships, no colour writes
+		glViewport(0, 0, renderWidth, renderHeight);
+		for (int v = 0; v < viewPasses; v++) {
+			glBindFramebuffer(GL_FRAMEBUFFER, layeredViews ? sceneTargets.FBO : sceneTargets.layerFBO(v));
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+		}
+		if (depthPrepass) {
+			passTimer.begin(PASS_PREPASS);
+			glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+			depthMappingShader.use();
+			depthMappingShader.setBool("cameraDepth", true);
+			for (int v = 0; v < viewPasses; v++) {
+				glBindFramebuffer(GL_FRAMEBUFFER, layeredViews ? sceneTargets.FBO : sceneTargets.layerFBO(v));
+				prepared.draws.submit(drawState, PASS_PREPASS, DRAW_ALL, v, passViews);
+			}
+			glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+			passTimer.end(PASS_PREPASS);
+		}
 	// second rendering --> color
-		glViewport(0, 0, SCR_WIDTH, SCR_HEIGHT);
-		glBindFramebuffer(GL_FRAMEBUFFER, hdrFBO);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-			renderSkyBox(skyboxShader);
-			renderSun(sunShader, sun);
+		passTimer.begin(PASS_COLOR);
+		overdrawCounter.begin((size_t)renderWidth * renderHeight * viewCount);
+		if (overdrawView) {
+			// every fragment that passes the depth test counts in the stencil
+			glEnable(GL_STENCIL_TEST);
+			glStencilFunc(GL_ALWAYS, 0, 0xFF);
+			glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+		}
 			glActiveTexture(GL_TEXTURE10);
 			glBindTexture(GL_TEXTURE_2D, depthMap);
-			renderShip(objectShader, ourModel, true);
-			renderWater(objectShader, water, true);
-			renderText(textShader, shipName);
+			glActiveTexture(GL_TEXTURE11);
+			glBindTexture(GL_TEXTURE_2D, depthMap);
+			glBindSampler(11, shadowCompareSampler);
+			glActiveTexture(GL_TEXTURE12);
+			glBindTexture(GL_TEXTURE_2D, varianceShadowMap.texture());
+			if (ocean) {
+				glActiveTexture(GL_TEXTURE13);
+				glBindTexture(GL_TEXTURE_2D, ocean->displacementTexture());
+				glActiveTexture(GL_TEXTURE14);
+				glBindTexture(GL_TEXTURE_2D, ocean->normalTexture());
+			}
+			objectShader.use();
+			objectShader.setInt("shadowTier", shadowTier);
+			objectShader.setBool("oceanWaves", ocean != NULL);
+			if (ocean) {
+				objectShader.setFloat("oceanPatchSize", ocean->patchSize());
+				objectShader.setFloat("oceanLod", ocean->lod(WATER_GRID_SPACING));
+			}
+			// opaque first, then the skybox at the far plane where nothing was drawn,
+			// then the water and the labels blended over both
+			for (int v = 0; v < viewPasses; v++) {
+				glBindFramebuffer(GL_FRAMEBUFFER, layeredViews ? sceneTargets.FBO : sceneTargets.layerFBO(v));
+				prepared.draws.submit(drawState, PASS_COLOR, DRAW_OPAQUE, v, passViews);
+				glActiveTexture(GL_TEXTURE0);
+				glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+				renderSkyBox(skyboxShader, v, passViews);
+				glEnable(GL_BLEND);
+				prepared.draws.submit(drawState, PASS_COLOR, DRAW_TRANSLUCENT, v, passViews);
+				glDisable(GL_BLEND);
+			}
+		glDisable(GL_STENCIL_TEST);
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		overdrawCounter.end();
+		passTimer.end(PASS_COLOR);
 
-	//  third rendering --->blur
-		bool horizontal = true, first_iteration = true;
-		unsigned int amount = 10;
-		blurShader.use();
-		for (unsigned int i = 0; i < amount; i++)
-		{
-			glBindFramebuffer(GL_FRAMEBUFFER, pingpongFBO[horizontal]);
-			blurShader.setInt("horizontal", horizontal);
-			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, first_iteration ? colorBuffers[1] : pingpongColorbuffers[!horizontal]);
-			renderScreen();
-			horizontal = !horizontal;
-			if (first_iteration)
-				first_iteration = false;
-		}
+	//  third rendering --->bloom
+		passTimer.begin(PASS_BLOOM);
+		if (bloom)
+			renderBloom(bloomChain, bloomDownShader, bloomUpShader, sceneTargets, renderWidth, renderHeight);
 		glBindFramebuffer(GL_FRAMEBUFFER, 0);
-	//  fourth rendering  --> the scene  
+		passTimer.end(PASS_BLOOM);
+	//  fourth rendering  --> the scene, every view in its tile by one instanced quad
+		passTimer.begin(PASS_HDR);
+		glViewport(0, 0, screenWidth, screenHeight);
+		glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT); 
 		hdrShader.use();
 		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, sceneTargets.colorBuffer);
 		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, pingpongColorbuffers[!horizontal]);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, bloomChain.texture());
+		hdrShader.setInt("columns", viewColumns);
+		hdrShader.setInt("rows", viewRows);
 		hdrShader.setInt("bloom", bloom);
 		hdrShader.setFloat("exposure", exposure);
-		renderScreen();
+		hdrShader.setVec2("sceneScale", (float)renderWidth / sceneTargets.width, (float)renderHeight / sceneTargets.height);
+		if (bloomChain.levels() > 0) {
+			const BloomMip &mip = bloomChain.level(0);
+			hdrShader.setVec2("bloomScale", (float)bloomSize(renderWidth, 0) / mip.width, (float)bloomSize(renderHeight, 0) / mip.height);
+		}
+		renderScreen(viewCount);
+		passTimer.end(PASS_HDR);
 
 		//std::cout << "bloom: " << (bloom ? "on" : "off") << "| exposure: " << exposure << std::endl;
 
 	// use for debug
 		if (DebugMode) {
-			glBindFramebuffer(GL_FRAMEBUFFER, 0);
+			glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
 			float near_plane = 1.0f, far_plane = 7.5f;
 			debugDepthQuad.use();
 			debugDepthQuad.setFloat("near_plane", near_plane);
 			debugDepthQuad.setFloat("far_plane", far_plane);
+			debugDepthQuad.setVec2("sceneScale", (float)renderWidth / sceneTargets.width, (float)renderHeight / sceneTargets.height);
 			glActiveTexture(GL_TEXTURE0);
-			glBindTexture(GL_TEXTURE_2D, colorBuffers[0]);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, sceneTargets.colorBuffer);
 			renderScreen();
 		}
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+		if (overdrawView)
+			renderOverdraw(overdrawShader, sceneTargets, renderWidth, renderHeight, screenFBO);
+		// the readbacks are mapped a few frames later, nothing here waits for the GPU
+		if (capturing) {
+			frameCapture.read(CAPTURE_SCREEN, screenFBO, screenWidth, screenHeight);
+			frameCapture.read(CAPTURE_SCENE, sceneTargets.layerFBO(0), renderWidth, renderHeight);
+			if (prepared.shadowUpdate) // the depth map is kept between its updates
+				frameCapture.read(CAPTURE_DEPTH, depthFBO, shadowSize(), shadowSize());
+		}
+		resolution.endFrame();
+		passTimer.endFrame();
+		// after the frame's timing: the readback waits for the GPU
+		if (benchMode && !loading && frameCount >= BENCH_WARMUP && goldenImages.due(frameCount - BENCH_WARMUP, benchFrames - 1)) {
+			std::vector<unsigned char> pixels((size_t)screenWidth * screenHeight * 3);
+			glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+			glPixelStorei(GL_PACK_ALIGNMENT, 1);
+			glReadPixels(0, 0, screenWidth, screenHeight, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+			glPixelStorei(GL_PACK_ALIGNMENT, 4);
+			goldenImages.check(frameCount - BENCH_WARMUP, pixels, screenWidth, screenHeight);
+		}
+		if (!benchMode) {
+			glfwSwapBuffers(window);
+			glfwPollEvents();
+		}
+		if (assetLoader.firstFrameTime() < 0.0) {
+			glFinish();
+			assetLoader.firstFrame();
+			if (!benchMode)
+				std::cout << "first frame after " << assetLoader.firstFrameTime() << " ms" << std::endl;
+		}
+		// the bench measures the loaded scene, its warmup starts once loading is done
+		if (benchMode && loading)
+			passTimer.restartWarmup();
+		else
+			frameCount++;
+		if (!benchMode && !loading && !loadedShown) {
+			std::cout << "fully loaded after " << assetLoader.fullyLoadedTime() << " ms" << std::endl;
+			loadedShown = true;
+		}
+		preparedSlot = 1 - preparedSlot;
+	}
+	// the frame after the last one is still being prepared
+	jobs.wait(preparing);
+	if (traceOutput && !jobs.writeTrace(traceOutput, "gl thread"))
+		std::cout << "cannot write the trace to " << traceOutput << std::endl;
+
+	if (benchMode) {
+		passTimer.finish();
+		frameCapture.finish();
+		frameTimings.set(passTimer.frameCpuMs(), passTimer.frameGpuMs());
+		if (timingsOutput && !frameTimings.write(timingsOutput))
+			std::cout << "cannot write the timings to " << timingsOutput << std::endl;
+		if (perfBaseline)
+			frameTimings.compare(perfBaseline, perfTolerance / 100.0f);
+		std::string report = passTimer.report(screenWidth, screenHeight, gpuResources().report()
+			+ ",\n  " + gpuResources().memory().report(memoryBudget)
+			+ ",\n  " + shadowCache.report()
+			+ ",\n  \"shadow_tier\": \"" + shadowTierNames[shadowTier] + "\""
+			+ ",\n  \"culling\": { " + depthCulling.report("depth") + ", " + colorCulling.report("color") + " }"
+			+ ",\n  \"lod\": { \"levels\": " + std::to_string(ourModel.lodCount()) + ", "
+			+ depthShipLods.report("depth", ourModel, depthShipCuller.visibleMeshes()) + ", "
+			+ colorShipLods.report("color", ourModel, colorShipCuller.visibleMeshes()) + " }"
+			+ ",\n  " + drawState.report()
+			+ ",\n  " + assetLoader.report()
+			+ ",\n  " + scene.report()
+			+ ",\n  \"frame_prep\": { \"job_threads\": " + std::to_string(jobs.threads())
+			+ ", \"jobs_per_frame\": " + std::to_string(jobs.jobs() / std::max(1, benchFrames)) + ", \"steals\": " + std::to_string(jobs.steals())
+			+ ", \"prepare_ms\": " + std::to_string(prepareMs / std::max(1, benchFrames))
+			+ ", \"wait_ms\": " + std::to_string(prepareWaitMs / std::max(1, benchFrames)) + " }"
+			+ ",\n  \"views\": { \"count\": " + std::to_string(viewCount) + ", \"layered\": " + (layeredViews ? "true" : "false")
+			+ ", \"passes\": " + std::to_string(layeredViews ? 1 : viewCount)
+			+ ", \"width\": " + std::to_string(lastRenderWidth) + ", \"height\": " + std::to_string(lastRenderHeight) + " }"
+			+ ",\n  " + resolution.report()
+			+ ",\n  " + overdrawCounter.report(depthPrepass)
+			+ ",\n  \"bandwidth\": { \"format\": \"" + hdrFormatNames[sceneTargets.format] + "\""
+			+ ", \"bytes_per_pixel\": " + std::to_string(hdrBytesPerPixel(sceneTargets.format))
+			+ ", \"current\": " + PostBandwidth::chain(sceneTargets.format, lastRenderWidth, lastRenderHeight, bloom ? bloomChain.levels() : 0, (size_t)screenWidth * screenHeight).json()
+			+ ", \"rgb16f_mrt\": " + PostBandwidth::oldLayout(screenWidth, screenHeight, (size_t)screenWidth * screenHeight).json() + " }"
+			+ (ocean ? ",\n  " + ocean->report() : std::string())
+			+ (frameCapture.enabled() ? ",\n  " + frameCapture.report() : std::string())
+			+ (replayFile ? ",\n  \"replay\": { \"file\": \"" + std::string(replayFile) + "\", \"events\": " + std::to_string(inputRecording.size())
+				+ ", \"seconds\": " + std::to_string(inputRecording.length()) + ", \"step\": " + std::to_string(BENCH_STEP) + " }" : std::string())
+			+ (goldenImages.enabled() ? ",\n  " + goldenImages.report() : std::string())
+			+ (timingsOutput || perfBaseline ? ",\n  " + frameTimings.report() : std::string()));
+		if (benchOutput) {
+			std::ofstream out(benchOutput);
+			out << report;
+		}
+		else
+			std::cout << report;
+		bool churn = gpuResources().steadyStateCounters().churn();
+		if (churn)
+			std::cout << "GL objects were created, deleted or re-uploaded after warmup" << std::endl;
+		if (!frameTimings.passed())
+			std::cout << "PERF: the frames are slower than in " << perfBaseline << std::endl;
+		assetLoader.stop();
+		if (ocean)
+			ocean->stop();
+		passTimer.release();
+		resolution.release();
+		overdrawCounter.release();
+		gpuResources().releaseAll();
+		destroyHeadlessContext();
+		if (assertNoChurn && churn)
+			return 2;
+		if (!goldenImages.passed())
+			return 3;
+		return frameTimings.passed() ? 0 : 4;
 	}
 
+	frameCapture.finish();
+	if (recordFile) {
+		inputRecording.extend(recordTime);
+		if (inputRecording.save(recordFile))
+			std::cout << "recorded " << inputRecording.size() << " input events to " << recordFile << std::endl;
+		else
+			std::cout << "cannot write the recording to " << recordFile << std::endl;
+	}
+	assetLoader.stop();
+	if (ocean)
+		ocean->stop();
+	passTimer.release();
+	resolution.release();
+	overdrawCounter.release();
+	gpuResources().releaseAll();
 	glfwTerminate();
 	return 0;
 }
@@ -300,14 +1098,18 @@ void processInput(GLFWwindow *window)
 	if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
 		glfwSetWindowShouldClose(window, true);
 
+	unsigned int keys = 0;
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-		camera.ProcessKeyboard(FORWARD, deltaTime);
+		keys |= INPUT_FORWARD;
 	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-		camera.ProcessKeyboard(BACKWARD, deltaTime);
+		keys |= INPUT_BACKWARD;
 	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-		camera.ProcessKeyboard(LEFT, deltaTime);
+		keys |= INPUT_LEFT;
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-		camera.ProcessKeyboard(RIGHT, deltaTime);
+		keys |= INPUT_RIGHT;
+	moveCamera(keys, deltaTime);
+	bool lastBloom = bloom;
+	float lastExposure = exposure;
 	if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS)
 		cout << camera.Position.x << " " << camera.Position.y << " " << camera.Position.z << "\n";
 	if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS && !bloomKeyPressed)
@@ -317,6 +1119,36 @@ void processInput(GLFWwindow *window)
 	}
 	if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_RELEASE)
 		bloomKeyPressed = false;
+	if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS && !shadowTierKeyPressed)
+	{
+		shadowTier = (ShadowTier)((shadowTier + 1) % SHADOW_TIER_COUNT);
+		shadowTierKeyPressed = true;
+		cout << "shadow tier: " << shadowTierNames[shadowTier] << "\n";
+	}
+	if (glfwGetKey(window, GLFW_KEY_T) == GLFW_RELEASE)
+		shadowTierKeyPressed = false;
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_PRESS && !overdrawKeyPressed)
+	{
+		overdrawView = !overdrawView;
+		overdrawKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_O) == GLFW_RELEASE)
+		overdrawKeyPressed = false;
+	if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS && !captureKeyPressed && !captureSettings.directory.empty())
+	{
+		capturing = !capturing;
+		captureKeyPressed = true;
+		cout << "capture: " << (capturing ? "on" : "paused") << "\n";
+	}
+	if (glfwGetKey(window, GLFW_KEY_C) == GLFW_RELEASE)
+		captureKeyPressed = false;
+	if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS && !memoryKeyPressed)
+	{
+		memoryDumpRequested = true;
+		memoryKeyPressed = true;
+	}
+	if (glfwGetKey(window, GLFW_KEY_M) == GLFW_RELEASE)
+		memoryKeyPressed = false;
 
 
 	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
@@ -329,10 +1161,54 @@ void processInput(GLFWwindow *window)
 	else if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
 		exposure += 0.001f;
 
+	if (recordFile) {
+		inputRecording.keys(recordTime, keys);
+		if (bloom != lastBloom)
+			inputRecording.bloom(recordTime, bloom);
+		if (exposure != lastExposure)
+			inputRecording.exposure(recordTime, exposure);
+	}
+}
+
+void moveCamera(unsigned int keys, float deltaTime)
+{
+	if (keys & INPUT_FORWARD)
+		camera.ProcessKeyboard(FORWARD, deltaTime);
+	if (keys & INPUT_BACKWARD)
+		camera.ProcessKeyboard(BACKWARD, deltaTime);
+	if (keys & INPUT_LEFT)
+		camera.ProcessKeyboard(LEFT, deltaTime);
+	if (keys & INPUT_RIGHT)
+		camera.ProcessKeyboard(RIGHT, deltaTime);
+}
+
+// the recorded events up to time, then the held keys move the camera by one fixed step
+void replayInput(double time)
+{
+	InputEvent event;
+	while (inputRecording.replay(time, event)) {
+		if (event.type == INPUT_KEYS)
+			replayKeys = event.keys;
+		else if (event.type == INPUT_MOUSE)
+			camera.ProcessMouseMovement(event.x, event.y);
+		else if (event.type == INPUT_SCROLL)
+			camera.ProcessMouseScroll(event.y);
+		else if (event.type == INPUT_BLOOM)
+			bloom = event.keys != 0;
+		else if (event.type == INPUT_EXPOSURE)
+			exposure = event.x;
+	}
+	moveCamera(replayKeys, (float)deltaTime);
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
+	// minimized windows report 0 x 0, the targets keep their size then
+	if (width <= 0 || height <= 0)
+		return;
+	screenWidth = width;
+	screenHeight = height;
+	screenResized = true;
 	glViewport(0, 0, width, height);
 }
 
@@ -352,247 +1228,451 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 	lastY = ypos;
 
 	camera.ProcessMouseMovement(xoffset, yoffset);
+	if (recordFile)
+		inputRecording.mouse(recordTime, (float)xoffset, (float)yoffset);
 }
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
 	camera.ProcessMouseScroll(yoffset);
+	if (recordFile)
+		inputRecording.scroll(recordTime, (float)yoffset);
 }
 
-unsigned int loadCubemap(vector<std::string> faces) {
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-	glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-	int width, height, nrChannels;
-	for (unsigned int i = 0; i < faces.size(); i++) {
-		unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-		if (data) {
-			glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-			stbi_image_free(data);
-		}
-		else {
-			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-			stbi_image_free(data);
-		}
-	}
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-	return textureID;
-}
-
-void renderSkyBox(Shader &skyBoxShader) {
-
-	float skyboxVertices[] = {
-		// positions          
-		-1.0f,  1.0f, -1.0f,
-		-1.0f, -1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f,
-		 1.0f,  1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-
-		-1.0f, -1.0f,  1.0f,
-		-1.0f, -1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-		-1.0f,  1.0f, -1.0f,
-		-1.0f,  1.0f,  1.0f,
-		-1.0f, -1.0f,  1.0f,
-
-		 1.0f, -1.0f, -1.0f,
-		 1.0f, -1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f,
-		 1.0f,  1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f,
-
-		-1.0f, -1.0f,  1.0f,
-		-1.0f,  1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f,
-		 1.0f, -1.0f,  1.0f,
-		-1.0f, -1.0f,  1.0f,
-
-		-1.0f,  1.0f, -1.0f,
-		 1.0f,  1.0f, -1.0f,
-		 1.0f,  1.0f,  1.0f,
-		 1.0f,  1.0f,  1.0f,
-		-1.0f,  1.0f,  1.0f,
-		-1.0f,  1.0f, -1.0f,
-
-		-1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f,  1.0f,
-		 1.0f, -1.0f, -1.0f,
-		 1.0f, -1.0f, -1.0f,
-		-1.0f, -1.0f,  1.0f,
-		 1.0f, -1.0f,  1.0f
-	};
-
-	GLuint skyboxVAO, skyboxVBO;
-	glGenVertexArrays(1, &skyboxVAO);
-	glGenBuffers(1, &skyboxVBO);
-	glBindVertexArray(skyboxVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-	glBindVertexArray(0);
+unsigned int skyboxVAO = 0;
+unsigned int skyboxVBO;
+// views firstView ... firstView + views - 1, one instance each (layered, see skybox.vs)
+void renderSkyBox(CachedShader &skyBoxShader, int firstView, int views) {
 
+	// the cube is uploaded once and kept for the whole run
+	if (skyboxVAO == 0)
+	{
+		float skyboxVertices[] = {
+			// positions          
+			-1.0f,  1.0f, -1.0f,
+			-1.0f, -1.0f, -1.0f,
+			 1.0f, -1.0f, -1.0f,
+			 1.0f, -1.0f, -1.0f,
+			 1.0f,  1.0f, -1.0f,
+			-1.0f,  1.0f, -1.0f,
+
+			-1.0f, -1.0f,  1.0f,
+			-1.0f, -1.0f, -1.0f,
+			-1.0f,  1.0f, -1.0f,
+			-1.0f,  1.0f, -1.0f,
+			-1.0f,  1.0f,  1.0f,
+			-1.0f, -1.0f,  1.0f,
+
+			 1.0f, -1.0f, -1.0f,
+			 1.0f, -1.0f,  1.0f,
+			 1.0f,  1.0f,  1.0f,
+			 1.0f,  1.0f,  1.0f,
+			 1.0f,  1.0f, -1.0f,
+			 1.0f, -1.0f, -1.0f,
+
+			-1.0f, -1.0f,  1.0f,
+			-1.0f,  1.0f,  1.0f,
+			 1.0f,  1.0f,  1.0f,
+			 1.0f,  1.0f,  1.0f,
+			 1.0f, -1.0f,  1.0f,
+			-1.0f, -1.0f,  1.0f,
+
+			-1.0f,  1.0f, -1.0f,
+			 1.0f,  1.0f, -1.0f,
+			 1.0f,  1.0f,  1.0f,
+			 1.0f,  1.0f,  1.0f,
+			-1.0f,  1.0f,  1.0f,
+			-1.0f,  1.0f, -1.0f,
+
+			-1.0f, -1.0f, -1.0f,
+			-1.0f, -1.0f,  1.0f,
+			 1.0f, -1.0f, -1.0f,
+			 1.0f, -1.0f, -1.0f,
+			-1.0f, -1.0f,  1.0f,
+			 1.0f, -1.0f,  1.0f
+		};
 
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-	glm::mat4 view = camera.GetViewMatrix();
-	view = glm::mat4(glm::mat3(view));
+		skyboxVAO = gpuResources().create(GPU_VERTEX_ARRAY);
+		skyboxVBO = gpuResources().create(GPU_BUFFER);
+		glBindVertexArray(skyboxVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
+		gpuResources().bufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
+		gpuResources().allocated(GPU_BUFFER, skyboxVBO, MEMORY_BUFFERS, "skybox", GL_STATIC_DRAW, sizeof(skyboxVertices));
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glBindVertexArray(0);
+	}
 
 	skyBoxShader.use();
-	skyBoxShader.setMat4("view", view);
-	skyBoxShader.setMat4("projection", projection);
+	skyBoxShader.setInt("firstView", firstView);
+	skyBoxShader.setInt("viewCount", views);
 
 	glBindVertexArray(skyboxVAO);
 	//glActiveTexture(GL_TEXTURE1);
 	//glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	glDrawArraysInstanced(GL_TRIANGLES, 0, 36, views);
 	glBindVertexArray(0);
 }
 
-void renderText(Shader &textShader, Model &textModel) {
+void renderText(DrawList &drawList, CachedShader &textShader, CachedModel &textModel, InstanceBuffer &fleetInstances, GLsizei firstInstance, GLsizei count) {
 
 	
-	glm::vec3 upOffset = glm::vec3(0.0, 2.0, 0.0);
+	// one label above every ship: billboard.vs adds the ship position from the instance data,
+	// the camera axes are taken from the view matrix. Blended, so drawn after the opaque packets.
+	// Placement and size are the label of the scene's first ship
+	const SceneLabel *label = scene.label(shipNode);
+	if (count == 0 || label == NULL)
+		return;
 	glm::mat4 model = glm::mat4(1.0f);
-	model = glm::translate(model, shipPos + upOffset);
-	//model = glm::rotate(model, glm::radians(90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-	model = glm::scale(model, glm::vec3(0.1f, 0.1f, 0.1f));
-	glm::mat4 view = camera.GetViewMatrix();
-		
-	glm::vec3 CameraRight = glm::vec3(view[0][0], view[1][0] ,view[2][0]);
-	glm::vec3 CameraUp = glm::vec3(view[0][1], view[1][1], view[2][1]);
-	textShader.use();
-	textShader.setVec3("CameraRight", CameraRight);
-	textShader.setVec3("CameraUp", CameraUp);
-	textShader.setVec3("CenterPos", shipPos + upOffset);
-
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-	textShader.setMat4("model", model);
-	textShader.setMat4("projection", projection);
-	textShader.setMat4("view", view);
-	textModel.Draw(textShader);
+	model = glm::translate(model, label->offset);
+	model = glm::scale(model, glm::vec3(label->size));
+
+	DrawPacket packet;
+	packet.shader = &textShader;
+	packet.model = &textModel;
+	packet.instances = &fleetInstances;
+	packet.firstInstance = firstInstance;
+	packet.instanceCount = count;
+	packet.hasTransform = true;
+	packet.transform = model;
+	drawList.addModel(PASS_COLOR, true, packet, NULL, 0.0f);
 }
 
-void renderSun(Shader &sunShader, Model &sunModel) {
-
-	glm::mat4 model = glm::mat4(1.0f);
-	model = glm::translate(model, sunPos);
-	model = glm::scale(model, glm::vec3(0.05f, 0.05f, 0.05f));
+void renderSun(DrawList &drawList, CachedShader &sunShader, CachedModel &sunModel, const FrameData &frame) {
 
-	glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-	glm::mat4 view = camera.GetViewMatrix();
-
-	sunShader.use();
-	sunShader.setMat4("model", model);
-	sunShader.setMat4("projection", projection);
-	sunShader.setMat4("view", view);
-	sunModel.Draw(sunShader);
+	DrawPacket packet;
+	packet.shader = &sunShader;
+	packet.model = &sunModel;
+	packet.hasTransform = true;
+	packet.transform = scene.world(sunNode);
+	drawList.addModel(PASS_COLOR, false, packet, NULL, glm::distance(glm::vec3(frame.viewPos), scene.worldPosition(sunNode)));
 }
 
-void renderWater(Shader &waterShader, Model &waterModel, bool isRenderLight) {
+void renderWater(DrawList &drawList, unsigned int pass, CachedShader &waterShader, CachedModel &waterModel, const std::vector<unsigned char> &visibleMeshes, bool isRenderLight, const FrameData &frame) {
 
-	waterShader.use();
-	renderlightSpaceMatrix(waterShader);
-	glm::mat4 model = glm::mat4(1.0f);
-	waterShader.setMat4("model", model);
+	DrawPacket packet;
+	packet.shader = &waterShader;
+	packet.model = &waterModel;
+	packet.hasTransform = true;
+	packet.transform = waterModelMatrix();
 
+	glm::vec3 eye = scene.worldPosition(sunNode);
 	if (!isRenderLight) { // for render depth
 
 	}
 	else if (isRenderLight) {
-		waterShader.setInt("objectNum", 2);
-		
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		glm::mat4 view = camera.GetViewMatrix();
-
-		waterShader.setMat4("projection", projection);
-		waterShader.setMat4("view", view);
-		renderLight(waterShader, waterModel);
+		packet.objectNum = 2;
+		eye = glm::vec3(frame.viewPos);
 	}
-	waterModel.Draw(waterShader);
+	// the water is blended over the skybox and the hulls in the colour pass
+	drawList.addModel(pass, isRenderLight, packet, &visibleMeshes, glm::distance(eye, glm::vec3(packet.transform[3])));
 }
 
-void renderShip(Shader &shipShader, Model &shipModel, bool isRenderLight) {
-	
-	shipShader.use();
-
-	renderlightSpaceMatrix(shipShader);
-	
-	glm::mat4 model = glm::mat4(1.0f);
-	model = glm::rotate(model, glm::radians(60.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-	model = glm::translate(model, shipPos);
-	model = glm::scale(model, glm::vec3(0.001f, 0.001f, 0.001f));
+void renderShip(DrawList &drawList, unsigned int pass, CachedShader &shipShader, CachedModel &shipModel, InstanceBuffer &fleetInstances, GLsizei firstInstance, const LodSelector &lods, const std::vector<unsigned char> &visibleMeshes, bool isRenderLight) {
 	
-	shipShader.setMat4("model", model);
+	// the transforms of the visible ships come from the instance buffer, from firstInstance
+	// on grouped by LOD, one instanced packet per level and mesh
+	DrawPacket packet;
+	packet.shader = &shipShader;
+	packet.model = &shipModel;
+	packet.instances = &fleetInstances;
 
 	if (!isRenderLight) { // for render depth
 
 	}
 	else if (isRenderLight) {
-		shipShader.setInt("objectNum", 1);
+		packet.objectNum = 1;
+	}
+	for (int level = 0; level < lods.levelCount(); level++)
+	{
+		const LodGroup &group = lods.group(level);
+		if (group.count == 0)
+			continue;
+		packet.lod = level;
+		packet.firstInstance = firstInstance + group.first;
+		packet.instanceCount = group.count;
+		drawList.addModel(pass, false, packet, &visibleMeshes, 0.0f);
+	}
+
+}
 
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-		glm::mat4 view = camera.GetViewMatrix();
+// count ships in a square grid around the ship of the scene, copies of its node (same parent,
+// heading and label) with their positions offset; returns the ship nodes, the original first
+std::vector<int> buildFleet(int count) {
 
-		shipShader.setMat4("projection", projection);
-		shipShader.setMat4("view", view);
-		renderLight(shipShader, shipModel);
+	int ship = shipNode;
+	glm::vec3 rest = scene.position(ship);
+	std::vector<int> nodes;
+	int side = (int)ceil(sqrt((double)std::max(count, 1)));
+	for (int i = 0; i < count; i++)
+	{
+		glm::vec3 offset((i % side - side / 2) * 1.5f, 0.0f, (i / side - side / 2) * 6.0f);
+		int node = i == 0 ? ship : scene.clone(ship, "ship_" + std::to_string(i));
+		scene.setPosition(node, rest + offset);
+		nodes.push_back(node);
 	}
-	shipModel.Draw(shipShader);
+	return nodes;
+}
+
+glm::mat4 waterModelMatrix() {
 
+	return scene.world(waterNode);
 }
 
-void renderlightSpaceMatrix(Shader &objectShader) {
+glm::mat4 lightSpaceMatrix() {
 
 	glm::mat4 lightProjection = glm::mat4(1.0f);
 	glm::mat4 lightView = glm::mat4(1.0f);
-	glm::mat4 lightSpaceMatrix = glm::mat4(1.0f);
 	float near_plane = 1.0f, far_plane = 7.5f;
 	lightProjection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, near_plane, far_plane);
-	lightView = glm::lookAt(sunPos, glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
-	lightSpaceMatrix = lightProjection * lightView;
+	lightView = glm::lookAt(scene.worldPosition(sunNode), glm::vec3(0.0f), glm::vec3(0.0, 1.0, 0.0));
+	return lightProjection * lightView;
+}
+
+// the lights of the scene into their slots, at the world positions of their nodes
+void renderLight(FrameData &frame) {
 
-	objectShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
+	static const char *slots[FRAME_LIGHT_COUNT] = { "sun", "right", "left", "back" };
+	for (size_t i = 0; i < scene.lights.size(); i++)
+	{
+		const SceneLight &light = scene.lights[i];
+		for (int slot = 0; slot < FRAME_LIGHT_COUNT; slot++)
+		{
+			if (light.slot != slots[slot])
+				continue;
+			frame.lights[slot].position = glm::vec4(scene.worldPosition(light.node), light.directional ? 0.0f : 1.0f);
+			frame.lights[slot].ambient = glm::vec4(light.ambient, 0.0f);
+			frame.lights[slot].diffuse = glm::vec4(light.diffuse, 0.0f);
+			frame.lights[slot].specular = glm::vec4(light.specular, 0.0f);
+		}
+	}
 }
 
-void renderLight(Shader &objectShader, Model &objectModel) {
+// the views of the next frame, every view is as wide as its tile; the frame preparation adds
+// the light, the whole block is uploaded once per frame
+FrameData viewFrameData() {
 
-	// without position infomation
-	objectShader.setVec3("viewPos", camera.Position);
+	FrameData frame;
+	for (int v = 0; v < viewCount; v++)
+	{
+		Camera &view = viewCamera(v);
+		frame.viewMatrices[v] = view.GetViewMatrix();
+		frame.projections[v] = glm::perspective(glm::radians(view.Zoom), (float)tileWidth() / (float)tileHeight(), 0.1f, 100.0f);
+		frame.viewPositions[v] = glm::vec4(view.Position, 1.0f);
+	}
+	// the slots of the views not drawn are uploaded as well
+	for (int v = viewCount; v < FRAME_MAX_VIEWS; v++)
+	{
+		frame.viewMatrices[v] = glm::mat4(0.0f);
+		frame.projections[v] = glm::mat4(0.0f);
+		frame.viewPositions[v] = glm::vec4(0.0f);
+	}
+	frame.view = frame.viewMatrices[0];
+	frame.projection = frame.projections[0];
+	frame.viewPos = frame.viewPositions[0];
+	return frame;
+}
 
-	objectShader.setVec3("sunLight.position", sunPos);
-	objectShader.setVec3("sunLight.ambient", 0.05f, 0.05f, 0.05f);
-	objectShader.setVec3("sunLight.diffuse", 0.8f, 0.8f, 0.8f);
-	objectShader.setVec3("sunLight.specular", 1.0f, 1.0f, 1.0f);
+// view 0 is the interactive camera, the others the cameras of the scene
+Camera &viewCamera(int view) {
 
-	objectShader.setVec3("rightLight.direction", shipPos - glm::vec3(2.04f, 0.72f, 2.35f));
-	objectShader.setVec3("rightLight.ambient", 0.05f, 0.05f, 0.05f);
-	objectShader.setVec3("rightLight.diffuse", 0.5f, 0.5f, 0.5f);
-	objectShader.setVec3("rightLight.specular", 0.7f, 0.7f, 0.7f);
+	return view == 0 ? camera : sceneCameras[view - 1];
+}
+
+// size of a view on the screen, the window split into viewColumns x viewRows tiles
+int tileWidth() {
+
+	return std::max(1, screenWidth / viewColumns);
+}
 
-	objectShader.setVec3("leftLight.direction", shipPos - glm::vec3(3.36, 0.72, 0.224));
-	objectShader.setVec3("leftLight.ambient", 0.05f, 0.05f, 0.05f);
-	objectShader.setVec3("leftLight.diffuse", 0.5f, 0.5f, 0.5f);
-	objectShader.setVec3("leftLight.specular", 0.7f, 0.7f, 0.7f);
+int tileHeight() {
 
-	objectShader.setVec3("backLight.direction", shipPos - glm::vec3(-3.17, 0.77, -1.82));
-	objectShader.setVec3("backLight.ambient", 0.05f, 0.05f, 0.05f);
-	objectShader.setVec3("backLight.diffuse", 0.5f, 0.5f, 0.5f);
-	objectShader.setVec3("backLight.specular", 0.7f, 0.7f, 0.7f);
+	return std::max(1, screenHeight / viewRows);
+}
+
+// size of the scene targets for a window size: room for the largest render scale
+int targetSize(int screenSize) {
+
+	return std::max(1, (int)std::ceil(screenSize * resolutionSettings.maxScale));
+}
+
+// width or height of the part of bloom level `level` a sceneSize frame uses
+int bloomSize(int sceneSize, int level) {
+
+	for (int i = 0; i <= level; i++)
+		sceneSize = std::max(1, sceneSize / 2);
+	return sceneSize;
+}
+
+// Progressive bloom: the scene is downsampled level by level (bright pass in the first step),
+// then every level is blended back up into the larger one. The cost follows the number of
+// levels at falling resolution instead of full-screen passes.
+// Below full render scale only the lower left sceneWidth x sceneHeight of the scene is drawn,
+// every level then uses the same part of its target, imageScale tells the shaders where it ends.
+void renderBloom(BloomChain &bloomChain, CachedShader &downShader, CachedShader &upShader, const SceneTargets &scene, int sceneWidth, int sceneHeight) {
+
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glActiveTexture(GL_TEXTURE0);
+
+	downShader.use();
+	for (int i = 0; i < bloomChain.levels(); i++)
+	{
+		glViewport(0, 0, bloomSize(sceneWidth, i), bloomSize(sceneHeight, i));
+		downShader.setBool("brightPass", i == 0);
+		if (i == 0) {
+			glBindTexture(GL_TEXTURE_2D_ARRAY, scene.colorBuffer);
+			downShader.setVec2("imageScale", (float)sceneWidth / scene.width, (float)sceneHeight / scene.height);
+		}
+		else {
+			const BloomMip &source = bloomChain.level(i - 1);
+			glBindTexture(GL_TEXTURE_2D_ARRAY, source.texture);
+			downShader.setVec2("imageScale", (float)bloomSize(sceneWidth, i - 1) / source.width, (float)bloomSize(sceneHeight, i - 1) / source.height);
+		}
+		renderBloomLevel(downShader, bloomChain, i);
+	}
+
+	// level = 1/2 level + 1/2 upsampled smaller level, which keeps the overall brightness
+	glEnable(GL_BLEND);
+	glBlendColor(0.0f, 0.0f, 0.0f, 0.5f);
+	glBlendFunc(GL_CONSTANT_ALPHA, GL_ONE_MINUS_CONSTANT_ALPHA);
+	upShader.use();
+	for (int i = bloomChain.levels() - 1; i > 0; i--)
+	{
+		const BloomMip &source = bloomChain.level(i);
+		glViewport(0, 0, bloomSize(sceneWidth, i - 1), bloomSize(sceneHeight, i - 1));
+		glBindTexture(GL_TEXTURE_2D_ARRAY, source.texture);
+		upShader.setVec2("imageScale", (float)bloomSize(sceneWidth, i) / source.width, (float)bloomSize(sceneHeight, i) / source.height);
+		renderBloomLevel(upShader, bloomChain, i - 1);
+	}
+
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDisable(GL_BLEND);
+	glEnable(GL_DEPTH_TEST);
+}
+
+// one bloom step into every view of a level: one quad per layer as instances of a single draw,
+// or a draw per layer without layer selection in the vertex shader
+void renderBloomLevel(CachedShader &shader, const BloomChain &bloomChain, int level) {
+
+	int layers = bloomChain.layers();
+	for (int layer = 0; layer < (layeredViews ? 1 : layers); layer++)
+	{
+		glBindFramebuffer(GL_FRAMEBUFFER, layeredViews ? bloomChain.level(level).FBO : bloomChain.layerFBO(level, layer));
+		shader.setInt("firstLayer", layer);
+		renderScreen(layeredViews ? layers : 1);
+	}
+}
+
+// Overdraw view: the stencil of the scene holds the number of fragments the colour pass drew
+// per pixel. One full screen quad per count paints the pixels with that count, then the
+// result replaces the frame on the screen (the first view only).
+void renderOverdraw(CachedShader &overdrawShader, const SceneTargets &scene, int sceneWidth, int sceneHeight, unsigned int screenFBO) {
+
+	static const glm::vec3 heat[] = {
+		glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 0.6f), glm::vec3(0.0f, 0.5f, 1.0f), glm::vec3(0.0f, 0.8f, 0.3f),
+		glm::vec3(0.6f, 0.9f, 0.0f), glm::vec3(1.0f, 0.8f, 0.0f), glm::vec3(1.0f, 0.5f, 0.0f), glm::vec3(1.0f, 0.2f, 0.0f),
+		glm::vec3(1.0f, 0.0f, 0.0f)
+	};
+	const int steps = sizeof(heat) / sizeof(heat[0]);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, scene.layerFBO(0));
+	glViewport(0, 0, sceneWidth, sceneHeight);
+	glDisable(GL_DEPTH_TEST);
+	glEnable(GL_STENCIL_TEST);
+	glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+	overdrawShader.use();
+	for (int i = 0; i < steps; i++)
+	{
+		// the last colour takes every count from there on
+		glStencilFunc(i + 1 < steps ? GL_EQUAL : GL_LEQUAL, i, 0xFF);
+		overdrawShader.setVec3("color", heat[i]);
+		renderScreen();
+	}
+	glDisable(GL_STENCIL_TEST);
+	glEnable(GL_DEPTH_TEST);
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, scene.layerFBO(0));
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, screenFBO);
+	glBlitFramebuffer(0, 0, sceneWidth, sceneHeight, 0, 0, screenWidth, screenHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, screenFBO);
+}
+
+// VSM tier: (z, z^2) at half the shadow map size, blurred horizontally and vertically.
+// Only runs when the shadow map changed, the lighting pass then needs a single fetch.
+void renderShadowMoments(VarianceShadowMap &varianceShadowMap, CachedShader &momentsShader, CachedShader &blurShader, unsigned int depthMap, int shadowWidth, int shadowHeight) {
+
+	if (!varianceShadowMap.created())
+		varianceShadowMap.create(shadowWidth / 2, shadowHeight / 2);
+
+	glDisable(GL_BLEND);
+	glDisable(GL_DEPTH_TEST);
+	glViewport(0, 0, varianceShadowMap.width, varianceShadowMap.height);
+	glActiveTexture(GL_TEXTURE0);
+
+	momentsShader.use();
+	glBindFramebuffer(GL_FRAMEBUFFER, varianceShadowMap.FBO[0]);
+	glBindTexture(GL_TEXTURE_2D, depthMap);
+	renderScreen();
+
+	blurShader.use();
+	blurShader.setVec2("direction", 1.0f, 0.0f);
+	glBindFramebuffer(GL_FRAMEBUFFER, varianceShadowMap.FBO[1]);
+	glBindTexture(GL_TEXTURE_2D, varianceShadowMap.moments[0]);
+	renderScreen();
+	blurShader.setVec2("direction", 0.0f, 1.0f);
+	glBindFramebuffer(GL_FRAMEBUFFER, varianceShadowMap.FBO[0]);
+	glBindTexture(GL_TEXTURE_2D, varianceShadowMap.moments[1]);
+	renderScreen();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glEnable(GL_DEPTH_TEST);
+	varianceShadowMap.validate();
+}
+
+// side of the square depth map
+int shadowSize()
+{
+	return 1024 * depthResolution;
+}
+
+// (re)allocates the depth map for the current depthResolution, the FBO keeps it attached
+void allocateDepthMap(unsigned int depthMap)
+{
+	glBindTexture(GL_TEXTURE_2D, depthMap);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, shadowSize(), shadowSize(), 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	gpuResources().allocated(GPU_TEXTURE, depthMap, MEMORY_SHADOW, "shadow map", GL_DEPTH_COMPONENT,
+		MemoryTracker::textureBytes(GL_DEPTH_COMPONENT, shadowSize(), shadowSize()));
+}
+
+// one step towards the memory budget: halve the shadow map down to 1024, then lower the largest
+// render scale (the caller reallocates the scene targets); false if --memory-scale is off or
+// nothing is left to lower
+bool fitMemoryBudget(unsigned int depthMap, ShadowCache &shadowCache, VarianceShadowMap &varianceShadowMap, DynamicResolution &resolution)
+{
+	if (!memoryScale)
+		return false;
+	if (depthResolution > 1) {
+		depthResolution /= 2;
+		glActiveTexture(GL_TEXTURE0);
+		allocateDepthMap(depthMap);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		shadowCache.resize(shadowSize(), shadowSize());
+		varianceShadowMap.release();
+		return true;
+	}
+	if (resolutionSettings.maxScale > resolutionSettings.minScale) {
+		resolutionSettings.maxScale = std::max(resolutionSettings.minScale, resolutionSettings.maxScale - 0.125f);
+		resolution.setMaxScale(resolutionSettings.maxScale);
+		return true;
+	}
+	return false;
 }
 
 unsigned int quadVAO = 0;
 unsigned int quadVBO;
-void renderScreen()
+// instances: one quad each, the layered passes draw a layer per instance
+void renderScreen(int instances)
 {
 	if (quadVAO == 0)
 	{
@@ -604,17 +1684,18 @@ void renderScreen()
 			 1.0f, -1.0f, 0.0f, 1.0f, 0.0f,
 		};
 		// setup plane VAO
-		glGenVertexArrays(1, &quadVAO);
-		glGenBuffers(1, &quadVBO);
+		quadVAO = gpuResources().create(GPU_VERTEX_ARRAY);
+		quadVBO = gpuResources().create(GPU_BUFFER);
 		glBindVertexArray(quadVAO);
 		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+		gpuResources().bufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+		gpuResources().allocated(GPU_BUFFER, quadVBO, MEMORY_BUFFERS, "screen quad", GL_STATIC_DRAW, sizeof(quadVertices));
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(1);
 		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 	}
 	glBindVertexArray(quadVAO);
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instances);
 	glBindVertexArray(0);
 }
@@ -0,0 +1,253 @@
+#ifndef MEMORY_TRACKER_H
+#define MEMORY_TRACKER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+enum MemoryCategory {
+	MEMORY_RENDER_TARGETS,	// scene colour / depth, bloom levels, screen buffers
+	MEMORY_SHADOW,			// shadow map and moments
+	MEMORY_TEXTURES,		// material textures and cubemaps
+	MEMORY_BUFFERS,			// vertex, index, uniform and instance buffers
+	MEMORY_STAGING,			// pixel buffers for uploads and captures
+	MEMORY_CPU_MESHES,		// vertex caches waiting for their upload
+	MEMORY_CPU_IMAGES,		// decoded images waiting for their upload
+	MEMORY_CATEGORY_COUNT
+};
+
+static const char *memoryCategoryNames[MEMORY_CATEGORY_COUNT] = {
+	"render_targets", "shadow", "textures", "buffers", "staging", "cpu_meshes", "cpu_images"
+};
+
+// the storage of one GL object
+struct MemoryAllocation {
+	int type;			// GpuResourceType
+	GLuint id;
+	MemoryCategory category;
+	std::string owner;	// what it is for, file name of a texture
+	GLenum format;		// internal format of an image, usage of a buffer
+	size_t bytes;
+};
+
+// Bytes held per category, current and highest. GPU objects are recorded with their size,
+// format and owner when their storage is (re)allocated and dropped when the object is deleted;
+// CPU data is only counted. Decoding threads count their images, hence the lock.
+// Sizes of images are texels times texel size, what the driver adds (alignment, mip tails,
+// compression of render targets) is not known.
+class MemoryTracker
+{
+public:
+	MemoryTracker() : gpuPeak(0)
+	{
+		for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+			current[i] = peak[i] = 0;
+	}
+
+	// replaces what was recorded for the object before
+	void allocated(int type, GLuint id, MemoryCategory category, const std::string &owner, GLenum format, size_t bytes)
+	{
+		if (id == 0)
+			return;
+		std::lock_guard<std::mutex> lock(mutex);
+		remove(type, id);
+		MemoryAllocation allocation;
+		allocation.type = type;
+		allocation.id = id;
+		allocation.category = category;
+		allocation.owner = owner;
+		allocation.format = format;
+		allocation.bytes = bytes;
+		allocations[std::make_pair(type, id)] = allocation;
+		add(category, bytes);
+	}
+
+	void released(int type, GLuint id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		remove(type, id);
+	}
+
+	// every GPU record, the objects are gone (GpuResources::releaseAll)
+	void releasedAll()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for (std::map<Key, MemoryAllocation>::iterator it = allocations.begin(); it != allocations.end(); ++it)
+			current[it->second.category] -= it->second.bytes;
+		allocations.clear();
+	}
+
+	void cpuAllocated(MemoryCategory category, size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		add(category, bytes);
+	}
+
+	void cpuReleased(MemoryCategory category, size_t bytes)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		current[category] -= std::min(bytes, current[category]);
+	}
+
+	size_t bytes(MemoryCategory category) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return current[category];
+	}
+
+	size_t peakBytes(MemoryCategory category) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return peak[category];
+	}
+
+	// everything in GPU memory (the categories before the CPU ones)
+	size_t gpuBytes() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t sum = 0;
+		for (int i = 0; i < MEMORY_CPU_MESHES; i++)
+			sum += current[i];
+		return sum;
+	}
+
+	size_t gpuPeakBytes() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return gpuPeak;
+	}
+
+	// the totals and the allocations, largest first; at most limit of them (0: all)
+	std::string dump(size_t limit = 0) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		std::vector<const MemoryAllocation *> sorted;
+		for (std::map<Key, MemoryAllocation>::const_iterator it = allocations.begin(); it != allocations.end(); ++it)
+			sorted.push_back(&it->second);
+		std::stable_sort(sorted.begin(), sorted.end(), largerFirst);
+		std::ostringstream out;
+		out << "MEMORY:";
+		for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+			out << " " << memoryCategoryNames[i] << " " << megabytes(current[i]) << " MB (peak " << megabytes(peak[i]) << ")";
+		out << "\n";
+		for (size_t i = 0; i < sorted.size() && (limit == 0 || i < limit); i++)
+		{
+			const MemoryAllocation &a = *sorted[i];
+			out << "  " << megabytes(a.bytes) << " MB  " << memoryCategoryNames[a.category] << "  " << formatName(a.format)
+				<< "  " << a.owner << " (" << a.id << ")\n";
+		}
+		if (limit != 0 && sorted.size() > limit)
+			out << "  ... " << sorted.size() - limit << " more\n";
+		return out.str();
+	}
+
+	// "memory" member for the bench report, bytes
+	std::string report(size_t budget) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		size_t gpu = 0;
+		for (int i = 0; i < MEMORY_CPU_MESHES; i++)
+			gpu += current[i];
+		std::ostringstream out;
+		out << "\"memory\": { \"budget\": " << budget << ", \"gpu\": " << gpu << ", \"gpu_peak\": " << gpuPeak
+			<< ", \"allocations\": " << allocations.size() << ",\n    \"current\": { ";
+		for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+			out << "\"" << memoryCategoryNames[i] << "\": " << current[i] << (i + 1 < MEMORY_CATEGORY_COUNT ? ", " : " },\n");
+		out << "    \"peak\": { ";
+		for (int i = 0; i < MEMORY_CATEGORY_COUNT; i++)
+			out << "\"" << memoryCategoryNames[i] << "\": " << peak[i] << (i + 1 < MEMORY_CATEGORY_COUNT ? ", " : " } }");
+		return out.str();
+	}
+
+	// uncompressed images only, compressed ones are recorded with the size of their data
+	static size_t textureBytes(GLenum internalFormat, int width, int height, int depth = 1, int levels = 1)
+	{
+		size_t texel = texelBytes(internalFormat), sum = 0;
+		for (int i = 0; i < levels; i++)
+			sum += (size_t)std::max(1, width >> i) * std::max(1, height >> i) * depth * texel;
+		return sum;
+	}
+
+	// levels of a full mipmap chain
+	static int mipLevels(int width, int height)
+	{
+		int levels = 1;
+		while ((width | height) >> levels)
+			levels++;
+		return levels;
+	}
+
+	static size_t texelBytes(GLenum internalFormat)
+	{
+		switch (internalFormat)
+		{
+		case GL_R8: case GL_RED: return 1;
+		case GL_RG8: case GL_R16F: return 2;
+		case GL_RGB32F: case GL_RGBA32F: return 16;
+		case GL_RGB16F: case GL_RGBA16F: case GL_RG32F: case GL_DEPTH32F_STENCIL8: return 8;
+		default: return 4;	// 8 bit RGB(A) (RGB is padded), packed floats, depth
+		}
+	}
+
+	static const char *formatName(GLenum format)
+	{
+		switch (format)
+		{
+		case GL_RGB: case GL_RGB8: return "RGB8";
+		case GL_RGBA: case GL_RGBA8: return "RGBA8";
+		case GL_RGB16F: return "RGB16F";
+		case GL_RGBA16F: return "RGBA16F";
+		case GL_RG32F: return "RG32F";
+		case GL_R11F_G11F_B10F: return "R11F_G11F_B10F";
+		case GL_RGB9_E5: return "RGB9_E5";
+		case GL_DEPTH_COMPONENT: return "DEPTH";
+		case GL_DEPTH24_STENCIL8: return "DEPTH24_STENCIL8";
+		case GL_STATIC_DRAW: return "static";
+		case GL_DYNAMIC_DRAW: return "dynamic";
+		case GL_STREAM_DRAW: return "stream";
+		case GL_STREAM_READ: return "stream_read";
+		default: return "compressed";
+		}
+	}
+
+private:
+	typedef std::pair<int, GLuint> Key;
+
+	mutable std::mutex mutex;
+	std::map<Key, MemoryAllocation> allocations;
+	size_t current[MEMORY_CATEGORY_COUNT];
+	size_t peak[MEMORY_CATEGORY_COUNT];
+	size_t gpuPeak;
+
+	void add(MemoryCategory category, size_t bytes)
+	{
+		current[category] += bytes;
+		peak[category] = std::max(peak[category], current[category]);
+		size_t gpu = 0;
+		for (int i = 0; i < MEMORY_CPU_MESHES; i++)
+			gpu += current[i];
+		gpuPeak = std::max(gpuPeak, gpu);
+	}
+
+	void remove(int type, GLuint id)
+	{
+		std::map<Key, MemoryAllocation>::iterator it = allocations.find(std::make_pair(type, id));
+		if (it == allocations.end())
+			return;
+		current[it->second.category] -= it->second.bytes;
+		allocations.erase(it);
+	}
+
+	static bool largerFirst(const MemoryAllocation *a, const MemoryAllocation *b) { return a->bytes > b->bytes; }
+
+	static double megabytes(size_t bytes) { return (double)bytes / (1024.0 * 1024.0); }
+};
+
+#endif
@@ -0,0 +1,111 @@
+#ifndef MESH_FORMAT_H
+#define MESH_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// On-disk layout of the binary mesh cache (see cached_model.h):
+//   MeshCacheHeader
+//   MeshCacheMesh[meshCount]
+//   MeshCacheMaterial[materialCount]
+//   MeshCacheTexture[textureCount]
+//   MeshCacheLod[lodCount]
+//   vertex data (16 byte aligned), then index data (every LOD of a mesh after each other)
+
+const uint32_t MESH_CACHE_MAGIC = 0x4853454d; // "MESH"
+const uint32_t MESH_CACHE_VERSION = 5;
+const int MESH_CACHE_MAX_LODS = 4; // LOD 0 plus up to three simplified levels
+
+struct MeshCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t sourceHash;
+	uint32_t meshCount;
+	uint32_t materialCount;
+	uint32_t textureCount;
+	uint32_t lodCount;
+};
+
+struct MeshCacheMesh {
+	uint64_t vertexOffset;
+	uint64_t indexOffset;
+	uint32_t vertexCount;
+	uint32_t indexCount;	// all LODs
+	uint32_t material;
+	float boundsMin[3];		// object space AABB of the vertices, used for culling
+	float boundsMax[3];
+	uint32_t firstLod;
+	uint32_t lodCount;
+	uint32_t pad;
+};
+
+struct MeshCacheMaterial {
+	uint32_t firstTexture;
+	uint32_t textureCount;
+};
+
+// index range of one LOD inside the index data of its mesh
+struct MeshCacheLod {
+	uint32_t firstIndex;
+	uint32_t indexCount;
+	float error;			// object space distance the simplification may have moved the surface
+	uint32_t pad;
+};
+
+struct MeshCacheTexture {
+	char type[32];
+	char path[224];
+};
+
+// matches the attribute locations of object.vs
+struct MeshCacheVertex {
+	float position[3];
+	float normal[3];
+	float texCoords[2];
+	float tangent[3];
+	float bitangent[3];
+};
+
+static_assert(sizeof(MeshCacheHeader) == 32, "mesh cache layout");
+static_assert(sizeof(MeshCacheMesh) == 64, "mesh cache layout");
+static_assert(sizeof(MeshCacheLod) == 16, "mesh cache layout");
+static_assert(sizeof(MeshCacheVertex) == 14 * sizeof(float), "mesh cache layout");
+
+// FNV-1a
+inline uint64_t hashBytes(const unsigned char *data, size_t size, uint64_t hash = 14695981039346656037ULL)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// in-memory result of an import, written out as a cache file
+struct ImportedTexture {
+	std::string type;
+	std::string path;
+};
+
+// simplified index list over the vertices of the mesh
+struct ImportedLod {
+	std::vector<uint32_t> indices;
+	float error;
+};
+
+struct ImportedMesh {
+	std::vector<MeshCacheVertex> vertices;
+	std::vector<uint32_t> indices;	// LOD 0
+	std::vector<ImportedLod> lods;	// LOD 1, 2, ...
+	uint32_t material;
+};
+
+struct ImportedModel {
+	std::vector<ImportedMesh> meshes;
+	std::vector<std::vector<ImportedTexture> > materials;
+};
+
+#endif
@@ -0,0 +1,441 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include "mesh_format.h"
+#include "parallel_for.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <queue>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Builds the LOD chain stored in the mesh cache: quadric error edge collapse (Garland-Heckbert)
+// on the welded positions, one run per mesh that takes a snapshot every time the triangle
+// count halves. A level also ends when the next collapse would move the surface further
+// than its error limit: LOD_BASE_ERROR of the model radius for LOD 1, four times that for
+// every further level, so the levels of all meshes of a model mean the same on screen.
+//
+// Vertices only ever collapse onto an existing vertex, so every LOD is an index list over
+// the vertex buffer of LOD 0. Where the attributes split (UV or normal seams) a position has
+// several vertices; it may only collapse along an edge whose two triangles carry all of them,
+// i.e. along the seam, and each side of the seam is remapped to the vertex of the same side.
+// Seams and open borders also get constraint planes, so they keep their shape.
+class MeshSimplifier
+{
+public:
+	static constexpr float LOD_BASE_ERROR = 0.005f;
+
+	static void generateLods(ImportedModel &model, unsigned int threads = 0)
+	{
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		float min[3] = { INFINITY, INFINITY, INFINITY }, max[3] = { -INFINITY, -INFINITY, -INFINITY };
+		for (size_t i = 0; i < model.meshes.size(); i++)
+		{
+			for (size_t v = 0; v < model.meshes[i].vertices.size(); v++)
+			{
+				for (int k = 0; k < 3; k++)
+				{
+					min[k] = std::min(min[k], model.meshes[i].vertices[v].position[k]);
+					max[k] = std::max(max[k], model.meshes[i].vertices[v].position[k]);
+				}
+			}
+		}
+		float radius = 0.0f;
+		for (int k = 0; k < 3 && min[0] <= max[0]; k++)
+			radius += 0.25f * (max[k] - min[k]) * (max[k] - min[k]);
+		radius = std::sqrt(radius);
+		parallelFor(model.meshes.size(), threads, [&](size_t i) { generateLods(model.meshes[i], radius * LOD_BASE_ERROR); });
+	}
+
+	// fills mesh.lods with up to MESH_CACHE_MAX_LODS - 1 coarser index lists
+	static void generateLods(ImportedMesh &mesh, float baseError)
+	{
+		mesh.lods.clear();
+		if (mesh.indices.size() < 3)
+			return;
+		MeshSimplifier simplifier(mesh.vertices, mesh.indices);
+		size_t triangles = mesh.indices.size() / 3;
+		double maxError = baseError;
+		for (int level = 1; level < MESH_CACHE_MAX_LODS; level++, maxError *= 4.0)
+		{
+			simplifier.run(triangles >> level, maxError * maxError);
+			// stop when a level would save less than a quarter of the one before
+			size_t previous = level == 1 ? triangles : mesh.lods.back().indices.size() / 3;
+			if (simplifier.liveTriangles * 4 > previous * 3 || simplifier.liveTriangles == 0)
+				break;
+			ImportedLod lod;
+			lod.error = (float)std::sqrt(simplifier.maxCost);
+			simplifier.snapshot(lod.indices);
+			mesh.lods.push_back(lod);
+		}
+	}
+
+private:
+	// sum of squared distances to a set of planes, symmetric 4x4
+	struct Quadric {
+		double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+		Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+		Quadric(double a, double b, double c, double d, double weight)
+			: a2(a * a * weight), ab(a * b * weight), ac(a * c * weight), ad(a * d * weight), b2(b * b * weight),
+			bc(b * c * weight), bd(b * d * weight), c2(c * c * weight), cd(c * d * weight), d2(d * d * weight) {}
+
+		Quadric &operator+=(const Quadric &q)
+		{
+			a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad; b2 += q.b2;
+			bc += q.bc; bd += q.bd; c2 += q.c2; cd += q.cd; d2 += q.d2;
+			return *this;
+		}
+
+		double error(const float *p) const
+		{
+			double x = p[0], y = p[1], z = p[2];
+			return a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+				+ b2 * y * y + 2 * bc * y * z + 2 * bd * y
+				+ c2 * z * z + 2 * cd * z + d2;
+		}
+	};
+
+	struct Collapse {
+		double cost;
+		uint32_t from, to;
+		uint32_t fromVersion, toVersion;
+
+		bool operator<(const Collapse &other) const { return cost > other.cost; } // cheapest first
+	};
+
+	// weight of the seam and border planes against the face planes
+	static constexpr double CONSTRAINT_WEIGHT = 10.0;
+
+	const std::vector<MeshCacheVertex> &vertices;
+	std::vector<uint32_t> corners;					// 3 vertex indices per triangle
+	std::vector<unsigned char> alive;				// per triangle
+	std::vector<uint32_t> position;					// vertex -> welded position
+	std::vector<const float *> coords;				// position -> coordinates
+	std::vector<std::vector<uint32_t> > triangles;	// position -> triangles using it
+	std::vector<Quadric> quadrics;
+	std::vector<uint32_t> version;					// bumped whenever the position changes
+	std::vector<unsigned char> removed, border, locked;
+	std::priority_queue<Collapse> queue;
+	size_t liveTriangles;
+	double maxCost;
+
+	MeshSimplifier(const std::vector<MeshCacheVertex> &vertices, const std::vector<uint32_t> &indices)
+		: vertices(vertices), corners(indices), alive(indices.size() / 3, 1), liveTriangles(indices.size() / 3), maxCost(0.0)
+	{
+		weld();
+		size_t positionCount = coords.size();
+		triangles.resize(positionCount);
+		quadrics.resize(positionCount);
+		version.assign(positionCount, 0);
+		removed.assign(positionCount, 0);
+		border.assign(positionCount, 0);
+		locked.assign(positionCount, 0);
+
+		for (uint32_t t = 0; t < alive.size(); t++)
+		{
+			double n[3], d;
+			if (!plane(t, n, d)) // no area, dropped from every LOD
+			{
+				alive[t] = 0;
+				liveTriangles--;
+				continue;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				triangles[pos(t, k)].push_back(t);
+				quadrics[pos(t, k)] += Quadric(n[0], n[1], n[2], d, 1.0);
+			}
+		}
+		classifyEdges();
+
+		for (uint32_t t = 0; t < alive.size(); t++)
+		{
+			if (!alive[t])
+				continue;
+			for (int k = 0; k < 3; k++)
+			{
+				push(pos(t, k), pos(t, (k + 1) % 3));
+				push(pos(t, (k + 1) % 3), pos(t, k));
+			}
+		}
+	}
+
+	uint32_t pos(uint32_t triangle, int corner) const { return position[corners[triangle * 3 + corner]]; }
+
+	// vertices with bitwise equal positions share one position
+	void weld()
+	{
+		std::vector<uint32_t> order(vertices.size());
+		for (uint32_t i = 0; i < order.size(); i++)
+			order[i] = i;
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+			return memcmp(vertices[a].position, vertices[b].position, sizeof(vertices[a].position)) < 0;
+		});
+		position.resize(vertices.size());
+		for (size_t i = 0; i < order.size(); i++)
+		{
+			if (i == 0 || memcmp(vertices[order[i]].position, vertices[order[i - 1]].position, sizeof(vertices[0].position)) != 0)
+				coords.push_back(vertices[order[i]].position);
+			position[order[i]] = (uint32_t)coords.size() - 1;
+		}
+	}
+
+	// unit normal and offset of a triangle, false if it has no area
+	bool plane(uint32_t t, double *n, double &d) const
+	{
+		const float *p0 = coords[pos(t, 0)], *p1 = coords[pos(t, 1)], *p2 = coords[pos(t, 2)];
+		normal(p0, p1, p2, n);
+		double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0.0)
+			return false;
+		n[0] /= length; n[1] /= length; n[2] /= length;
+		d = -(n[0] * p0[0] + n[1] * p0[1] + n[2] * p0[2]);
+		return true;
+	}
+
+	static void normal(const float *p0, const float *p1, const float *p2, double *n)
+	{
+		double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+		double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+
+	// border edges (one triangle) and seams (two triangles with different vertices) get
+	// constraint planes, positions on non-manifold edges are locked
+	void classifyEdges()
+	{
+		std::vector<std::pair<uint64_t, uint32_t> > edges; // (position pair, triangle * 3 + corner)
+		for (uint32_t t = 0; t < alive.size(); t++)
+		{
+			if (!alive[t])
+				continue;
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t a = pos(t, k), b = pos(t, (k + 1) % 3);
+				edges.push_back(std::make_pair((uint64_t)std::min(a, b) << 32 | std::max(a, b), t * 3 + k));
+			}
+		}
+		std::sort(edges.begin(), edges.end());
+		for (size_t i = 0; i < edges.size(); )
+		{
+			size_t end = i + 1;
+			while (end < edges.size() && edges[end].first == edges[i].first)
+				end++;
+			uint32_t a = (uint32_t)(edges[i].first >> 32), b = (uint32_t)edges[i].first;
+			if (end - i > 2)
+			{
+				locked[a] = locked[b] = 1;
+			}
+			else if (end - i == 1)
+			{
+				border[a] = border[b] = 1;
+				constrain(edges[i].second);
+			}
+			else if (!sameVertices(edges[i].second, edges[i + 1].second))
+			{
+				constrain(edges[i].second);
+				constrain(edges[i + 1].second);
+			}
+			i = end;
+		}
+	}
+
+	// the two edges (triangle * 3 + corner) use the same vertex at each end
+	bool sameVertices(uint32_t e0, uint32_t e1) const
+	{
+		uint32_t a0 = corners[e0], b0 = corners[e0 - e0 % 3 + (e0 % 3 + 1) % 3];
+		uint32_t a1 = corners[e1], b1 = corners[e1 - e1 % 3 + (e1 % 3 + 1) % 3];
+		return (a0 == a1 && b0 == b1) || (a0 == b1 && b0 == a1);
+	}
+
+	// plane through the edge, perpendicular to its triangle
+	void constrain(uint32_t edge)
+	{
+		uint32_t t = edge / 3;
+		int k = edge % 3;
+		double n[3], d;
+		if (!plane(t, n, d))
+			return;
+		const float *p0 = coords[pos(t, k)], *p1 = coords[pos(t, (k + 1) % 3)];
+		double e[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+		double m[3] = { e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0] };
+		double length = std::sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+		if (length == 0.0)
+			return;
+		m[0] /= length; m[1] /= length; m[2] /= length;
+		Quadric q(m[0], m[1], m[2], -(m[0] * p0[0] + m[1] * p0[1] + m[2] * p0[2]), CONSTRAINT_WEIGHT);
+		quadrics[pos(t, k)] += q;
+		quadrics[pos(t, (k + 1) % 3)] += q;
+	}
+
+	void push(uint32_t from, uint32_t to)
+	{
+		if (locked[from])
+			return;
+		Quadric q = quadrics[from];
+		q += quadrics[to];
+		Collapse collapse;
+		collapse.cost = std::max(0.0, q.error(coords[to]));
+		collapse.from = from;
+		collapse.to = to;
+		collapse.fromVersion = version[from];
+		collapse.toVersion = version[to];
+		queue.push(collapse);
+	}
+
+	void run(size_t targetTriangles, double costLimit)
+	{
+		while (liveTriangles > targetTriangles && !queue.empty() && queue.top().cost <= costLimit)
+		{
+			Collapse c = queue.top();
+			queue.pop();
+			if (removed[c.from] || removed[c.to] || version[c.from] != c.fromVersion || version[c.to] != c.toVersion)
+				continue;
+			if (collapse(c.from, c.to))
+				maxCost = std::max(maxCost, c.cost);
+		}
+	}
+
+	// move position from onto position to, false if that would break the mesh
+	bool collapse(uint32_t from, uint32_t to)
+	{
+		// vertices at from -> vertices at to, taken from the triangles on the edge
+		std::vector<std::pair<uint32_t, uint32_t> > remap;
+		int edgeTriangles = 0;
+		std::vector<uint32_t> &around = triangles[from];
+		for (size_t i = 0; i < around.size(); i++)
+		{
+			uint32_t t = around[i];
+			int kf = corner(t, from), kt = corner(t, to);
+			if (!alive[t] || kt < 0)
+				continue;
+			edgeTriangles++;
+			uint32_t vf = corners[t * 3 + kf], vt = corners[t * 3 + kt];
+			for (size_t r = 0; r < remap.size(); r++)
+				if (remap[r].first == vf && remap[r].second != vt)
+					return false;
+			remap.push_back(std::make_pair(vf, vt));
+		}
+		if (edgeTriangles == 0 || (border[from] && edgeTriangles != 1))
+			return false;
+
+		// every vertex at from needs a partner, and no remaining triangle may flip
+		for (size_t i = 0; i < around.size(); i++)
+		{
+			uint32_t t = around[i];
+			if (!alive[t] || corner(t, to) >= 0)
+				continue;
+			int kf = corner(t, from);
+			if (target(remap, corners[t * 3 + kf]) == UINT32_MAX)
+				return false;
+			const float *p[3], *q[3];
+			for (int k = 0; k < 3; k++)
+			{
+				p[k] = coords[pos(t, k)];
+				q[k] = k == kf ? coords[to] : p[k];
+			}
+			double before[3], after[3];
+			normal(p[0], p[1], p[2], before);
+			normal(q[0], q[1], q[2], after);
+			if (before[0] * after[0] + before[1] * after[1] + before[2] * after[2] <= 0.0)
+				return false;
+		}
+
+		// link condition: from and to only share the vertices opposite the edge
+		std::vector<uint32_t> ringFrom, ringTo;
+		ring(from, ringFrom);
+		ring(to, ringTo);
+		std::vector<uint32_t> shared;
+		std::set_intersection(ringFrom.begin(), ringFrom.end(), ringTo.begin(), ringTo.end(), std::back_inserter(shared));
+		if ((int)shared.size() > edgeTriangles)
+			return false;
+
+		for (size_t i = 0; i < around.size(); i++)
+		{
+			uint32_t t = around[i];
+			if (!alive[t])
+				continue;
+			if (corner(t, to) >= 0)
+			{
+				alive[t] = 0;
+				liveTriangles--;
+				continue;
+			}
+			int kf = corner(t, from);
+			corners[t * 3 + kf] = target(remap, corners[t * 3 + kf]);
+			triangles[to].push_back(t);
+		}
+		around.clear();
+		std::vector<uint32_t> &kept = triangles[to];
+		kept.erase(std::remove_if(kept.begin(), kept.end(), [&](uint32_t t) { return !alive[t]; }), kept.end());
+
+		quadrics[to] += quadrics[from];
+		removed[from] = 1;
+		version[to]++;
+		for (size_t i = 0; i < kept.size(); i++)
+		{
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t other = pos(kept[i], k);
+				if (other == to)
+					continue;
+				push(other, to);
+				push(to, other);
+			}
+		}
+		return true;
+	}
+
+	int corner(uint32_t t, uint32_t p) const
+	{
+		for (int k = 0; k < 3; k++)
+			if (pos(t, k) == p)
+				return k;
+		return -1;
+	}
+
+	static uint32_t target(const std::vector<std::pair<uint32_t, uint32_t> > &remap, uint32_t vertex)
+	{
+		for (size_t r = 0; r < remap.size(); r++)
+			if (remap[r].first == vertex)
+				return remap[r].second;
+		return UINT32_MAX;
+	}
+
+	// sorted positions sharing a live triangle with p
+	void ring(uint32_t p, std::vector<uint32_t> &out) const
+	{
+		out.clear();
+		for (size_t i = 0; i < triangles[p].size(); i++)
+		{
+			uint32_t t = triangles[p][i];
+			if (!alive[t])
+				continue;
+			for (int k = 0; k < 3; k++)
+				if (pos(t, k) != p)
+					out.push_back(pos(t, k));
+		}
+		std::sort(out.begin(), out.end());
+		out.erase(std::unique(out.begin(), out.end()), out.end());
+	}
+
+	void snapshot(std::vector<uint32_t> &indices) const
+	{
+		indices.clear();
+		for (size_t t = 0; t < alive.size(); t++)
+			if (alive[t])
+				indices.insert(indices.end(), corners.begin() + t * 3, corners.begin() + t * 3 + 3);
+	}
+};
+
+#endif
@@ -0,0 +1,606 @@
+#ifndef OBJ_IMPORTER_H
+#define OBJ_IMPORTER_H
+
+#include "mapped_file.h"
+#include "mesh_format.h"
+#include "parallel_for.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OBJ_IMPORTER_SSE
+#endif
+
+// Multi-threaded Wavefront OBJ/MTL importer, used to build the mesh cache.
+//
+// The file is split into line ranges, one per worker:
+//  1. every range counts its v/vt/vn lines and remembers its last usemtl,
+//  2. after a prefix sum every range parses straight into the shared attribute arrays
+//     and deduplicates its face corners per material into a local table,
+//  3. the local tables are merged per material (one task per material), and the
+//     tangent frames of each mesh are generated 4 faces at a time with SSE.
+// Output matches the Assimp path of model.h: triangulated, V flipped, one mesh per material.
+class ObjImporter
+{
+public:
+	static bool import(const std::string &path, ImportedModel &result, unsigned int threads = 0)
+	{
+		MappedFile file(path);
+		if (!file.valid())
+			return false;
+		std::string directory = path.substr(0, path.find_last_of('/'));
+
+		if (threads == 0)
+			threads = std::max(1u, std::thread::hardware_concurrency());
+		const char *text = (const char *)file.data();
+		std::vector<Chunk> chunks = split(text, text + file.size(), threads);
+
+		parallelFor(chunks.size(), threads, [&](size_t i) { count(chunks[i]); });
+
+		uint32_t positionCount = 0, texCoordCount = 0, normalCount = 0;
+		std::string material;
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			chunks[i].positionBase = positionCount;
+			chunks[i].texCoordBase = texCoordCount;
+			chunks[i].normalBase = normalCount;
+			chunks[i].startMaterial = material;
+			positionCount += chunks[i].positionCount;
+			texCoordCount += chunks[i].texCoordCount;
+			normalCount += chunks[i].normalCount;
+			if (chunks[i].hasMaterial)
+				material = chunks[i].lastMaterial;
+		}
+
+		Attributes attributes;
+		attributes.positions.resize(positionCount * 3);
+		attributes.texCoords.resize(texCoordCount * 2);
+		attributes.normals.resize(normalCount * 3);
+		parallelFor(chunks.size(), threads, [&](size_t i) { parse(chunks[i], attributes); });
+
+		// materials in order of first use
+		std::vector<std::string> names;
+		std::map<std::string, std::vector<Group *> > groups;
+		for (size_t i = 0; i < chunks.size(); i++)
+		{
+			for (size_t g = 0; g < chunks[i].groups.size(); g++)
+			{
+				Group &group = chunks[i].groups[g];
+				if (group.indices.empty())
+					continue;
+				if (groups.find(group.material) == groups.end())
+					names.push_back(group.material);
+				groups[group.material].push_back(&group);
+			}
+		}
+
+		// every chunk sees the mtllib lines of its part of the file, each library is read once
+		std::map<std::string, std::vector<ImportedTexture> > library;
+		std::set<std::string> libraries;
+		for (size_t i = 0; i < chunks.size(); i++)
+			for (size_t m = 0; m < chunks[i].mtllibs.size(); m++)
+				if (libraries.insert(chunks[i].mtllibs[m]).second)
+					loadMaterials(directory + "/" + chunks[i].mtllibs[m], library);
+
+		result.meshes.clear();
+		result.materials.clear();
+		result.meshes.resize(names.size());
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			result.materials.push_back(library[names[i]]);
+			result.meshes[i].material = (uint32_t)i;
+		}
+		parallelFor(names.size(), threads, [&](size_t i) {
+			merge(groups[names[i]], attributes, result.meshes[i]);
+		});
+		return true;
+	}
+
+private:
+	struct Corner {
+		int32_t position, texCoord, normal;
+		bool operator==(const Corner &other) const
+		{
+			return position == other.position && texCoord == other.texCoord && normal == other.normal;
+		}
+	};
+
+	struct CornerHash {
+		size_t operator()(const Corner &c) const
+		{
+			uint64_t h = (uint64_t)(uint32_t)c.position * 0x9E3779B97F4A7C15ULL;
+			h ^= (uint64_t)(uint32_t)c.texCoord * 0xC2B2AE3D27D4EB4FULL + (h << 6) + (h >> 2);
+			h ^= (uint64_t)(uint32_t)c.normal * 0x165667B19E3779F9ULL + (h << 6) + (h >> 2);
+			return (size_t)h;
+		}
+	};
+
+	typedef std::unordered_map<Corner, uint32_t, CornerHash> CornerTable;
+
+	// faces of one material inside one chunk, indices point into corners
+	struct Group {
+		std::string material;
+		std::vector<Corner> corners;
+		std::vector<uint32_t> indices;
+		CornerTable lookup;
+	};
+
+	struct Chunk {
+		const char *begin, *end;
+		uint32_t positionCount, texCoordCount, normalCount;
+		bool hasMaterial;
+		std::string lastMaterial;
+		std::vector<std::string> mtllibs;
+
+		uint32_t positionBase, texCoordBase, normalBase;
+		std::string startMaterial;
+		std::vector<Group> groups;
+	};
+
+	struct Attributes {
+		std::vector<float> positions;
+		std::vector<float> texCoords;
+		std::vector<float> normals;
+	};
+
+	static std::vector<Chunk> split(const char *begin, const char *end, unsigned int threads)
+	{
+		const size_t minChunk = 256 * 1024;
+		size_t size = end - begin;
+		size_t count = std::max<size_t>(1, std::min<size_t>(threads * 4, size / minChunk));
+		std::vector<Chunk> chunks;
+		const char *start = begin;
+		for (size_t i = 1; i <= count && start < end; i++)
+		{
+			const char *stop = i == count ? end : begin + size * i / count;
+			if (stop < start)
+				stop = start;
+			while (stop < end && *stop != '\n')
+				stop++;
+			if (stop < end)
+				stop++;
+			Chunk chunk = Chunk();
+			chunk.begin = start;
+			chunk.end = stop;
+			chunks.push_back(chunk);
+			start = stop;
+		}
+		return chunks;
+	}
+
+	static const char *lineEnd(const char *p, const char *end)
+	{
+		const char *n = (const char *)memchr(p, '\n', end - p);
+		return n ? n : end;
+	}
+
+	static const char *skipSpaces(const char *p, const char *end)
+	{
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		return p;
+	}
+
+	static bool startsWith(const char *p, const char *end, const char *keyword)
+	{
+		size_t n = strlen(keyword);
+		return (size_t)(end - p) > n && memcmp(p, keyword, n) == 0 && (p[n] == ' ' || p[n] == '\t');
+	}
+
+	static std::string restOfLine(const char *p, const char *end)
+	{
+		p = skipSpaces(p, end);
+		while (end > p && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t'))
+			end--;
+		return std::string(p, end);
+	}
+
+	static const char *parseFloat(const char *p, const char *end, float &out)
+	{
+		p = skipSpaces(p, end);
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+			negative = *p++ == '-';
+		double value = 0.0;
+		while (p < end && *p >= '0' && *p <= '9')
+			value = value * 10.0 + (*p++ - '0');
+		if (p < end && *p == '.')
+		{
+			p++;
+			double scale = 0.1;
+			while (p < end && *p >= '0' && *p <= '9')
+			{
+				value += (*p++ - '0') * scale;
+				scale *= 0.1;
+			}
+		}
+		if (p < end && (*p == 'e' || *p == 'E'))
+		{
+			p++;
+			bool negativeExponent = false;
+			if (p < end && (*p == '-' || *p == '+'))
+				negativeExponent = *p++ == '-';
+			int exponent = 0;
+			while (p < end && *p >= '0' && *p <= '9')
+				exponent = exponent * 10 + (*p++ - '0');
+			value *= std::pow(10.0, negativeExponent ? -exponent : exponent);
+		}
+		out = (float)(negative ? -value : value);
+		return p;
+	}
+
+	static const char *parseIndex(const char *p, const char *end, int &out)
+	{
+		bool negative = false;
+		if (p < end && *p == '-')
+		{
+			negative = true;
+			p++;
+		}
+		int value = 0;
+		while (p < end && *p >= '0' && *p <= '9')
+			value = value * 10 + (*p++ - '0');
+		out = negative ? -value : value;
+		return p;
+	}
+
+	// OBJ indices are 1-based, negative ones count back from the current element
+	static int32_t resolve(int index, uint32_t count)
+	{
+		if (index > 0)
+			return index - 1;
+		if (index < 0)
+			return (int32_t)count + index;
+		return -1;
+	}
+
+	static void count(Chunk &chunk)
+	{
+		for (const char *p = chunk.begin; p < chunk.end; )
+		{
+			const char *end = lineEnd(p, chunk.end);
+			const char *s = skipSpaces(p, end);
+			if (startsWith(s, end, "v"))
+				chunk.positionCount++;
+			else if (startsWith(s, end, "vt"))
+				chunk.texCoordCount++;
+			else if (startsWith(s, end, "vn"))
+				chunk.normalCount++;
+			else if (startsWith(s, end, "usemtl"))
+			{
+				chunk.hasMaterial = true;
+				chunk.lastMaterial = restOfLine(s + 6, end);
+			}
+			else if (startsWith(s, end, "mtllib"))
+				chunk.mtllibs.push_back(restOfLine(s + 6, end));
+			p = end + 1;
+		}
+	}
+
+	static size_t group(Chunk &chunk, const std::string &material)
+	{
+		for (size_t i = 0; i < chunk.groups.size(); i++)
+			if (chunk.groups[i].material == material)
+				return i;
+		chunk.groups.push_back(Group());
+		chunk.groups.back().material = material;
+		return chunk.groups.size() - 1;
+	}
+
+	static void parse(Chunk &chunk, Attributes &attributes)
+	{
+		uint32_t positions = chunk.positionBase, texCoords = chunk.texCoordBase, normals = chunk.normalBase;
+		size_t current = group(chunk, chunk.startMaterial);
+		std::vector<Corner> face;
+		for (const char *p = chunk.begin; p < chunk.end; )
+		{
+			const char *end = lineEnd(p, chunk.end);
+			const char *s = skipSpaces(p, end);
+			if (startsWith(s, end, "v"))
+			{
+				float *v = &attributes.positions[positions++ * 3];
+				s = parseFloat(s + 1, end, v[0]);
+				s = parseFloat(s, end, v[1]);
+				parseFloat(s, end, v[2]);
+			}
+			else if (startsWith(s, end, "vt"))
+			{
+				float *v = &attributes.texCoords[texCoords++ * 2];
+				s = parseFloat(s + 2, end, v[0]);
+				parseFloat(s, end, v[1]);
+				v[1] = 1.0f - v[1]; // same as aiProcess_FlipUVs
+			}
+			else if (startsWith(s, end, "vn"))
+			{
+				float *v = &attributes.normals[normals++ * 3];
+				s = parseFloat(s + 2, end, v[0]);
+				s = parseFloat(s, end, v[1]);
+				parseFloat(s, end, v[2]);
+			}
+			else if (startsWith(s, end, "usemtl"))
+			{
+				current = group(chunk, restOfLine(s + 6, end));
+			}
+			else if (startsWith(s, end, "f"))
+			{
+				face.clear();
+				s = skipSpaces(s + 1, end);
+				while (s < end && *s != '\r')
+				{
+					int v = 0, vt = 0, vn = 0;
+					const char *start = s;
+					s = parseIndex(s, end, v);
+					if (s == start)
+						break;
+					if (s < end && *s == '/')
+					{
+						s++;
+						if (s < end && *s != '/')
+							s = parseIndex(s, end, vt);
+						if (s < end && *s == '/')
+							s = parseIndex(s + 1, end, vn);
+					}
+					Corner corner = { resolve(v, positions), resolve(vt, texCoords), resolve(vn, normals) };
+					face.push_back(corner);
+					s = skipSpaces(s, end);
+				}
+				// triangle fan, like aiProcess_Triangulate for convex polygons
+				Group &faces = chunk.groups[current];
+				for (size_t i = 2; i < face.size(); i++)
+				{
+					add(faces, face[0]);
+					add(faces, face[i - 1]);
+					add(faces, face[i]);
+				}
+			}
+			p = end + 1;
+		}
+	}
+
+	static void add(Group &group, const Corner &corner)
+	{
+		std::pair<CornerTable::iterator, bool> inserted = group.lookup.insert(std::make_pair(corner, (uint32_t)group.corners.size()));
+		if (inserted.second)
+			group.corners.push_back(corner);
+		group.indices.push_back(inserted.first->second);
+	}
+
+	static void merge(const std::vector<Group *> &parts, const Attributes &attributes, ImportedMesh &mesh)
+	{
+		std::vector<Corner> corners;
+		if (parts.size() == 1)
+		{
+			corners.swap(parts[0]->corners);
+			mesh.indices.swap(parts[0]->indices);
+		}
+		else
+		{
+			CornerTable lookup;
+			for (size_t i = 0; i < parts.size(); i++)
+			{
+				std::vector<uint32_t> remap(parts[i]->corners.size());
+				for (size_t c = 0; c < parts[i]->corners.size(); c++)
+				{
+					std::pair<CornerTable::iterator, bool> inserted = lookup.insert(std::make_pair(parts[i]->corners[c], (uint32_t)corners.size()));
+					if (inserted.second)
+						corners.push_back(parts[i]->corners[c]);
+					remap[c] = inserted.first->second;
+				}
+				for (size_t k = 0; k < parts[i]->indices.size(); k++)
+					mesh.indices.push_back(remap[parts[i]->indices[k]]);
+			}
+		}
+
+		bool hasNormals = true;
+		mesh.vertices.resize(corners.size());
+		for (size_t i = 0; i < corners.size(); i++)
+		{
+			MeshCacheVertex &vertex = mesh.vertices[i];
+			memset(&vertex, 0, sizeof(vertex));
+			const Corner &c = corners[i];
+			if (c.position >= 0 && (size_t)c.position * 3 < attributes.positions.size())
+				memcpy(vertex.position, &attributes.positions[c.position * 3], 3 * sizeof(float));
+			if (c.texCoord >= 0 && (size_t)c.texCoord * 2 < attributes.texCoords.size())
+				memcpy(vertex.texCoords, &attributes.texCoords[c.texCoord * 2], 2 * sizeof(float));
+			if (c.normal >= 0 && (size_t)c.normal * 3 < attributes.normals.size())
+				memcpy(vertex.normal, &attributes.normals[c.normal * 3], 3 * sizeof(float));
+			else
+				hasNormals = false;
+		}
+		generateTangents(mesh.vertices, mesh.indices, !hasNormals);
+	}
+
+	static void accumulate(MeshCacheVertex &v, const float t[3], const float b[3], const float n[3], bool normals)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			v.tangent[k] += t[k];
+			v.bitangent[k] += b[k];
+			if (normals)
+				v.normal[k] += n[k];
+		}
+	}
+
+	static void faceFrame(const MeshCacheVertex &a, const MeshCacheVertex &b, const MeshCacheVertex &c, float t[3], float bt[3], float n[3])
+	{
+		float e1[3], e2[3];
+		for (int k = 0; k < 3; k++)
+		{
+			e1[k] = b.position[k] - a.position[k];
+			e2[k] = c.position[k] - a.position[k];
+		}
+		float du1 = b.texCoords[0] - a.texCoords[0], dv1 = b.texCoords[1] - a.texCoords[1];
+		float du2 = c.texCoords[0] - a.texCoords[0], dv2 = c.texCoords[1] - a.texCoords[1];
+		float det = du1 * dv2 - du2 * dv1;
+		float r = det != 0.0f ? 1.0f / det : 0.0f;
+		for (int k = 0; k < 3; k++)
+		{
+			t[k] = (e1[k] * dv2 - e2[k] * dv1) * r;
+			bt[k] = (e2[k] * du1 - e1[k] * du2) * r;
+		}
+		n[0] = e1[1] * e2[2] - e1[2] * e2[1];
+		n[1] = e1[2] * e2[0] - e1[0] * e2[2];
+		n[2] = e1[0] * e2[1] - e1[1] * e2[0];
+	}
+
+	// per-face tangent/bitangent accumulated on the vertices, then Gram-Schmidt against the normal
+	static void generateTangents(std::vector<MeshCacheVertex> &vertices, const std::vector<uint32_t> &indices, bool generateNormals)
+	{
+		// the face normals replace whatever normals part of the mesh came with
+		if (generateNormals)
+		{
+			for (size_t i = 0; i < vertices.size(); i++)
+				memset(vertices[i].normal, 0, sizeof(vertices[i].normal));
+		}
+		size_t faces = indices.size() / 3;
+		size_t f = 0;
+#ifdef OBJ_IMPORTER_SSE
+		for (; f + 4 <= faces; f += 4)
+		{
+			const MeshCacheVertex *a[4], *b[4], *c[4];
+			for (int k = 0; k < 4; k++)
+			{
+				a[k] = &vertices[indices[(f + k) * 3]];
+				b[k] = &vertices[indices[(f + k) * 3 + 1]];
+				c[k] = &vertices[indices[(f + k) * 3 + 2]];
+			}
+			__m128 e1[3], e2[3];
+			for (int d = 0; d < 3; d++)
+			{
+				__m128 pa = _mm_setr_ps(a[0]->position[d], a[1]->position[d], a[2]->position[d], a[3]->position[d]);
+				e1[d] = _mm_sub_ps(_mm_setr_ps(b[0]->position[d], b[1]->position[d], b[2]->position[d], b[3]->position[d]), pa);
+				e2[d] = _mm_sub_ps(_mm_setr_ps(c[0]->position[d], c[1]->position[d], c[2]->position[d], c[3]->position[d]), pa);
+			}
+			__m128 ua = _mm_setr_ps(a[0]->texCoords[0], a[1]->texCoords[0], a[2]->texCoords[0], a[3]->texCoords[0]);
+			__m128 va = _mm_setr_ps(a[0]->texCoords[1], a[1]->texCoords[1], a[2]->texCoords[1], a[3]->texCoords[1]);
+			__m128 du1 = _mm_sub_ps(_mm_setr_ps(b[0]->texCoords[0], b[1]->texCoords[0], b[2]->texCoords[0], b[3]->texCoords[0]), ua);
+			__m128 dv1 = _mm_sub_ps(_mm_setr_ps(b[0]->texCoords[1], b[1]->texCoords[1], b[2]->texCoords[1], b[3]->texCoords[1]), va);
+			__m128 du2 = _mm_sub_ps(_mm_setr_ps(c[0]->texCoords[0], c[1]->texCoords[0], c[2]->texCoords[0], c[3]->texCoords[0]), ua);
+			__m128 dv2 = _mm_sub_ps(_mm_setr_ps(c[0]->texCoords[1], c[1]->texCoords[1], c[2]->texCoords[1], c[3]->texCoords[1]), va);
+
+			// degenerate UVs get a zero frame instead of inf
+			__m128 det = _mm_sub_ps(_mm_mul_ps(du1, dv2), _mm_mul_ps(du2, dv1));
+			__m128 valid = _mm_cmpneq_ps(det, _mm_setzero_ps());
+			__m128 r = _mm_and_ps(valid, _mm_div_ps(_mm_set1_ps(1.0f), det));
+
+			float t[3][4], bt[3][4], n[3][4];
+			for (int d = 0; d < 3; d++)
+			{
+				_mm_storeu_ps(t[d], _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e1[d], dv2), _mm_mul_ps(e2[d], dv1)), r));
+				_mm_storeu_ps(bt[d], _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(e2[d], du1), _mm_mul_ps(e1[d], du2)), r));
+			}
+			_mm_storeu_ps(n[0], _mm_sub_ps(_mm_mul_ps(e1[1], e2[2]), _mm_mul_ps(e1[2], e2[1])));
+			_mm_storeu_ps(n[1], _mm_sub_ps(_mm_mul_ps(e1[2], e2[0]), _mm_mul_ps(e1[0], e2[2])));
+			_mm_storeu_ps(n[2], _mm_sub_ps(_mm_mul_ps(e1[0], e2[1]), _mm_mul_ps(e1[1], e2[0])));
+
+			for (int k = 0; k < 4; k++)
+			{
+				float tk[3] = { t[0][k], t[1][k], t[2][k] };
+				float bk[3] = { bt[0][k], bt[1][k], bt[2][k] };
+				float nk[3] = { n[0][k], n[1][k], n[2][k] };
+				for (int corner = 0; corner < 3; corner++)
+					accumulate(vertices[indices[(f + k) * 3 + corner]], tk, bk, nk, generateNormals);
+			}
+		}
+#endif
+		for (; f < faces; f++)
+		{
+			float t[3], bt[3], n[3];
+			faceFrame(vertices[indices[f * 3]], vertices[indices[f * 3 + 1]], vertices[indices[f * 3 + 2]], t, bt, n);
+			for (int corner = 0; corner < 3; corner++)
+				accumulate(vertices[indices[f * 3 + corner]], t, bt, n, generateNormals);
+		}
+
+		for (size_t i = 0; i < vertices.size(); i++)
+		{
+			MeshCacheVertex &v = vertices[i];
+			normalize(v.normal);
+			orthogonalize(v.tangent, v.normal);
+			orthogonalize(v.bitangent, v.normal);
+		}
+	}
+
+	static void normalize(float v[3])
+	{
+		float length = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		if (length > 0.0f)
+			for (int k = 0; k < 3; k++)
+				v[k] /= length;
+	}
+
+	static void orthogonalize(float v[3], const float n[3])
+	{
+		float d = v[0] * n[0] + v[1] * n[1] + v[2] * n[2];
+		for (int k = 0; k < 3; k++)
+			v[k] -= n[k] * d;
+		normalize(v);
+	}
+
+	// texture types follow model.h: map_Kd -> diffuse, map_Ks -> specular,
+	// map_bump -> normal, map_Ka -> height; a material defined again replaces the earlier one
+	static void loadMaterials(const std::string &path, std::map<std::string, std::vector<ImportedTexture> > &library)
+	{
+		MappedFile file(path);
+		if (!file.valid())
+			return;
+		const char *text = (const char *)file.data();
+		const char *fileEnd = text + file.size();
+		std::string name;
+		std::map<std::string, std::vector<ImportedTexture> > slots[4];
+		const char *types[4] = { "texture_diffuse", "texture_specular", "texture_normal", "texture_height" };
+		for (const char *p = text; p < fileEnd; )
+		{
+			const char *end = lineEnd(p, fileEnd);
+			const char *s = skipSpaces(p, end);
+			int slot = -1;
+			const char *arg = NULL;
+			if (startsWith(s, end, "newmtl"))
+			{
+				name = restOfLine(s + 6, end);
+				library[name].clear();
+				for (int i = 0; i < 4; i++)
+					slots[i].erase(name);
+			}
+			else if (startsWith(s, end, "map_Kd"))
+				slot = 0, arg = s + 6;
+			else if (startsWith(s, end, "map_Ks"))
+				slot = 1, arg = s + 6;
+			else if (startsWith(s, end, "map_bump") || startsWith(s, end, "map_Bump"))
+				slot = 2, arg = s + 8;
+			else if (startsWith(s, end, "bump"))
+				slot = 2, arg = s + 4;
+			else if (startsWith(s, end, "map_Ka"))
+				slot = 3, arg = s + 6;
+			if (slot >= 0)
+			{
+				// options such as "-bm 0.3" come first, the file name is the last token
+				std::string rest = restOfLine(arg, end);
+				size_t space = rest.find_last_of(" \t");
+				ImportedTexture texture;
+				texture.type = types[slot];
+				texture.path = space == std::string::npos ? rest : rest.substr(space + 1);
+				slots[slot][name].push_back(texture);
+			}
+			p = end + 1;
+		}
+		for (int slot = 0; slot < 4; slot++)
+		{
+			std::map<std::string, std::vector<ImportedTexture> >::iterator it;
+			for (it = slots[slot].begin(); it != slots[slot].end(); ++it)
+				library[it->first].insert(library[it->first].end(), it->second.begin(), it->second.end());
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,465 @@
+#ifndef OCEAN_H
+#define OCEAN_H
+
+#include <glad/glad.h>
+#include "fft2d.h"
+#include "gpu_resources.h"
+#include "parallel_for.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Spectral ocean after Tessendorf: a Phillips spectrum of random wave amplitudes is
+// advanced in time every frame and transformed with inverse FFTs (fft2d.h) into a tiling
+// height field with horizontal (choppy) displacement and its slopes. Three transforms per
+// frame, each carrying two real fields: height + i slope x, displacement x + i displacement z,
+// and slope z. OceanSurface runs the simulation of the next frame on its own thread while the
+// current one renders and uploads the results to one of two texture pairs. The rows and the
+// FFT passes are spread over the persistent parallelFor pool, no threads are started per frame.
+
+struct OceanSettings {
+	int size;			// FFT grid, a power of two in [64, 512]
+	float patchSize;	// world units covered by one repeat of the maps
+	float windSpeed;	// in world units per second
+	float windX, windZ;
+	float waveHeight;	// RMS height of the surface
+	float choppiness;	// scale of the horizontal displacement
+
+	OceanSettings() : size(128), patchSize(20.0f), windSpeed(4.5f), windX(1.0f), windZ(0.4f), waveHeight(0.01f), choppiness(1.0f) {}
+};
+
+const float OCEAN_GRAVITY = 9.81f;
+
+// CPU side of the ocean, no GL
+class OceanSimulation
+{
+public:
+	OceanSimulation(const OceanSettings &settings, unsigned int threads)
+		: settings(settings), n(settings.size), threads(std::max(1u, threads)), fft(settings.size),
+		fftMs(0.0), simulateMs(0.0)
+	{
+		size_t cells = (size_t)n * n;
+		h0.resize(cells * 2);
+		h0Conjugate.resize(cells * 2);
+		omega.resize(cells);
+		waveX.resize(cells);
+		waveZ.resize(cells);
+		data.resize(cells * 12);
+		for (int i = 0; i < 3; i++)
+		{
+			ComplexPlane plane = { &data[cells * (i * 2)], &data[cells * (i * 2 + 1)] };
+			ComplexPlane result = { &data[cells * (6 + i * 2)], &data[cells * (7 + i * 2)] };
+			planes.push_back(plane);
+			scratch.push_back(result);
+		}
+		displacementMap.resize(cells * 4);
+		normalMap.resize(cells * 4);
+		initSpectrum();
+	}
+
+	int size() const { return n; }
+
+	// surface at time seconds into displacement() and normals()
+	void simulate(float time)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		size_t rows = (size_t)n;
+		parallelFor(rows, threads, [&](size_t row) {
+			for (int x = 0; x < n; x++)
+			{
+				size_t i = row * n + x;
+				float c = std::cos(omega[i] * time), s = std::sin(omega[i] * time);
+				// h0(k) e^(iwt) + conj(h0(-k)) e^(-iwt)
+				float hr = h0[i * 2] * c - h0[i * 2 + 1] * s + h0Conjugate[i * 2] * c + h0Conjugate[i * 2 + 1] * s;
+				float hi = h0[i * 2] * s + h0[i * 2 + 1] * c + h0Conjugate[i * 2 + 1] * c - h0Conjugate[i * 2] * s;
+				float kx = waveX[i], kz = waveZ[i];
+				float k = std::sqrt(kx * kx + kz * kz);
+				float dx = k > 0.0f ? kx / k : 0.0f, dz = k > 0.0f ? kz / k : 0.0f;
+				// h + i (i kx h) = h - kx h, both transforms are real
+				planes[0].re[i] = hr - kx * hr;
+				planes[0].im[i] = hi - kx * hi;
+				// -i kx/k h + i (-i kz/k h)
+				planes[1].re[i] = dx * hi + dz * hr;
+				planes[1].im[i] = dz * hi - dx * hr;
+				// i kz h
+				planes[2].re[i] = -kz * hi;
+				planes[2].im[i] = kz * hr;
+			}
+		});
+
+		std::chrono::steady_clock::time_point transform = std::chrono::steady_clock::now();
+		fft.inverse(planes, scratch, threads);
+		std::chrono::steady_clock::time_point transformed = std::chrono::steady_clock::now();
+
+		// the spectrum is centred on k = 0, which flips the sign of every other texel
+		float chop = settings.choppiness;
+		parallelFor(rows, threads, [&](size_t row) {
+			for (int x = 0; x < n; x++)
+			{
+				size_t from = (size_t)x * n + row, to = (row * n + x) * 4;
+				float sign = ((x + row) & 1) ? -1.0f : 1.0f;
+				displacementMap[to + 0] = sign * scratch[1].re[from] * chop;
+				displacementMap[to + 1] = sign * scratch[0].re[from];
+				displacementMap[to + 2] = sign * scratch[1].im[from] * chop;
+				displacementMap[to + 3] = 0.0f;
+				float sx = sign * scratch[0].im[from], sz = sign * scratch[2].re[from];
+				float length = std::sqrt(sx * sx + 1.0f + sz * sz);
+				normalMap[to + 0] = toByte(-sx / length);
+				normalMap[to + 1] = toByte(1.0f / length);
+				normalMap[to + 2] = toByte(-sz / length);
+				normalMap[to + 3] = 255;
+			}
+		});
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+		fftMs = std::chrono::duration<double, std::milli>(transformed - transform).count();
+		simulateMs = std::chrono::duration<double, std::milli>(end - start).count();
+	}
+
+	// RGBA floats per texel: displacement x, height, displacement z, 0
+	const std::vector<float> &displacement() const { return displacementMap; }
+	// RGBA8 per texel: the world space normal as n * 0.5 + 0.5
+	const std::vector<unsigned char> &normals() const { return normalMap; }
+	// of the last simulate()
+	double lastFFTMs() const { return fftMs; }
+	double lastSimulateMs() const { return simulateMs; }
+
+	// The normal map against normals from central differences of the height map: the RMS
+	// difference of their x and z over the RMS of the differenced ones, the larger of the two.
+	// The spectral slopes are exact and the differences are not, so a correct map is off by a
+	// few tenths at the 8 bit precision of the map; a lost slope is off by about 1.
+	double normalError() const
+	{
+		float spacing = settings.patchSize / n;
+		double diff[2] = { 0.0, 0.0 }, reference[2] = { 0.0, 0.0 };
+		for (int z = 0; z < n; z++)
+		{
+			for (int x = 0; x < n; x++)
+			{
+				float sx = (height(x + 1, z) - height(x - 1, z)) / (2.0f * spacing);
+				float sz = (height(x, z + 1) - height(x, z - 1)) / (2.0f * spacing);
+				float length = std::sqrt(sx * sx + 1.0f + sz * sz);
+				float expected[2] = { -sx / length, -sz / length };
+				for (int c = 0; c < 2; c++)
+				{
+					float mapped = normalMap[((size_t)z * n + x) * 4 + c * 2] / 255.0f * 2.0f - 1.0f;
+					diff[c] += (mapped - expected[c]) * (mapped - expected[c]);
+					reference[c] += expected[c] * expected[c];
+				}
+			}
+		}
+		double error = 0.0;
+		for (int c = 0; c < 2; c++)
+			error = std::max(error, reference[c] > 0.0 ? std::sqrt(diff[c] / reference[c]) : 0.0);
+		return error;
+	}
+
+	// FFT throughput for every grid size; flops counted as 5 n log2(n) per 1D transform. Also
+	// checks the normals of a rough 64 x 64 sea with normalError(), normalsPassed: below tolerance
+	static std::string benchmark(unsigned int threads, int iterations, bool &normalsPassed)
+	{
+		const double tolerance = 0.5;
+		OceanSettings rough;
+		rough.size = 64;
+		rough.waveHeight = 0.1f;
+		OceanSimulation check(rough, threads);
+		check.simulate(1.0f);
+		double normalError = check.normalError();
+		normalsPassed = normalError < tolerance;
+
+		std::ostringstream out;
+		out << "{\n  \"fft\": { \"threads\": " << threads << ", \"simd\": "
+#ifdef FFT_SSE
+			<< "true"
+#else
+			<< "false"
+#endif
+			<< ", \"iterations\": " << iterations << ", \"sizes\": [";
+		for (int size = 64; size <= 512; size *= 2)
+		{
+			out << (size == 64 ? "\n" : ",\n") << "    { \"size\": " << size;
+			unsigned int counts[2] = { 1, threads };
+			for (int t = 0; t < 2; t++)
+			{
+				OceanSettings settings;
+				settings.size = size;
+				OceanSimulation simulation(settings, counts[t]);
+				simulation.simulate(0.0f);
+				std::vector<double> ffts, totals;
+				for (int i = 0; i < iterations; i++)
+				{
+					simulation.simulate(i / 60.0f);
+					ffts.push_back(simulation.lastFFTMs());
+					totals.push_back(simulation.lastSimulateMs());
+				}
+				std::sort(ffts.begin(), ffts.end());
+				std::sort(totals.begin(), totals.end());
+				double fftMs = ffts[ffts.size() / 2];
+				double log2n = std::log2((double)size);
+				double flops = 3.0 * 2.0 * size * 5.0 * size * log2n; // 3 grids, rows and columns
+				out << (t == 0 ? ", \"single_thread\": " : ", \"threaded\": ")
+					<< "{ \"fft_ms\": " << fftMs << ", \"simulate_ms\": " << totals[totals.size() / 2]
+					<< ", \"gflops\": " << (fftMs > 0.0 ? flops / (fftMs * 1e6) : 0.0) << " }";
+				if (threads == 1)
+					break;
+			}
+			out << " }";
+		}
+		out << "\n  ] },\n  \"normals\": { \"size\": " << rough.size << ", \"error\": " << normalError << ", \"tolerance\": " << tolerance
+			<< ", \"passed\": " << (normalsPassed ? "true" : "false") << " }\n}\n";
+		return out.str();
+	}
+
+private:
+	OceanSettings settings;
+	int n;
+	unsigned int threads;
+	FFT2D fft;
+	std::vector<float> h0, h0Conjugate; // interleaved complex, conj(h0(-k)) for the second
+	std::vector<float> omega, waveX, waveZ;
+	std::vector<float> data; // the three planes and their transposed results
+	std::vector<ComplexPlane> planes, scratch;
+	std::vector<float> displacementMap;
+	std::vector<unsigned char> normalMap;
+	double fftMs, simulateMs;
+
+	static unsigned char toByte(float v)
+	{
+		return (unsigned char)std::min(255.0f, std::max(0.0f, (v * 0.5f + 0.5f) * 255.0f + 0.5f));
+	}
+
+	// of the height map, wrapped around
+	float height(int x, int z) const
+	{
+		x = (x + n) % n;
+		z = (z + n) % n;
+		return displacementMap[((size_t)z * n + x) * 4 + 1];
+	}
+
+	float phillips(float kx, float kz) const
+	{
+		float k2 = kx * kx + kz * kz;
+		if (k2 < 1e-12f)
+			return 0.0f;
+		float windLength = std::sqrt(settings.windX * settings.windX + settings.windZ * settings.windZ);
+		float along = (kx * settings.windX + kz * settings.windZ) / (std::sqrt(k2) * std::max(windLength, 1e-6f));
+		float largest = settings.windSpeed * settings.windSpeed / OCEAN_GRAVITY;
+		float smallest = settings.patchSize / n * 0.5f; // damps what the grid cannot resolve
+		float p = std::exp(-1.0f / (k2 * largest * largest)) / (k2 * k2) * along * along * std::exp(-k2 * smallest * smallest);
+		return along < 0.0f ? p * 0.07f : p; // little travels against the wind
+	}
+
+	// random amplitudes, fixed seed so every run has the same sea; scaled to waveHeight
+	void initSpectrum()
+	{
+		std::mt19937 random(1);
+		std::normal_distribution<float> gaussian(0.0f, 1.0f);
+		const float pi = 3.14159265358979f;
+		for (int z = 0; z < n; z++)
+		{
+			for (int x = 0; x < n; x++)
+			{
+				size_t i = (size_t)z * n + x;
+				waveX[i] = 2.0f * pi * (x - n / 2) / settings.patchSize;
+				waveZ[i] = 2.0f * pi * (z - n / 2) / settings.patchSize;
+				float amplitude = std::sqrt(phillips(waveX[i], waveZ[i]) * 0.5f);
+				float a = gaussian(random), b = gaussian(random);
+				// the -n/2 row and column have no mirror and stay 0
+				bool edge = x == 0 || z == 0;
+				h0[i * 2] = edge ? 0.0f : a * amplitude;
+				h0[i * 2 + 1] = edge ? 0.0f : b * amplitude;
+				omega[i] = std::sqrt(OCEAN_GRAVITY * std::sqrt(waveX[i] * waveX[i] + waveZ[i] * waveZ[i]));
+			}
+		}
+		double energy = 0.0;
+		for (int z = 0; z < n; z++)
+		{
+			for (int x = 0; x < n; x++)
+			{
+				size_t i = (size_t)z * n + x, mirror = (size_t)((n - z) % n) * n + (n - x) % n;
+				h0Conjugate[i * 2] = h0[mirror * 2];
+				h0Conjugate[i * 2 + 1] = -h0[mirror * 2 + 1];
+				float re = h0[i * 2] + h0Conjugate[i * 2], im = h0[i * 2 + 1] + h0Conjugate[i * 2 + 1];
+				energy += re * re + im * im;
+			}
+		}
+		float scale = energy > 0.0 ? settings.waveHeight / (float)std::sqrt(energy) : 0.0f;
+		for (size_t i = 0; i < h0.size(); i++)
+		{
+			h0[i] *= scale;
+			h0Conjugate[i] *= scale;
+		}
+	}
+};
+
+// The ocean maps on the GPU. update() collects the surface simulated during the last frame,
+// uploads it into the texture pair the GPU did not read last frame and starts the next one.
+class OceanSurface
+{
+public:
+	OceanSurface(const OceanSettings &settings, unsigned int threads)
+		: settings(settings), simulation(settings, threads), threads(std::max(1u, threads)),
+		current(0), started(false), pending(false), stopping(false), nextTime(0.0f),
+		frames(0), simulateMs(0.0), fftMs(0.0), waitMs(0.0)
+	{
+		for (int i = 0; i < 2; i++)
+			displacementMaps[i] = normalMaps[i] = 0;
+		worker = std::thread([this]() { work(); });
+	}
+
+	~OceanSurface() { stop(); }
+
+	void create()
+	{
+		int n = settings.size;
+		for (int i = 0; i < 2; i++)
+		{
+			displacementMaps[i] = gpuResources().create(GPU_TEXTURE);
+			glBindTexture(GL_TEXTURE_2D, displacementMaps[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, n, n, 0, GL_RGBA, GL_FLOAT, NULL);
+			gpuResources().allocated(GPU_TEXTURE, displacementMaps[i], MEMORY_TEXTURES, "ocean displacement", GL_RGBA16F, MemoryTracker::textureBytes(GL_RGBA16F, n, n, 1, MemoryTracker::mipLevels(n, n)));
+			setParameters();
+			normalMaps[i] = gpuResources().create(GPU_TEXTURE);
+			glBindTexture(GL_TEXTURE_2D, normalMaps[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, n, n, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+			gpuResources().allocated(GPU_TEXTURE, normalMaps[i], MEMORY_TEXTURES, "ocean normals", GL_RGBA8, MemoryTracker::textureBytes(GL_RGBA8, n, n, 1, MemoryTracker::mipLevels(n, n)));
+			setParameters();
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+	}
+
+	// main thread, once per frame: the maps for time (simulated while the last frame
+	// rendered), then the simulation of nextTime starts
+	void update(float time, float nextTime)
+	{
+		if (!started)
+			start(time);
+		std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			done.wait(lock, [this]() { return !pending; });
+		}
+		waitMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+		simulateMs += simulation.lastSimulateMs();
+		fftMs += simulation.lastFFTMs();
+		frames++;
+
+		current = 1 - current;
+		int n = settings.size;
+		glBindTexture(GL_TEXTURE_2D, displacementMaps[current]);
+		gpuResources().texSubImage2D(GL_TEXTURE_2D, 0, 0, 0, n, n, GL_RGBA, GL_FLOAT, &simulation.displacement()[0]);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, normalMaps[current]);
+		gpuResources().texSubImage2D(GL_TEXTURE_2D, 0, 0, 0, n, n, GL_RGBA, GL_UNSIGNED_BYTE, &simulation.normals()[0]);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		start(nextTime);
+	}
+
+	unsigned int displacementTexture() const { return displacementMaps[current]; }
+	unsigned int normalTexture() const { return normalMaps[current]; }
+	float patchSize() const { return settings.patchSize; }
+
+	// mip level of the displacement whose texels are as large as the mesh spacing
+	float lod(float spacing) const
+	{
+		return std::max(0.0f, std::log2(spacing * settings.size / settings.patchSize));
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		if (worker.joinable())
+			worker.join();
+	}
+
+	// forget the timings so far, e.g. of the bench warmup
+	void resetStats()
+	{
+		frames = 0;
+		simulateMs = fftMs = waitMs = 0.0;
+	}
+
+	// "ocean" member for the bench report, averages per frame
+	std::string report() const
+	{
+		double count = std::max(1u, frames);
+		std::ostringstream out;
+		out << "\"ocean\": { \"size\": " << settings.size << ", \"threads\": " << threads
+			<< ", \"simulate_ms\": " << simulateMs / count << ", \"fft_ms\": " << fftMs / count
+			<< ", \"main_thread_wait_ms\": " << waitMs / count
+			<< ", \"upload_bytes\": " << (size_t)settings.size * settings.size * (4 * sizeof(float) + 4) << " }";
+		return out.str();
+	}
+
+private:
+	OceanSettings settings;
+	OceanSimulation simulation;
+	unsigned int threads;
+	unsigned int displacementMaps[2], normalMaps[2];
+	int current; // pair the GPU reads this frame
+
+	std::thread worker;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	bool started, pending, stopping;
+	float nextTime;
+
+	unsigned int frames;
+	double simulateMs, fftMs, waitMs;
+
+	static void setParameters()
+	{
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	}
+
+	void start(float time)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			nextTime = time;
+			pending = true;
+			started = true;
+		}
+		wake.notify_one();
+	}
+
+	void work()
+	{
+		for (;;)
+		{
+			float time;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() { return stopping || pending; });
+				if (stopping)
+					return;
+				time = nextTime;
+			}
+			simulation.simulate(time);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				pending = false;
+			}
+			done.notify_all();
+		}
+	}
+};
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef OVERDRAW_H
+#define OVERDRAW_H
+
+#include <glad/glad.h>
+
+#include <sstream>
+#include <string>
+
+// Fragments that pass the depth test in the colour pass (GL_SAMPLES_PASSED), per frame and
+// per drawn pixel. Read back LATENCY frames later like PassTimer, so it does not stall.
+class OverdrawCounter
+{
+public:
+	static const int LATENCY = 4;
+
+	OverdrawCounter() : frame(-1), frames(0), fragments(0.0), pixels(0.0)
+	{
+		glGenQueries(LATENCY, queries);
+		for (int i = 0; i < LATENCY; i++)
+			issued[i] = 0;
+	}
+
+	~OverdrawCounter() { release(); }
+
+	// deletes the queries, call while the context is still current
+	void release()
+	{
+		if (queries[0] != 0)
+			glDeleteQueries(LATENCY, queries);
+		for (int i = 0; i < LATENCY; i++)
+			queries[i] = 0;
+	}
+
+	// pixelCount: pixels of the viewport the pass draws into
+	void begin(size_t pixelCount)
+	{
+		frame++;
+		int slot = frame % LATENCY;
+		collect(slot);
+		glBeginQuery(GL_SAMPLES_PASSED, queries[slot]);
+		issued[slot] = pixelCount;
+	}
+
+	void end() { glEndQuery(GL_SAMPLES_PASSED); }
+
+	void resetStats()
+	{
+		frames = 0;
+		fragments = 0.0;
+		pixels = 0.0;
+	}
+
+	// "overdraw" member for the bench report, means over the frames read back so far
+	std::string report(bool depthPrepass) const
+	{
+		std::ostringstream out;
+		out << "\"overdraw\": { \"depth_prepass\": " << (depthPrepass ? "true" : "false")
+			<< ", \"fragments\": " << (frames ? fragments / frames : 0.0)
+			<< ", \"pixels\": " << (frames ? pixels / frames : 0.0)
+			<< ", \"fragments_per_pixel\": " << (pixels > 0.0 ? fragments / pixels : 0.0) << " }";
+		return out.str();
+	}
+
+private:
+	GLuint queries[LATENCY];
+	size_t issued[LATENCY];	// pixels of the frame in the slot, 0 when empty
+	int frame;
+	int frames;
+	double fragments;
+	double pixels;
+
+	void collect(int slot)
+	{
+		if (issued[slot] == 0)
+			return;
+		GLuint64 passed = 0;
+		glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &passed);
+		fragments += (double)passed;
+		pixels += (double)issued[slot];
+		frames++;
+		issued[slot] = 0;
+	}
+};
+
+#endif
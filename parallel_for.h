@@ -0,0 +1,134 @@
+#ifndef PARALLEL_FOR_H
+#define PARALLEL_FOR_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Threads kept for the whole run that help with parallelFor loops. A loop queues one ticket
+// per helper it wants; the calling thread works on the loop too and waits only for indices
+// already taken, so loops can come from several threads at once and nest without deadlock.
+class ParallelPool
+{
+public:
+	explicit ParallelPool(unsigned int threads) : stopping(false)
+	{
+		for (unsigned int i = 0; i < threads; i++)
+			workers.push_back(std::thread([this]() { work(); }));
+	}
+
+	~ParallelPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (size_t i = 0; i < workers.size(); i++)
+			workers[i].join();
+	}
+
+	unsigned int threads() const { return (unsigned int)workers.size(); }
+
+	// f(i) for i in [0, count) on the caller and up to helpers pool threads
+	void run(size_t count, unsigned int helpers, const std::function<void(size_t)> &f)
+	{
+		std::shared_ptr<Loop> loop(new Loop(count, f));
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (unsigned int t = 0; t < helpers; t++)
+				tickets.push_back(loop);
+		}
+		if (helpers == 1)
+			wake.notify_one();
+		else
+			wake.notify_all();
+		loop->work();
+		std::unique_lock<std::mutex> lock(loop->mutex);
+		loop->finished.wait(lock, [&loop]() { return loop->done == loop->count; });
+	}
+
+private:
+	struct Loop {
+		size_t count;
+		const std::function<void(size_t)> &f;	// valid while indices are left, the caller waits for them
+		std::atomic<size_t> next;
+		size_t done;	// under mutex
+		std::mutex mutex;
+		std::condition_variable finished;
+
+		Loop(size_t count, const std::function<void(size_t)> &f) : count(count), f(f), next(0), done(0) {}
+
+		void work()
+		{
+			size_t ran = 0;
+			for (size_t i = next++; i < count; i = next++)
+			{
+				f(i);
+				ran++;
+			}
+			if (ran == 0)
+				return;
+			std::lock_guard<std::mutex> lock(mutex);
+			done += ran;
+			if (done == count)
+				finished.notify_all();
+		}
+	};
+
+	std::vector<std::thread> workers;
+	std::deque<std::shared_ptr<Loop> > tickets;	// late tickets find their loop finished
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping;
+
+	void work()
+	{
+		for (;;)
+		{
+			std::shared_ptr<Loop> loop;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [this]() { return stopping || !tickets.empty(); });
+				if (stopping)
+					return;
+				loop = tickets.front();
+				tickets.pop_front();
+			}
+			loop->work();
+		}
+	}
+};
+
+// one helper per core but the caller's, started with the first parallel loop
+inline ParallelPool &parallelPool()
+{
+	static ParallelPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	return pool;
+}
+
+// calls f(i) for i in [0, count) on up to threads threads, the indices are handed out one by one
+template <typename F>
+void parallelFor(size_t count, unsigned int threads, F f)
+{
+	unsigned int workers = (unsigned int)std::min<size_t>(threads, count);
+	if (workers > 1)
+		workers = std::min(workers, parallelPool().threads() + 1);
+	if (workers <= 1)
+	{
+		for (size_t i = 0; i < count; i++)
+			f(i);
+		return;
+	}
+	std::function<void(size_t)> body(f);
+	parallelPool().run(count, workers - 1, body);
+}
+
+#endif
@@ -0,0 +1,198 @@
+#ifndef PASS_TIMER_H
+#define PASS_TIMER_H
+
+#include <glad/glad.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// GPU (GL_TIME_ELAPSED) and CPU timing of the render passes.
+// Queries are kept in a ring of LATENCY frames and read back LATENCY frames later,
+// so the readback normally does not stall the pipeline.
+// Only one pass can be timed at a time, passes must not overlap.
+class PassTimer
+{
+public:
+	static const int LATENCY = 4;
+
+	PassTimer(const std::vector<std::string> &passNames, bool enabled, int warmupFrames = 0)
+		: names(passNames), enabled(enabled), warmup(warmupFrames), frame(-1), start(0)
+	{
+		gpuSamples.resize(names.size());
+		cpuSamples.resize(names.size());
+		if (!enabled)
+			return;
+		queries.resize(LATENCY * names.size());
+		issued.assign(LATENCY * names.size(), false);
+		glGenQueries((GLsizei)queries.size(), &queries[0]);
+	}
+
+	~PassTimer() { release(); }
+
+	// deletes the queries, call while the context is still current
+	void release()
+	{
+		if (enabled && !queries.empty())
+			glDeleteQueries((GLsizei)queries.size(), &queries[0]);
+		queries.clear();
+		issued.clear();
+	}
+
+	void beginFrame()
+	{
+		if (!enabled)
+			return;
+		frame++;
+		collect(frame % LATENCY);
+		frameStart = now();
+	}
+
+	void endFrame()
+	{
+		if (enabled && recording())
+			frameSamples.push_back(since(frameStart));
+	}
+
+	void begin(int pass)
+	{
+		if (!enabled)
+			return;
+		int slot = (frame % LATENCY) * (int)names.size() + pass;
+		glBeginQuery(GL_TIME_ELAPSED, queries[slot]);
+		issued[slot] = recording();
+		passStart = now();
+	}
+
+	void end(int pass)
+	{
+		if (!enabled)
+			return;
+		glEndQuery(GL_TIME_ELAPSED);
+		if (recording())
+			cpuSamples[pass].push_back(since(passStart));
+	}
+
+	// count the warmup again from the next frame on, e.g. while assets are still loading
+	void restartWarmup() { start = frame + 1; }
+
+	// read back every query still in flight
+	void finish()
+	{
+		if (!enabled)
+			return;
+		// oldest first, so the frames stay in order
+		for (int i = 1; i <= LATENCY; i++)
+			collect((frame + i) % LATENCY);
+	}
+
+	// per measured frame: CPU time and the sum of the GPU times of its passes (after finish())
+	const std::vector<double> &frameCpuMs() const { return frameSamples; }
+	const std::vector<double> &frameGpuMs() const { return frameGpuSamples; }
+
+	// extra: further members of the report object, e.g. "\"name\": {...}"
+	std::string report(int width, int height, const std::string &extra = "") const
+	{
+		std::ostringstream out;
+		const char *renderer = enabled ? (const char *)glGetString(GL_RENDERER) : "";
+		out << "{\n";
+		out << "  \"renderer\": \"" << escape(renderer ? renderer : "") << "\",\n";
+		out << "  \"width\": " << width << ",\n";
+		out << "  \"height\": " << height << ",\n";
+		out << "  \"frames\": " << frameSamples.size() << ",\n";
+		out << "  \"warmup_frames\": " << warmup << ",\n";
+		out << "  \"frame\": { \"cpu_ms\": " << stats(frameSamples) << " },\n";
+		out << "  \"passes\": {\n";
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			out << "    \"" << names[i] << "\": { \"gpu_ms\": " << stats(gpuSamples[i])
+				<< ", \"cpu_ms\": " << stats(cpuSamples[i]) << " }";
+			out << (i + 1 < names.size() ? ",\n" : "\n");
+		}
+		out << (extra.empty() ? "  }\n" : "  },\n");
+		if (!extra.empty())
+			out << "  " << extra << "\n";
+		out << "}\n";
+		return out.str();
+	}
+
+private:
+	typedef std::chrono::high_resolution_clock Clock;
+
+	std::vector<std::string> names;
+	bool enabled;
+	int warmup;
+	int frame;
+	int start; // first warmup frame
+	std::vector<GLuint> queries;
+	std::vector<bool> issued;
+	std::vector<std::vector<double> > gpuSamples;
+	std::vector<std::vector<double> > cpuSamples;
+	std::vector<double> frameSamples;
+	std::vector<double> frameGpuSamples;
+	Clock::time_point frameStart;
+	Clock::time_point passStart;
+
+	bool recording() const { return frame >= start + warmup; }
+
+	static Clock::time_point now() { return Clock::now(); }
+
+	static double since(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	void collect(int ring)
+	{
+		double frameMs = 0.0;
+		bool any = false;
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			size_t slot = ring * names.size() + i;
+			if (!issued[slot])
+				continue;
+			GLuint64 ns = 0;
+			glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &ns);
+			gpuSamples[i].push_back(ns / 1.0e6);
+			frameMs += ns / 1.0e6;
+			any = true;
+			issued[slot] = false;
+		}
+		if (any)
+			frameGpuSamples.push_back(frameMs);
+	}
+
+	static std::string stats(std::vector<double> samples)
+	{
+		std::ostringstream out;
+		if (samples.empty())
+		{
+			out << "null";
+			return out.str();
+		}
+		std::sort(samples.begin(), samples.end());
+		// nearest-rank percentiles
+		size_t n = samples.size();
+		size_t p99 = (size_t)std::ceil(0.99 * n) - 1;
+		out << "{ \"min\": " << samples[0]
+			<< ", \"median\": " << samples[(n - 1) / 2]
+			<< ", \"p99\": " << samples[p99] << " }";
+		return out.str();
+	}
+
+	static std::string escape(const std::string &s)
+	{
+		std::string r;
+		for (size_t i = 0; i < s.size(); i++)
+		{
+			if (s[i] == '"' || s[i] == '\\')
+				r += '\\';
+			r += s[i];
+		}
+		return r;
+	}
+};
+
+#endif
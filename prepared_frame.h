@@ -0,0 +1,24 @@
+#ifndef PREPARED_FRAME_H
+#define PREPARED_FRAME_H
+
+#include <glm/glm.hpp>
+#include "draw_list.h"
+#include "frame_data.h"
+#include "shadow_cache.h"
+
+#include <vector>
+
+// Everything the GL thread needs to submit one frame, filled by the frame preparation jobs.
+// There are two: frame N is submitted from one while N + 1 is prepared into the other.
+struct PreparedFrame {
+	FrameData data;
+	DrawList depthDraws;	// the depth pass, only with shadowUpdate
+	DrawList draws;			// the pre-pass and the colour pass
+	std::vector<glm::mat4> instances;	// the ships of the depth pass, then those of the colour pass
+	bool shadowUpdate;
+	ShadowRegion shadowRegion;
+
+	PreparedFrame() : shadowUpdate(false) {}
+};
+
+#endif
@@ -0,0 +1,278 @@
+#ifndef REGRESSION_CHECK_H
+#define REGRESSION_CHECK_H
+
+#include <stb_image.h>
+#include "image_writer.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+struct GoldenSettings {
+	std::string directory;	// reference images, empty: no comparison
+	bool update;			// write the references instead of comparing
+	std::vector<int> frames;	// measured frames to compare, empty: every EVERY-th and the last
+	int tolerance;			// a channel may be off by this much (of 255)
+	float maxDifferent;		// fraction of the pixels allowed beyond the tolerance
+
+	GoldenSettings() : update(false), tolerance(8), maxDifferent(0.001f) {}
+};
+
+// comma separated frame numbers
+inline bool parseGoldenFrames(const char *list, std::vector<int> &frames)
+{
+	frames.clear();
+	std::stringstream in(list);
+	std::string item;
+	while (std::getline(in, item, ','))
+	{
+		char *end = NULL;
+		long frame = strtol(item.c_str(), &end, 10);
+		if (item.empty() || *end != '\0' || frame < 0)
+			return false;
+		frames.push_back((int)frame);
+	}
+	return !frames.empty();
+}
+
+// one compared frame
+struct GoldenResult {
+	int frame;
+	bool found;			// the reference could be read and has the same size
+	double different;	// fraction of the pixels beyond the tolerance
+	int maxDiff;		// largest channel difference
+	double meanDiff;	// mean channel difference
+	bool passed;
+};
+
+// Compares frames of a deterministic run (bench or replay) with reference images in
+// directory/golden_NNNNNN.png, or writes them there (update). A frame passes when at most
+// maxDifferent of its pixels have a channel more than tolerance away from the reference, so
+// driver rounding does not fail it and a missing ship or a shifted camera does.
+class GoldenImages
+{
+public:
+	static const int EVERY = 60;
+
+	explicit GoldenImages(const GoldenSettings &settings) : settings(settings), written(0) {}
+
+	bool enabled() const { return !settings.directory.empty(); }
+
+	// frame counts from the first measured frame, last is the final one
+	bool due(int frame, int last) const
+	{
+		if (!enabled())
+			return false;
+		if (settings.frames.empty())
+			return frame % EVERY == 0 || frame == last;
+		return std::find(settings.frames.begin(), settings.frames.end(), frame) != settings.frames.end();
+	}
+
+	// pixels: RGB, bottom row first as glReadPixels returns them
+	void check(int frame, const std::vector<unsigned char> &pixels, int width, int height)
+	{
+		std::string file = path(frame);
+		if (settings.update)
+		{
+			if (ImageWriter::writePng(file, &pixels[0], width, height, 3))
+				written++;
+			else
+				std::cout << "GOLDEN: cannot write " << file << std::endl;
+			return;
+		}
+		GoldenResult result = { frame, false, 1.0, 255, 255.0, false };
+		int w = 0, h = 0, channels = 0;
+		unsigned char *reference = stbi_load(file.c_str(), &w, &h, &channels, 3);
+		if (reference && w == width && h == height)
+		{
+			result.found = true;
+			size_t different = 0, sum = 0;
+			int maxDiff = 0;
+			for (int y = 0; y < height; y++)
+			{
+				// the reference is stored top row first
+				const unsigned char *a = &pixels[(size_t)(height - 1 - y) * width * 3];
+				const unsigned char *b = reference + (size_t)y * width * 3;
+				for (int x = 0; x < width; x++)
+				{
+					int pixelDiff = 0;
+					for (int c = 0; c < 3; c++)
+					{
+						int d = std::abs((int)a[x * 3 + c] - (int)b[x * 3 + c]);
+						pixelDiff = std::max(pixelDiff, d);
+						sum += d;
+					}
+					maxDiff = std::max(maxDiff, pixelDiff);
+					if (pixelDiff > settings.tolerance)
+						different++;
+				}
+			}
+			size_t count = (size_t)width * height;
+			result.different = (double)different / count;
+			result.maxDiff = maxDiff;
+			result.meanDiff = (double)sum / (count * 3);
+			result.passed = result.different <= settings.maxDifferent;
+		}
+		else
+			std::cout << "GOLDEN: no reference of " << width << " x " << height << " in " << file << std::endl;
+		if (reference)
+			stbi_image_free(reference);
+		if (!result.passed)
+			std::cout << "GOLDEN: frame " << frame << " differs from " << file << std::endl;
+		results.push_back(result);
+	}
+
+	bool passed() const
+	{
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			if (!results[i].passed)
+				return false;
+		}
+		return true;
+	}
+
+	// "golden" member for the bench report
+	std::string report() const
+	{
+		std::ostringstream out;
+		out << "\"golden\": { \"directory\": \"" << settings.directory << "\", \"update\": " << (settings.update ? "true" : "false")
+			<< ", \"written\": " << written << ", \"tolerance\": " << settings.tolerance << ", \"max_different\": " << settings.maxDifferent
+			<< ", \"passed\": " << (passed() ? "true" : "false") << ", \"frames\": [";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const GoldenResult &r = results[i];
+			out << (i > 0 ? ", " : " ") << "{ \"frame\": " << r.frame << ", \"found\": " << (r.found ? "true" : "false")
+				<< ", \"different\": " << r.different << ", \"max_diff\": " << r.maxDiff << ", \"mean_diff\": " << r.meanDiff
+				<< ", \"passed\": " << (r.passed ? "true" : "false") << " }";
+		}
+		out << (results.empty() ? "] }" : " ] }");
+		return out.str();
+	}
+
+private:
+	GoldenSettings settings;
+	std::vector<GoldenResult> results;
+	int written;
+
+	std::string path(int frame) const
+	{
+		char name[32];
+		snprintf(name, sizeof(name), "/golden_%06d.png", frame);
+		return settings.directory + name;
+	}
+};
+
+// Per frame CPU and GPU times of the measured frames as "frame,cpu_ms,gpu_ms" lines. A run
+// compared with a baseline file (of an earlier build, same recording and flags) regresses
+// when its median CPU or GPU frame time is more than tolerance above the baseline's; medians,
+// so a single hitch does not fail it.
+class FrameTimings
+{
+public:
+	FrameTimings() : tolerance(0.1), baselineCpu(0.0), baselineGpu(0.0), cpuMedian(0.0), gpuMedian(0.0), compared(false) {}
+
+	void set(const std::vector<double> &cpuMs, const std::vector<double> &gpuMs)
+	{
+		cpu = cpuMs;
+		gpu = gpuMs;
+		cpuMedian = median(cpu);
+		gpuMedian = median(gpu);
+	}
+
+	bool write(const std::string &path) const
+	{
+		std::ofstream out(path.c_str());
+		if (!out)
+			return false;
+		out << "frame,cpu_ms,gpu_ms\n";
+		for (size_t i = 0; i < std::max(cpu.size(), gpu.size()); i++)
+		{
+			out << i << ",";
+			if (i < cpu.size())
+				out << cpu[i];
+			out << ",";
+			if (i < gpu.size())
+				out << gpu[i];
+			out << "\n";
+		}
+		return (bool)out;
+	}
+
+	// reads the medians of a timings file, fraction: allowed slowdown
+	bool compare(const std::string &path, double fraction)
+	{
+		std::ifstream in(path.c_str());
+		if (!in)
+		{
+			std::cout << "PERF: cannot open " << path << std::endl;
+			return false;
+		}
+		std::vector<double> baseCpuMs, baseGpuMs;
+		std::string line;
+		std::getline(in, line);	// header
+		while (std::getline(in, line))
+		{
+			std::stringstream fields(line);
+			std::string frame, cpuField, gpuField;
+			std::getline(fields, frame, ',');
+			std::getline(fields, cpuField, ',');
+			std::getline(fields, gpuField, ',');
+			if (!cpuField.empty())
+				baseCpuMs.push_back(atof(cpuField.c_str()));
+			if (!gpuField.empty())
+				baseGpuMs.push_back(atof(gpuField.c_str()));
+		}
+		baseline = path;
+		tolerance = fraction;
+		baselineCpu = median(baseCpuMs);
+		baselineGpu = median(baseGpuMs);
+		compared = true;
+		return true;
+	}
+
+	// no baseline counts as passed
+	bool passed() const
+	{
+		if (!compared)
+			return true;
+		bool cpuOk = baselineCpu <= 0.0 || cpuMedian <= baselineCpu * (1.0 + tolerance);
+		bool gpuOk = baselineGpu <= 0.0 || gpuMedian <= baselineGpu * (1.0 + tolerance);
+		return cpuOk && gpuOk;
+	}
+
+	// "perf" member for the bench report
+	std::string report() const
+	{
+		std::ostringstream out;
+		out << "\"perf\": { \"frames\": " << cpu.size() << ", \"cpu_median_ms\": " << cpuMedian << ", \"gpu_median_ms\": " << gpuMedian;
+		if (compared)
+			out << ", \"baseline\": \"" << baseline << "\", \"baseline_cpu_median_ms\": " << baselineCpu
+				<< ", \"baseline_gpu_median_ms\": " << baselineGpu << ", \"tolerance\": " << tolerance;
+		out << ", \"passed\": " << (passed() ? "true" : "false") << " }";
+		return out.str();
+	}
+
+private:
+	std::vector<double> cpu, gpu;
+	std::string baseline;
+	double tolerance;
+	double baselineCpu, baselineGpu;
+	double cpuMedian, gpuMedian;
+	bool compared;
+
+	static double median(std::vector<double> samples)
+	{
+		if (samples.empty())
+			return 0.0;
+		std::sort(samples.begin(), samples.end());
+		return samples[(samples.size() - 1) / 2];
+	}
+};
+
+#endif
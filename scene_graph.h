@@ -0,0 +1,290 @@
+#ifndef SCENE_GRAPH_H
+#define SCENE_GRAPH_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// what a scene file can attach to a node
+struct SceneModel {
+	int node;
+	std::string name;	// resolved to a loaded model by the caller
+};
+
+struct SceneLight {
+	int node;
+	std::string slot;	// "sun", "right", ... the caller maps it to a FrameLightIndex
+	bool directional;	// the world position of the node is the direction then
+	glm::vec3 ambient, diffuse, specular;
+};
+
+struct SceneLabel {
+	int node;
+	glm::vec3 offset;	// from the node position, not rotated or scaled with it
+	float size;
+};
+
+// a fixed view of the scene from the world position of its node
+struct SceneCamera {
+	int node;
+	float yaw, pitch;	// degrees, as Camera takes them
+	float zoom;			// vertical field of view, degrees
+};
+
+// Nodes of the scene in flat arrays, one per transform component, in topological order
+// (a parent always comes before its children). Setting a transform marks the node dirty;
+// update() walks the arrays once and rebuilds the world matrix of every dirty node and of
+// everything below one, the rest keeps last frame's matrix.
+//
+// Scene file, one entry per line, # starts a comment:
+//   node <name> <parent or -> <position xyz> <rotation xyz, degrees> <scale xyz>
+//   model <node> <name>
+//   light <node> <slot> <point|directional> <ambient rgb> <diffuse rgb> <specular rgb>
+//   label <node> <offset xyz> <size>
+//   camera <node> <yaw> <pitch> <field of view>
+// The rotation is applied as yaw (y) * pitch (x) * roll (z), the local matrix is T * R * S.
+class SceneGraph
+{
+public:
+	std::vector<SceneModel> models;
+	std::vector<SceneLight> lights;
+	std::vector<SceneLabel> labels;
+	std::vector<SceneCamera> cameras;
+
+	SceneGraph() : frames(0), updatedNodes(0), updateMs(0.0) {}
+
+	bool load(const std::string &path)
+	{
+		std::ifstream in(path.c_str());
+		if (!in)
+		{
+			std::cout << "SCENE: cannot open " << path << std::endl;
+			return false;
+		}
+		std::string line;
+		for (int number = 1; std::getline(in, line); number++)
+		{
+			std::istringstream fields(line.substr(0, line.find('#')));
+			std::string kind, name;
+			if (!(fields >> kind))
+				continue;
+			bool ok = false;
+			if (kind == "node")
+			{
+				std::string parentName;
+				glm::vec3 position, rotation, scale;
+				if (fields >> name >> parentName >> position.x >> position.y >> position.z
+					>> rotation.x >> rotation.y >> rotation.z >> scale.x >> scale.y >> scale.z)
+				{
+					int parent = parentName == "-" ? -1 : find(parentName);
+					ok = (parent >= 0 || parentName == "-") && find(name) < 0;
+					if (ok)
+						add(name, parent, position, rotation, scale);
+				}
+			}
+			else if (kind == "model")
+			{
+				SceneModel model;
+				ok = (bool)(fields >> name >> model.name) && (model.node = find(name)) >= 0;
+				if (ok)
+					models.push_back(model);
+			}
+			else if (kind == "light")
+			{
+				SceneLight light;
+				std::string type;
+				ok = (bool)(fields >> name >> light.slot >> type
+					>> light.ambient.x >> light.ambient.y >> light.ambient.z
+					>> light.diffuse.x >> light.diffuse.y >> light.diffuse.z
+					>> light.specular.x >> light.specular.y >> light.specular.z)
+					&& (light.node = find(name)) >= 0 && (type == "point" || type == "directional");
+				light.directional = type == "directional";
+				if (ok)
+					lights.push_back(light);
+			}
+			else if (kind == "label")
+			{
+				SceneLabel label;
+				ok = (bool)(fields >> name >> label.offset.x >> label.offset.y >> label.offset.z >> label.size)
+					&& (label.node = find(name)) >= 0;
+				if (ok)
+					labels.push_back(label);
+			}
+			else if (kind == "camera")
+			{
+				SceneCamera camera;
+				ok = (bool)(fields >> name >> camera.yaw >> camera.pitch >> camera.zoom)
+					&& (camera.node = find(name)) >= 0;
+				if (ok)
+					cameras.push_back(camera);
+			}
+			if (!ok)
+			{
+				std::cout << "SCENE: " << path << ":" << number << ": cannot read \"" << line << "\"" << std::endl;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	int add(const std::string &name, int parent, const glm::vec3 &position, const glm::vec3 &rotation, const glm::vec3 &scale)
+	{
+		names.push_back(name);
+		parents.push_back(parent);
+		positions.push_back(position);
+		rotations.push_back(rotation);
+		scales.push_back(scale);
+		worlds.push_back(glm::mat4(1.0f));
+		dirty.push_back(1);
+		changed.push_back(0);
+		return (int)names.size() - 1;
+	}
+
+	// a copy of node under the same parent with its models and labels (not its children)
+	int clone(int node, const std::string &name)
+	{
+		int copy = add(name, parents[node], positions[node], rotations[node], scales[node]);
+		for (size_t i = 0, count = models.size(); i < count; i++)
+		{
+			if (models[i].node == node)
+			{
+				models.push_back(models[i]);
+				models.back().node = copy;
+			}
+		}
+		for (size_t i = 0, count = labels.size(); i < count; i++)
+		{
+			if (labels[i].node == node)
+			{
+				labels.push_back(labels[i]);
+				labels.back().node = copy;
+			}
+		}
+		return copy;
+	}
+
+	int find(const std::string &name) const
+	{
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			if (names[i] == name)
+				return (int)i;
+		}
+		return -1;
+	}
+
+	// nodes carrying the model called name, in node order
+	std::vector<int> modelNodes(const std::string &name) const
+	{
+		std::vector<int> nodes;
+		for (size_t i = 0; i < models.size(); i++)
+		{
+			if (models[i].name == name)
+				nodes.push_back(models[i].node);
+		}
+		return nodes;
+	}
+
+	const SceneLabel *label(int node) const
+	{
+		for (size_t i = 0; i < labels.size(); i++)
+		{
+			if (labels[i].node == node)
+				return &labels[i];
+		}
+		return NULL;
+	}
+
+	size_t size() const { return names.size(); }
+	const glm::vec3 &position(int node) const { return positions[node]; }
+
+	void setPosition(int node, const glm::vec3 &position)
+	{
+		positions[node] = position;
+		dirty[node] = 1;
+	}
+
+	void setRotation(int node, const glm::vec3 &rotation)
+	{
+		rotations[node] = rotation;
+		dirty[node] = 1;
+	}
+
+	void setScale(int node, const glm::vec3 &scale)
+	{
+		scales[node] = scale;
+		dirty[node] = 1;
+	}
+
+	// valid after update()
+	const glm::mat4 &world(int node) const { return worlds[node]; }
+	glm::vec3 worldPosition(int node) const { return glm::vec3(worlds[node][3]); }
+	// the world matrix was rebuilt by the last update()
+	bool moved(int node) const { return changed[node] != 0; }
+
+	// returns the number of world matrices rebuilt
+	int update()
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		int count = 0;
+		for (size_t i = 0; i < names.size(); i++)
+		{
+			int parent = parents[i];
+			changed[i] = dirty[i] | (parent >= 0 ? changed[parent] : 0);
+			if (!changed[i])
+				continue;
+			dirty[i] = 0;
+			glm::mat4 local = glm::translate(glm::mat4(1.0f), positions[i]);
+			local = glm::rotate(local, glm::radians(rotations[i].y), glm::vec3(0.0f, 1.0f, 0.0f));
+			local = glm::rotate(local, glm::radians(rotations[i].x), glm::vec3(1.0f, 0.0f, 0.0f));
+			local = glm::rotate(local, glm::radians(rotations[i].z), glm::vec3(0.0f, 0.0f, 1.0f));
+			local = glm::scale(local, scales[i]);
+			worlds[i] = parent >= 0 ? worlds[parent] * local : local;
+			count++;
+		}
+		frames++;
+		updatedNodes += count;
+		updateMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		return count;
+	}
+
+	void resetStats()
+	{
+		frames = 0;
+		updatedNodes = 0;
+		updateMs = 0.0;
+	}
+
+	// "scene" member for the bench report, means per frame
+	std::string report() const
+	{
+		double count = frames > 0 ? (double)frames : 1.0;
+		std::ostringstream out;
+		out << "\"scene\": { \"nodes\": " << names.size() << ", \"models\": " << models.size()
+			<< ", \"lights\": " << lights.size() << ", \"labels\": " << labels.size() << ", \"cameras\": " << cameras.size()
+			<< ", \"nodes_updated\": " << updatedNodes / count << ", \"update_ms\": " << updateMs / count << " }";
+		return out.str();
+	}
+
+private:
+	std::vector<std::string> names;
+	std::vector<int> parents;	// -1 for the roots, always lower than the own index
+	std::vector<glm::vec3> positions;
+	std::vector<glm::vec3> rotations;
+	std::vector<glm::vec3> scales;
+	std::vector<glm::mat4> worlds;
+	std::vector<unsigned char> dirty;	// set by the setters
+	std::vector<unsigned char> changed;	// rebuilt by the last update()
+
+	int frames;
+	size_t updatedNodes;
+	double updateMs;
+};
+
+#endif
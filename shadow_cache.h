@@ -0,0 +1,193 @@
+#ifndef SHADOW_CACHE_H
+#define SHADOW_CACHE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <vector>
+
+enum ShadowUpdateMode {
+	SHADOW_UPDATE_ON_CHANGE,	// re-render the whole map in the frame something changed
+	SHADOW_UPDATE_INTERVAL,		// moving casters: re-render at most every interval frames
+	SHADOW_UPDATE_REGIONS		// moving casters: re-render one tile of the map per frame
+};
+
+// part of the map an update draws
+struct ShadowRegion {
+	bool partial;	// else all of it
+	int x, y, width, height;
+
+	ShadowRegion() : partial(false), x(0), y(0), width(0), height(0) {}
+};
+
+// Keeps the shadow map until the light, a caster transform or the set of casters changes.
+// Every frame the light matrix and the casters are declared, then update() says whether
+// (and where, region()) the map has to be drawn:
+//
+//	shadowCache.beginFrame(lightSpaceMatrix());
+//	shadowCache.addCaster(&ship, shipModelMatrix());
+//	if (shadowCache.update()) { bind, beginUpdate(region()), clear, draw casters, endUpdate(); }
+//
+// A change of the light or of the caster set always redraws the whole map,
+// only moving casters use the interval / region modes. Only beginUpdate() and endUpdate()
+// call GL, the rest may run on a worker thread.
+class ShadowCache
+{
+public:
+	ShadowCache(int width, int height, ShadowUpdateMode mode = SHADOW_UPDATE_ON_CHANGE, int interval = 4, int regions = 2)
+		: width(width), height(height), mode(mode), interval(interval < 1 ? 1 : interval), regions(regions < 1 ? 1 : regions),
+		valid(false), lightChanged(false), moved(false), pendingTiles(0), nextTile(0), framesSinceUpdate(0),
+		frames(0), fullUpdates(0), tileUpdates(0)
+	{
+	}
+
+	void beginFrame(const glm::mat4 &lightSpaceMatrix)
+	{
+		frames++;
+		framesSinceUpdate++;
+		lightChanged = !valid || memcmp(&lightSpaceMatrix[0][0], &light[0][0], sizeof(glm::mat4)) != 0;
+		light = lightSpaceMatrix;
+		previous.swap(casters);
+		casters.clear();
+	}
+
+	// id identifies the caster between frames (the model it draws)
+	void addCaster(const void *id, const glm::mat4 &model)
+	{
+		Caster caster;
+		caster.id = id;
+		caster.model = model;
+		casters.push_back(caster);
+	}
+
+	// true if the map has to be drawn this frame; the scissor is set for a partial update
+	bool update()
+	{
+		bool setChanged = casters.size() != previous.size();
+		bool transformChanged = false;
+		for (size_t i = 0; !setChanged && i < casters.size(); i++)
+		{
+			setChanged = casters[i].id != previous[i].id;
+			transformChanged = transformChanged || memcmp(&casters[i].model[0][0], &previous[i].model[0][0], sizeof(glm::mat4)) != 0;
+		}
+
+		if (lightChanged || setChanged || (transformChanged && mode == SHADOW_UPDATE_ON_CHANGE))
+		{
+			moved = false;
+			pendingTiles = 0;
+			return full();
+		}
+		if (transformChanged)
+		{
+			moved = true;
+			pendingTiles = regions * regions; // the sweep starts over
+		}
+
+		if (mode == SHADOW_UPDATE_INTERVAL && moved && framesSinceUpdate >= interval)
+		{
+			moved = false;
+			return full();
+		}
+		if (mode == SHADOW_UPDATE_REGIONS && pendingTiles > 0)
+		{
+			int tile = nextTile;
+			nextTile = (nextTile + 1) % (regions * regions);
+			pendingTiles--;
+			tileUpdates++;
+			int x0 = (tile % regions) * width / regions, x1 = (tile % regions + 1) * width / regions;
+			int y0 = (tile / regions) * height / regions, y1 = (tile / regions + 1) * height / regions;
+			updated.partial = true;
+			updated.x = x0;
+			updated.y = y0;
+			updated.width = x1 - x0;
+			updated.height = y1 - y0;
+			framesSinceUpdate = 0;
+			return true;
+		}
+		return false;
+	}
+
+	// what the last update() asked to draw
+	const ShadowRegion &region() const { return updated; }
+
+	// GL thread: the scissor of a partial update
+	static void beginUpdate(const ShadowRegion &region)
+	{
+		if (!region.partial)
+			return;
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(region.x, region.y, region.width, region.height);
+	}
+
+	static void endUpdate()
+	{
+		glDisable(GL_SCISSOR_TEST);
+	}
+
+	// drop the map, e.g. after the render target was recreated
+	void invalidate() { valid = false; }
+
+	// after update(): true (and a full region) if the map was dropped since, so it is drawn
+	// in this frame instead of the next one
+	bool refresh()
+	{
+		if (valid)
+			return false;
+		return full();
+	}
+
+	// the map was reallocated at another size
+	void resize(int w, int h)
+	{
+		width = w;
+		height = h;
+		valid = false;
+	}
+
+	// "shadow" member for the bench report
+	std::string report() const
+	{
+		static const char *modes[] = { "on_change", "interval", "regions" };
+		std::ostringstream out;
+		out << "\"shadow\": { \"mode\": \"" << modes[mode] << "\", \"frames\": " << frames
+			<< ", \"full_updates\": " << fullUpdates << ", \"region_updates\": " << tileUpdates << " }";
+		return out.str();
+	}
+
+private:
+	struct Caster {
+		const void *id;
+		glm::mat4 model;
+	};
+
+	int width, height;
+	ShadowUpdateMode mode;
+	int interval;
+	int regions;
+
+	glm::mat4 light;
+	std::vector<Caster> casters, previous;
+	bool valid;
+	bool lightChanged;
+	bool moved;			// casters moved since the last full update (interval mode)
+	int pendingTiles;	// tiles still to redraw (regions mode)
+	int nextTile;
+	int framesSinceUpdate;
+	ShadowRegion updated;
+
+	unsigned int frames, fullUpdates, tileUpdates;
+
+	bool full()
+	{
+		updated = ShadowRegion();
+		valid = true;
+		fullUpdates++;
+		framesSinceUpdate = 0;
+		return true;
+	}
+};
+
+#endif
@@ -0,0 +1,118 @@
+#ifndef SHADOW_FILTER_H
+#define SHADOW_FILTER_H
+
+#include <glad/glad.h>
+#include "gpu_resources.h"
+
+#include <cstring>
+#include <iostream>
+
+// How object.fs filters the shadow map, selected with the shadowTier uniform.
+// The values match the SHADOW_* constants in object.fs.
+enum ShadowTier {
+	SHADOW_NONE,		// no shadow lookup at all
+	SHADOW_PCF,			// 3x3 manual depth compares (9 fetches)
+	SHADOW_HARDWARE,	// sampler2DShadow with linear filtering (1 fetch, 2x2 PCF in the sampler)
+	SHADOW_VSM,			// variance shadow map, prefiltered once (1 fetch)
+	SHADOW_TIER_COUNT
+};
+
+static const char *shadowTierNames[SHADOW_TIER_COUNT] = { "none", "pcf", "hardware", "vsm" };
+
+inline bool parseShadowTier(const char *name, ShadowTier &tier)
+{
+	for (int i = 0; i < SHADOW_TIER_COUNT; i++)
+	{
+		if (strcmp(name, shadowTierNames[i]) == 0)
+		{
+			tier = (ShadowTier)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Sampler object that turns a depth texture into a sampler2DShadow lookup:
+// the reference is compared per texel and the results are filtered bilinearly.
+inline unsigned int createShadowCompareSampler()
+{
+	unsigned int sampler = gpuResources().create(GPU_SAMPLER);
+	glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	float borderColor[] = { 1.0, 1.0, 1.0, 1.0 };
+	glSamplerParameterfv(sampler, GL_TEXTURE_BORDER_COLOR, borderColor);
+	glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glSamplerParameteri(sampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	return sampler;
+}
+
+// Depth moments (z, z^2) for the VSM tier. They are computed from the shadow map at
+// a lower resolution and blurred once whenever the map changes, so the lighting pass
+// needs a single filtered fetch. Created on first use.
+class VarianceShadowMap
+{
+public:
+	VarianceShadowMap() : width(0), height(0), valid(false)
+	{
+		FBO[0] = FBO[1] = 0;
+		moments[0] = moments[1] = 0;
+	}
+
+	bool created() const { return FBO[0] != 0; }
+
+	void create(int w, int h)
+	{
+		width = w;
+		height = h;
+		for (int i = 0; i < 2; i++)
+		{
+			FBO[i] = gpuResources().create(GPU_FRAMEBUFFER);
+			moments[i] = gpuResources().create(GPU_TEXTURE);
+			glBindFramebuffer(GL_FRAMEBUFFER, FBO[i]);
+			glBindTexture(GL_TEXTURE_2D, moments[i]);
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, width, height, 0, GL_RG, GL_FLOAT, NULL);
+			gpuResources().allocated(GPU_TEXTURE, moments[i], MEMORY_SHADOW, "shadow moments", GL_RG32F, MemoryTracker::textureBytes(GL_RG32F, width, height));
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+			float borderColor[] = { 1.0, 1.0, 1.0, 1.0 }; // outside the map: depth 1, lit
+			glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
+			glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, moments[i], 0);
+			if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+				std::cout << "Framebuffer not complete!" << std::endl;
+		}
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+		valid = false;
+	}
+
+	// the next use creates them again, e.g. for a new shadow map size
+	void release()
+	{
+		for (int i = 0; i < 2; i++)
+		{
+			gpuResources().destroy(GPU_FRAMEBUFFER, FBO[i]);
+			gpuResources().destroy(GPU_TEXTURE, moments[i]);
+		}
+		valid = false;
+	}
+
+	// the shadow map changed, the moments have to be rebuilt before the next use
+	void invalidate() { valid = false; }
+	bool isValid() const { return valid; }
+	void validate() { valid = true; }
+
+	// the blurred moments end up in moments[0]
+	unsigned int texture() const { return moments[0]; }
+
+	int width, height;
+	unsigned int FBO[2];
+	unsigned int moments[2];
+
+private:
+	bool valid;
+};
+
+#endif
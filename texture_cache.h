@@ -0,0 +1,391 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+#include "bc_encoder.h"
+#include "gpu_resources.h"
+#include "mapped_file.h"
+#include "mesh_format.h"
+#include "texture_format.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Block compressed textures baked next to the source image (water/waterTexture.png ->
+// water/waterTexture.ktx), layout in texture_format.h. Baking decodes the image, builds
+// the full mip chain with a box filter and compresses every level on the CPU
+// (bc_encoder.h), so it runs offline without a GPU (--bake-textures) or on first load.
+// The file is keyed by a hash of the source image, editing the image re-bakes it.
+//   colour maps  BC1, or BC3 if any pixel is not opaque
+//   normal maps  BC5 holding the unit normal's x and y, object.fs rebuilds z
+// Loading reads a valid file as is; without S3TC the BC1/BC3 levels are decoded to RGBA8
+// (BC5 is core since GL 3.0). Nothing here touches GL except upload() and createTexture().
+
+enum TextureKind {
+	TEXTURE_COLOR,
+	TEXTURE_NORMAL
+};
+
+struct BakedLevel {
+	int width, height;
+	size_t offset, size; // into BakedTexture::data
+};
+
+// a loaded texture, ready for upload()
+struct BakedTexture {
+	GLenum internalFormat;
+	GLenum format;		// of uncompressed data
+	bool compressed;
+	std::vector<BakedLevel> levels;
+	std::vector<unsigned char> data;
+	size_t uncompressedBytes; // RGBA8 size of the same chain
+
+	BakedTexture() : internalFormat(0), format(0), compressed(false), uncompressedBytes(0) {}
+};
+
+class TextureCache
+{
+public:
+	// true when the driver takes BC1/BC3; call with a current context
+	static bool s3tcSupported()
+	{
+#ifdef GL_EXT_texture_compression_s3tc
+		return GLAD_GL_EXT_texture_compression_s3tc != 0;
+#else
+		return false;
+#endif
+	}
+
+	static std::string bakedPath(const std::string &source)
+	{
+		size_t dot = source.find_last_of('.');
+		size_t slash = source.find_last_of('/');
+		if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+			return source + ".ktx";
+		return source.substr(0, dot) + ".ktx";
+	}
+
+	// reads the baked file, baking it first if it is missing or stale; no GL calls,
+	// safe on any thread; s3tc false decodes BC1/BC3 to RGBA8
+	static bool load(const std::string &source, TextureKind kind, bool s3tc, unsigned int threads, BakedTexture &result)
+	{
+		uint64_t hash = sourceHash(source, kind);
+		std::string path = bakedPath(source);
+		if (!read(path, hash, result))
+		{
+			if (!bake(source, kind, threads) || !read(path, hash, result))
+				return false;
+		}
+		if (!s3tc && result.internalFormat != GL_COMPRESSED_RG_RGTC2)
+			decompress(result);
+		return true;
+	}
+
+	// bakes source unless its baked file is up to date
+	static bool bake(const std::string &source, TextureKind kind, unsigned int threads)
+	{
+		uint64_t hash = sourceHash(source, kind);
+		std::string path = bakedPath(source);
+		BakedTexture current;
+		if (read(path, hash, current))
+			return true;
+
+		int width, height, channels;
+		unsigned char *pixels = stbi_load(source.c_str(), &width, &height, &channels, 4);
+		if (!pixels)
+		{
+			std::cout << "Texture failed to load at path: " << source << std::endl;
+			return false;
+		}
+		std::cout << "TEXTURE CACHE: baking " << source << std::endl;
+		std::vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4);
+		stbi_image_free(pixels);
+
+		BlockFormat format = BLOCK_BC5;
+		if (kind == TEXTURE_NORMAL)
+			encodeNormals(level);
+		else
+		{
+			format = BLOCK_BC1;
+			for (size_t i = 3; i < level.size(); i += 4)
+				if (level[i] < 255)
+					format = BLOCK_BC3;
+		}
+
+		int baseWidth = width, baseHeight = height;
+		std::vector<std::vector<unsigned char> > chain;
+		for (;;)
+		{
+			chain.push_back(compressImage(format, &level[0], width, height, threads));
+			if (width == 1 && height == 1)
+				break;
+			level = downsample(level, width, height, kind);
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		return write(path, hash, format, baseWidth, baseHeight, chain);
+	}
+
+	// levels from data, a client pointer or an offset into the bound GL_PIXEL_UNPACK_BUFFER;
+	// the texture has to be bound to target's texture target
+	static void upload(GLenum target, const BakedTexture &texture, const unsigned char *data)
+	{
+		for (size_t i = 0; i < texture.levels.size(); i++)
+		{
+			const BakedLevel &level = texture.levels[i];
+			if (texture.compressed)
+				glCompressedTexImage2D(target, (GLint)i, texture.internalFormat, level.width, level.height, 0, (GLsizei)level.size, data + level.offset);
+			else
+				glTexImage2D(target, (GLint)i, texture.internalFormat, level.width, level.height, 0, texture.format, GL_UNSIGNED_BYTE, data + level.offset);
+		}
+	}
+
+	// 2D texture, repeat and trilinear, loaded on the calling thread; 0 if it failed
+	static unsigned int createTexture(const std::string &source, TextureKind kind)
+	{
+		BakedTexture texture;
+		if (!load(source, kind, s3tcSupported(), std::thread::hardware_concurrency(), texture))
+			return 0;
+		GLuint id = gpuResources().create(GPU_TEXTURE);
+		glBindTexture(GL_TEXTURE_2D, id);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		upload(GL_TEXTURE_2D, texture, &texture.data[0]);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		gpuResources().uploaded(texture.data.size(), true);
+		gpuResources().allocated(GPU_TEXTURE, id, MEMORY_TEXTURES, source, texture.internalFormat, texture.data.size());
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		return id;
+	}
+
+private:
+	static uint64_t sourceHash(const std::string &source, TextureKind kind)
+	{
+		uint64_t hash = hashBytes((const unsigned char *)&TEXTURE_BAKE_VERSION, sizeof(TEXTURE_BAKE_VERSION));
+		uint32_t kindValue = (uint32_t)kind;
+		hash = hashBytes((const unsigned char *)&kindValue, sizeof(kindValue), hash);
+		MappedFile file(source);
+		if (file.valid())
+			hash = hashBytes(file.data(), file.size(), hash);
+		return hash;
+	}
+
+	static BlockFormat blockFormat(uint32_t internalFormat, bool &known)
+	{
+		known = true;
+		switch (internalFormat)
+		{
+		case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return BLOCK_BC1;
+		case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT: return BLOCK_BC3;
+		case GL_COMPRESSED_RG_RGTC2: return BLOCK_BC5;
+		}
+		known = false;
+		return BLOCK_BC1;
+	}
+
+	// validates the file and its hash, the levels are copied into result
+	static bool read(const std::string &path, uint64_t hash, BakedTexture &result)
+	{
+		MappedFile file(path);
+		if (!file.valid() || file.size() < sizeof(KtxHeader))
+			return false;
+		const unsigned char *base = file.data();
+		const KtxHeader *header = (const KtxHeader *)base;
+		bool known;
+		BlockFormat format = blockFormat(header->glInternalFormat, known);
+		if (memcmp(header->identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER)) != 0 || header->endianness != KTX_ENDIANNESS
+			|| !known || header->glType != 0 || header->numberOfFaces != 1 || header->numberOfArrayElements != 0
+			|| header->pixelWidth == 0 || header->pixelHeight == 0 || header->numberOfMipmapLevels == 0)
+			return false;
+
+		// the hash entry is the only key/value pair written
+		size_t position = sizeof(KtxHeader);
+		size_t keySize = sizeof(KTX_HASH_KEY) + sizeof(uint64_t);
+		if (header->bytesOfKeyValueData < 4 + keySize || position + header->bytesOfKeyValueData > file.size())
+			return false;
+		uint32_t entrySize;
+		uint64_t storedHash;
+		memcpy(&entrySize, base + position, sizeof(entrySize));
+		memcpy(&storedHash, base + position + 4 + sizeof(KTX_HASH_KEY), sizeof(storedHash));
+		if (entrySize != keySize || memcmp(base + position + 4, KTX_HASH_KEY, sizeof(KTX_HASH_KEY)) != 0 || storedHash != hash)
+			return false;
+		position += header->bytesOfKeyValueData;
+
+		BakedTexture texture;
+		texture.internalFormat = header->glInternalFormat;
+		texture.compressed = true;
+		int width = (int)header->pixelWidth, height = (int)header->pixelHeight;
+		for (uint32_t i = 0; i < header->numberOfMipmapLevels; i++)
+		{
+			uint32_t imageSize;
+			if (position + sizeof(imageSize) > file.size())
+				return false;
+			memcpy(&imageSize, base + position, sizeof(imageSize));
+			position += sizeof(imageSize);
+			size_t expected = (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+			if (imageSize != expected || position + imageSize > file.size())
+				return false;
+			BakedLevel level = { width, height, texture.data.size(), imageSize };
+			texture.levels.push_back(level);
+			texture.data.insert(texture.data.end(), base + position, base + position + imageSize);
+			texture.uncompressedBytes += (size_t)width * height * 4;
+			position += (imageSize + 3) & ~(size_t)3;
+			width = std::max(1, width / 2);
+			height = std::max(1, height / 2);
+		}
+		result = std::move(texture);
+		return true;
+	}
+
+	static bool write(const std::string &path, uint64_t hash, BlockFormat format, int width, int height, const std::vector<std::vector<unsigned char> > &chain)
+	{
+		static const GLenum internalFormats[] = { GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RG_RGTC2 };
+		static const GLenum baseFormats[] = { GL_RGB, GL_RGBA, GL_RG };
+		KtxHeader header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.identifier, KTX_IDENTIFIER, sizeof(KTX_IDENTIFIER));
+		header.endianness = KTX_ENDIANNESS;
+		header.glTypeSize = 1;
+		header.glInternalFormat = internalFormats[format];
+		header.glBaseInternalFormat = baseFormats[format];
+		header.pixelWidth = (uint32_t)width;
+		header.pixelHeight = (uint32_t)height;
+		header.numberOfFaces = 1;
+		header.numberOfMipmapLevels = (uint32_t)chain.size();
+		uint32_t entrySize = (uint32_t)(sizeof(KTX_HASH_KEY) + sizeof(hash));
+		header.bytesOfKeyValueData = (4 + entrySize + 3) & ~3u;
+
+		// workers may bake the same image at once, each writes its own temporary file
+		static std::atomic<unsigned int> temporaries(0);
+		std::string tmpPath = path + "." + std::to_string(temporaries++) + ".tmp";
+		std::ofstream out(tmpPath.c_str(), std::ios::binary | std::ios::trunc);
+		if (!out)
+			return false;
+		const char zeros[4] = { 0 };
+		out.write((const char *)&header, sizeof(header));
+		out.write((const char *)&entrySize, sizeof(entrySize));
+		out.write(KTX_HASH_KEY, sizeof(KTX_HASH_KEY));
+		out.write((const char *)&hash, sizeof(hash));
+		out.write(zeros, header.bytesOfKeyValueData - 4 - entrySize);
+		for (size_t i = 0; i < chain.size(); i++)
+		{
+			uint32_t imageSize = (uint32_t)chain[i].size();
+			out.write((const char *)&imageSize, sizeof(imageSize));
+			out.write((const char *)&chain[i][0], imageSize);
+			out.write(zeros, ((imageSize + 3) & ~3u) - imageSize);
+		}
+		out.close();
+		if (!out)
+		{
+			std::remove(tmpPath.c_str());
+			return false;
+		}
+		std::remove(path.c_str());
+		return std::rename(tmpPath.c_str(), path.c_str()) == 0;
+	}
+
+	// unit normal from the rgb of a normal map, its x and y into red and green
+	static void encodeNormals(std::vector<unsigned char> &pixels)
+	{
+		for (size_t i = 0; i < pixels.size(); i += 4)
+		{
+			float n[3];
+			for (int k = 0; k < 3; k++)
+				n[k] = pixels[i + k] / 255.0f * 2.0f - 1.0f;
+			float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length < 1e-4f)
+			{
+				n[0] = n[1] = 0.0f;
+				length = 1.0f;
+			}
+			pixels[i + 0] = toByte(n[0] / length * 0.5f + 0.5f);
+			pixels[i + 1] = toByte(n[1] / length * 0.5f + 0.5f);
+			pixels[i + 2] = 0;
+			pixels[i + 3] = 255;
+		}
+	}
+
+	static unsigned char toByte(float value)
+	{
+		return (unsigned char)std::min(255.0f, std::max(0.0f, value * 255.0f + 0.5f));
+	}
+
+	// next mip level, the average of 2x2 texels (the last row / column of odd sizes is left
+	// out, a size of 1 averages its texels with themselves); normals are averaged as vectors
+	// and renormalised
+	static std::vector<unsigned char> downsample(const std::vector<unsigned char> &pixels, int width, int height, TextureKind kind)
+	{
+		int w = std::max(1, width / 2), h = std::max(1, height / 2);
+		std::vector<unsigned char> result((size_t)w * h * 4);
+		for (int y = 0; y < h; y++)
+		{
+			for (int x = 0; x < w; x++)
+			{
+				int x0 = std::min(x * 2, width - 1), x1 = std::min(x * 2 + 1, width - 1);
+				int y0 = std::min(y * 2, height - 1), y1 = std::min(y * 2 + 1, height - 1);
+				const unsigned char *texels[4] = {
+					&pixels[((size_t)y0 * width + x0) * 4], &pixels[((size_t)y0 * width + x1) * 4],
+					&pixels[((size_t)y1 * width + x0) * 4], &pixels[((size_t)y1 * width + x1) * 4]
+				};
+				unsigned char *out = &result[((size_t)y * w + x) * 4];
+				if (kind == TEXTURE_NORMAL)
+				{
+					float n[3] = { 0.0f, 0.0f, 0.0f };
+					for (int t = 0; t < 4; t++)
+					{
+						float nx = texels[t][0] / 255.0f * 2.0f - 1.0f, ny = texels[t][1] / 255.0f * 2.0f - 1.0f;
+						n[0] += nx;
+						n[1] += ny;
+						n[2] += std::sqrt(std::max(0.0f, 1.0f - nx * nx - ny * ny));
+					}
+					float length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+					out[0] = toByte(length > 1e-4f ? n[0] / length * 0.5f + 0.5f : 0.5f);
+					out[1] = toByte(length > 1e-4f ? n[1] / length * 0.5f + 0.5f : 0.5f);
+					out[2] = 0;
+					out[3] = 255;
+				}
+				else
+				{
+					for (int k = 0; k < 4; k++)
+						out[k] = (unsigned char)((texels[0][k] + texels[1][k] + texels[2][k] + texels[3][k] + 2) / 4);
+				}
+			}
+		}
+		return result;
+	}
+
+	// BC1/BC3 levels to RGBA8 for drivers without S3TC
+	static void decompress(BakedTexture &texture)
+	{
+		bool known;
+		BlockFormat format = blockFormat(texture.internalFormat, known);
+		std::vector<unsigned char> data;
+		for (size_t i = 0; i < texture.levels.size(); i++)
+		{
+			BakedLevel &level = texture.levels[i];
+			std::vector<unsigned char> pixels = decompressImage(format, &texture.data[level.offset], level.width, level.height);
+			level.offset = data.size();
+			level.size = pixels.size();
+			data.insert(data.end(), pixels.begin(), pixels.end());
+		}
+		texture.data.swap(data);
+		texture.internalFormat = format == BLOCK_BC1 ? GL_RGB8 : GL_RGBA8;
+		texture.format = GL_RGBA;
+		texture.compressed = false;
+	}
+};
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef TEXTURE_FORMAT_H
+#define TEXTURE_FORMAT_H
+
+#include <cstdint>
+
+// On-disk layout of a baked texture (see texture_cache.h), a KTX 1.1 file:
+//   KtxHeader
+//   key/value data: uint32 size, "sourceHash\0", uint64 hash, padded to 4 bytes
+//   per mip level: uint32 imageSize, then imageSize bytes padded to 4 bytes
+// Only 2D textures with one face are written; a cube map is baked as six of them.
+
+const unsigned char KTX_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n' };
+const uint32_t KTX_ENDIANNESS = 0x04030201;
+const char KTX_HASH_KEY[] = "sourceHash";
+const uint32_t TEXTURE_BAKE_VERSION = 1; // part of the source hash, bump when the encoder changes
+
+// not every glad build has the extension tokens
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+
+struct KtxHeader {
+	unsigned char identifier[12];
+	uint32_t endianness;
+	uint32_t glType;				// 0 for compressed formats
+	uint32_t glTypeSize;
+	uint32_t glFormat;				// 0 for compressed formats
+	uint32_t glInternalFormat;
+	uint32_t glBaseInternalFormat;
+	uint32_t pixelWidth;
+	uint32_t pixelHeight;
+	uint32_t pixelDepth;
+	uint32_t numberOfArrayElements;
+	uint32_t numberOfFaces;
+	uint32_t numberOfMipmapLevels;
+	uint32_t bytesOfKeyValueData;
+};
+
+static_assert(sizeof(KtxHeader) == 64, "ktx layout");
+
+#endif